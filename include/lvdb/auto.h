@@ -222,7 +222,10 @@ namespace lv
 
 		virtual void do_save() {
 			if (db_) {
-				db_->set(key_, Bytes_Local_T<VALUE>(value_));
+				// a full writer queue leaves it dirty for the next tick
+				if (db_->async_set(key_, Bytes_Local_T<VALUE>(value_)) == -1) {
+					this->dirty(true);
+				}
 			}
 		}
 
@@ -259,7 +262,9 @@ namespace lv
 
 		virtual void do_save() {
 			if (db_) {
-				db_->hset(name_, key_, Bytes_Local_T<VALUE>(value_));
+				if (db_->async_hset(name_, key_, Bytes_Local_T<VALUE>(value_)) == -1) {
+					this->dirty(true);
+				}
 			}
 		}
 
@@ -300,7 +305,9 @@ namespace lv
 			if (db_) {
 				toolkit::Binary buf;
 				encode_pb_T(buf, Auto_Save_Object_T<OBJ>::get());
-				db_->set(key_, Bytes(buf) );
+				if (db_->async_set(key_, Bytes(buf)) == -1) {
+					this->dirty(true);
+				}
 			}
 		}
 
@@ -337,7 +344,9 @@ namespace lv
 			if (db_) {
 				toolkit::Binary buf;
 				encode_pb_T(buf, Auto_Save_Object_T<OBJ>::get());
-				db_->hset(name_, key_, Bytes(buf) );
+				if (db_->async_hset(name_, key_, Bytes(buf)) == -1) {
+					this->dirty(true);
+				}
 			}
 		}
 
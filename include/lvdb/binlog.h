@@ -3,6 +3,7 @@
 
 #include "lvdb/bytes.h"
 #include <string>
+#include <vector>
 
 
 namespace leveldb
@@ -18,6 +19,8 @@ namespace lv
 	public:
 		Binlog(){}
 		Binlog(uint64_t seq, char type, char cmd, const leveldb::Slice &key);
+		// a binlog carrying the value written to key
+		Binlog(uint64_t seq, char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val);
 
 	public:
 		int load(const Bytes &s);
@@ -28,6 +31,21 @@ namespace lv
 		char type() const;
 		char cmd() const;
 		const Bytes key() const;
+		// the kv key or the container name written, read from key()
+		const Bytes name() const;
+		bool has_val() const;
+		// empty unless has_val()
+		const Bytes val() const;
+		// the same binlog without its value
+		Binlog without_val() const;
+
+		// A BEGIN binlog packs the writes of one transaction under a single
+		// seq, in place of the key, each as type, cmd, fixed32 key length,
+		// key, fixed32 value length (0xffffffff without value) and value.
+		void add_entry(char type, char cmd, const leveldb::Slice &key);
+		void add_entry(char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val);
+		// the writes of a BEGIN binlog as binlogs with its seq, -1 if corrupt
+		int entries(std::vector<Binlog> *logs) const;
 
 		const char* data() const{
 			return buf.data();
@@ -43,6 +61,10 @@ namespace lv
 	private:
 		std::string buf;
 		static const unsigned int HEADER_LEN = sizeof(uint64_t) + 2;
+		// set in the type byte when the key length and the value follow the header
+		static const char VALUE_FLAG = 0x40;
+
+		bool valid() const;
 
 	};
 
@@ -289,6 +289,16 @@ namespace lv
 			size = 0;
 			return n;
 		}
+		// Bytes variants point into the decoded buffer instead of copying
+		int read_data(Bytes *ret){
+			int n = size;
+			if (ret){
+				*ret = Bytes(p, size);
+			}
+			p += size;
+			size = 0;
+			return n;
+		}
 		int read_8_data(std::string *ret = NULL){
 			if (size < 1){
 				return -1;
@@ -306,6 +316,23 @@ namespace lv
 			size -= len;
 			return 1 + len;
 		}
+		int read_8_data(Bytes *ret){
+			if (size < 1){
+				return -1;
+			}
+			int len = (uint8_t)p[0];
+			p += 1;
+			size -= 1;
+			if (size < len){
+				return -1;
+			}
+			if (ret){
+				*ret = Bytes(p, len);
+			}
+			p += len;
+			size -= len;
+			return 1 + len;
+		}
 	};
 
 }
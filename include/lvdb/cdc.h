@@ -0,0 +1,88 @@
+#pragma once
+
+
+#include "lvdb.h"
+#include "lvdb/binlog.h"
+
+
+namespace lv
+{
+	class LVDB_Impl;
+
+	// the binlogs a Cdc_Cursor returns, an empty field matches everything
+	struct Cdc_Filter
+	{
+		// DataType::KV, HASH, ZSET or QUEUE
+		std::string types;
+		// prefix of the kv key or of the container name
+		std::string prefix;
+		// BinlogCommand values
+		std::string cmds;
+
+		// evaluated on the encoded key of log, which is not decoded
+		bool match(const Binlog &log) const;
+	};
+
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// change data capture, the binlogs of the writes matching a filter in seq order
+	//
+	// commit() saves the position as the "<name>:cdc:seq" meta, a cursor
+	// opened again with the same name resumes after the last binlog
+	// committed, a new name starts after the last binlog of the db. The
+	// writes of a BEGIN binlog are returned one by one with the seq of their
+	// transaction. Values are only returned when their binlogs store them,
+	// see Options::binlog_inline_value.
+	//
+	// The binlogs dropped before the cursor read them, by the capacity of
+	// the binlogs or by flushdb, are reported once by next() as lost.
+	class Cdc_Cursor
+	{
+	public:
+		// db must not be sharded, subscribe to each of its shard(i)
+		Cdc_Cursor(LVDB* db, const std::string& name, const Cdc_Filter& filter);
+
+		/** reads up to limit binlogs at a time
+		 @returns
+		 >0: number of matching binlogs in logs
+		 0 : none within timeout_ms
+		 -1: error
+		 -2: the binlogs [lost_begin(), lost_end()] were dropped before they
+		     were read, the cursor is past them. The binlogs read before the
+		     gap are returned first, the gap by the next call.
+		 */
+		int next(std::vector<Binlog>* logs, int limit, int timeout_ms);
+		// saves the position, up to the last binlog read by next()
+		int commit();
+		// deletes the saved position
+		int remove();
+
+		// the last binlog read by next(), matching or not
+		uint64_t seq() const{
+			return next_seq_ - 1;
+		}
+
+		// the last range next() returned -2 for
+		uint64_t lost_begin() const{
+			return lost_begin_;
+		}
+		uint64_t lost_end() const{
+			return lost_end_;
+		}
+
+	private:
+		int lost(uint64_t begin, uint64_t end);
+
+		LVDB* db_;
+		// the db of the binlogs, NULL when db is sharded
+		LVDB_Impl* impl_;
+		std::string seq_key_;
+		Cdc_Filter filter_;
+		uint64_t next_seq_;
+		uint64_t lost_begin_;
+		uint64_t lost_end_;
+	};
+
+
+}
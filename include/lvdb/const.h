@@ -5,6 +5,22 @@ namespace lv
 {
 	static const int SSDB_SCORE_WIDTH = 9;
 	static const int SSDB_KEY_LEN_MAX = 255;
+	// keys deleted per transaction by flushdb and the clear operates
+	static const int SSDB_CLEAR_BATCH = 10000;
+	// binlogs read by a sync cursor at a time
+	static const int SSDB_SYNC_BATCH = 1000;
+
+	// how a read uses the leveldb block cache
+	class ReadPolicy{
+	public:
+		// the policy configured in Options for the operate
+		static const int DEFAULT = -1;
+		// look up the blocks in the cache and keep the ones read from disk
+		static const int CACHE = 0;
+		// look up the blocks in the cache only, for one-off bulk reads
+		static const int NO_CACHE = 1;
+		static const int COUNT = 2;
+	};
 
 	class DataType{
 	public:
@@ -16,6 +32,7 @@ namespace lv
 		static const char ZSET = 's'; // key => score
 		static const char ZSCORE = 'z'; // key|score => ""
 		static const char ZSIZE = 'Z';
+		static const char ZRANK = 'R'; // zset order-statistics index
 		static const char QUEUE = 'q';
 		static const char QSIZE = 'Q';
 		static const char MIN_PREFIX = HASH;
@@ -72,6 +89,11 @@ namespace lv
 		static const char QPOP_FRONT = 13;
 		static const char QSET = 14;
 
+		// key is the name of the container
+		static const char HCLEAR = 15;
+		static const char ZCLEAR = 16;
+		static const char QCLEAR = 17;
+
 		static const char BEGIN = 7;
 		static const char END = 8;
 	};
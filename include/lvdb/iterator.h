@@ -4,6 +4,7 @@
 #include <inttypes.h>
 #include <string>
 #include "bytes.h"
+#include "const.h"
 
 
 namespace leveldb{
@@ -12,6 +13,8 @@ namespace leveldb{
 
 namespace lv
 {
+	class Iterator_Pool;
+
 	class Iterator{
 	public:
 		enum Direction{
@@ -20,7 +23,9 @@ namespace lv
 		Iterator(leveldb::Iterator *it,
 			const std::string &end,
 			uint64_t limit,
-			Direction direction = Iterator::FORWARD);
+			Direction direction = Iterator::FORWARD,
+			Iterator_Pool *pool = NULL,
+			int policy = ReadPolicy::DEFAULT);
 		~Iterator();
 		int release();
 		bool skip(uint64_t offset);
@@ -30,6 +35,10 @@ namespace lv
 
 	private:
 		leveldb::Iterator *it;
+		// it goes back to the pool instead of being deleted
+		Iterator_Pool *pool;
+		// ReadPolicy the reads of it are counted for
+		int policy;
 		std::string end;
 		uint64_t limit;
 		bool is_first;
@@ -47,9 +56,16 @@ namespace lv
 		int release();
 		void return_val(bool onoff);
 		bool next();
+		// like next() but only fills the views below, they point into the
+		// leveldb iterator and are valid until the next next()/next_view()
+		bool next_view();
+		Bytes key_view() const{ return key_view_; }
+		Bytes val_view() const{ return val_view_; }
 	private:
 		Iterator *it;
 		bool return_val_;
+		Bytes key_view_;
+		Bytes val_view_;
 	};
 
 
@@ -64,9 +80,16 @@ namespace lv
 		int release();
 		void return_val(bool onoff);
 		bool next();
+		// like next() but only fills the views below, they point into the
+		// leveldb iterator and are valid until the next next()/next_view()
+		bool next_view();
+		Bytes key_view() const{ return key_view_; }
+		Bytes val_view() const{ return val_view_; }
 	private:
 		Iterator *it;
 		bool return_val_;
+		Bytes key_view_;
+		Bytes val_view_;
 	};
 
 
@@ -81,8 +104,15 @@ namespace lv
 		int release();
 		bool skip(uint64_t offset);
 		bool next();
+		// like next() but only fills the views below, they point into the
+		// leveldb iterator and are valid until the next next()/next_view()
+		bool next_view();
+		Bytes key_view() const{ return key_view_; }
+		int64_t score_value() const{ return score_value_; }
 	private:
 		Iterator *it;
+		Bytes key_view_;
+		int64_t score_value_;
 	};
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include <functional>
 #include <vector>
 #include <string>
 #include "lvdb/const.h"
@@ -12,6 +13,52 @@ namespace lv
 {
 	class Bytes;
 	class Config;
+	class Cdc_Cursor;
+	struct Cdc_Filter;
+
+	// values returned by the multi get operates, all of them are stored in
+	// one buffer which can be reused across calls
+	class Multi_Values{
+	public:
+		void clear(){
+			arena.clear();
+			items.clear();
+		}
+		size_t size() const{
+			return items.size();
+		}
+		bool found(size_t i) const{
+			return items[i].second >= 0;
+		}
+		// only valid until the next call that fills this object
+		Bytes value(size_t i) const{
+			if (items[i].second < 0){
+				return Bytes();
+			}
+			return Bytes(arena.data() + items[i].first, items[i].second);
+		}
+
+		std::string arena;
+		// offset in arena and length of each value, length -1: not found
+		std::vector<std::pair<size_t, int> > items;
+	};
+
+	// overrides the read policy of the operates called by this thread while
+	// it is alive, e.g. Read_Hint hint(ReadPolicy::NO_CACHE) around a
+	// one-off export
+	class Read_Hint{
+	public:
+		Read_Hint(int policy);
+		~Read_Hint();
+		// the hint of the calling thread, ReadPolicy::DEFAULT when none
+		static int current();
+	private:
+		int prev;
+	};
+
+	// the end of an async write, on the writer thread of the db: ret is what
+	// the synchronous operate returned, new_val the new value of the incr ones
+	typedef std::function<void(int64_t ret, int64_t new_val)> Async_Callback;
 
 	class LVDB{
 	public:
@@ -25,6 +72,16 @@ namespace lv
 
 		virtual int release() = 0;
 
+		// the dbs holding the data when Options::shards > 1, each of them has
+		// its own binlogs, so a Sync or a Copy runs on one shard. a db that
+		// is not sharded is its only shard
+		virtual int shards() const{
+			return 1;
+		}
+		virtual LVDB* shard(int i){
+			return this;
+		}
+
 		virtual int flushdb() = 0;
 
 		// return (start, end], not include start
@@ -50,6 +107,11 @@ namespace lv
 		virtual int meta_del(const Bytes &key) = 0;
 		virtual int meta_list(std::vector<std::string> *list) = 0;
 
+		// a change data capture cursor over the binlogs, see lvdb/cdc.h,
+		// deleted by the caller. NULL on a sharded db, whose shard(i) each
+		// have their own binlogs
+		virtual Cdc_Cursor* subscribe(const std::string &name, const Cdc_Filter &filter) = 0;
+
 		/* key value */
 
 		virtual int set(const Bytes &key, const Bytes &val, char log_type = BinlogType::SYNC) = 0;
@@ -57,12 +119,20 @@ namespace lv
 		virtual int del(const Bytes &key, char log_type = BinlogType::SYNC) = 0;
 		// -1: error, 1: ok, 0: value is not an integer or out of range
 		virtual int incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC) = 0;
+		// the number of keys written, 0 with an empty key and nothing written.
+		// With Options::shards > 1 they are not atomic: the keys of each shard
+		// are written by a transaction of their own, in shard order, and when
+		// one fails, the keys of the shards before it stay written. Their
+		// number is returned then, less than the keys given, -1 if none.
 		virtual int multi_set(const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC) = 0;
 		virtual int multi_del(const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC) = 0;
 		virtual int set_bit(const Bytes &key, int bitoffset, int on, char log_type = BinlogType::SYNC) = 0;
 		virtual int get_bit(const Bytes &key, int bitoffset) = 0;
 
 		virtual int get(const Bytes &key, std::string *val) = 0;
+		// read all keys from one snapshot, vals->value(i) is the value of keys[offset + i]
+		// @return -1: error, other: the number of keys found
+		virtual int multi_get(const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0) = 0;
 		virtual int getset(const Bytes &key, std::string *val, const Bytes &newval, char log_type = BinlogType::SYNC) = 0;
 		// return (start, end]
 		virtual KIterator* scan(const Bytes &start, const Bytes &end, uint64_t limit) = 0;
@@ -74,10 +144,16 @@ namespace lv
 		virtual int hdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC) = 0;
 		// -1: error, 1: ok, 0: value is not an integer or out of range
 		virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC) = 0;
+		// @return -1: error, other: the number of new items inserted
+		virtual int multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC) = 0;
+		// @return -1: error, other: the number of items deleted
+		virtual int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC) = 0;
 
 		virtual int64_t hsize(const Bytes &name) = 0;
-		virtual int64_t hclear(const Bytes &name) = 0;
+		// @return -1: error, other: the number of items deleted
+		virtual int64_t hclear(const Bytes &name, char log_type = BinlogType::SYNC) = 0;
 		virtual int hget(const Bytes &name, const Bytes &key, std::string *val) = 0;
+		virtual int multi_hget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0) = 0;
 		virtual int hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list) = 0;
 		virtual int hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
@@ -91,12 +167,18 @@ namespace lv
 		virtual int zdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC) = 0;
 		// -1: error, 1: ok, 0: value is not an integer or out of range
 		virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC) = 0;
+		// @return -1: error, other: the number of new items inserted
+		virtual int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC) = 0;
+		// @return -1: error, other: the number of items deleted
+		virtual int multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC) = 0;
 
 		virtual int64_t zsize(const Bytes &name) = 0;
+		virtual int64_t zclear(const Bytes &name, char log_type = BinlogType::SYNC) = 0;
 		/**
 		 * @return -1: error; 0: not found; 1: found
 		 */
 		virtual int zget(const Bytes &name, const Bytes &key, std::string *score) = 0;
+		virtual int multi_zget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *scores, int offset = 0) = 0;
 		virtual int64_t zrank(const Bytes &name, const Bytes &key) = 0;
 		virtual int64_t zrrank(const Bytes &name, const Bytes &key) = 0;
 		virtual ZIterator* zrange(const Bytes &name, uint64_t offset, uint64_t limit) = 0;
@@ -116,6 +198,7 @@ namespace lv
 		virtual int64_t zfix(const Bytes &name) = 0;
 
 		virtual int64_t qsize(const Bytes &name) = 0;
+		virtual int64_t qclear(const Bytes &name, char log_type = BinlogType::SYNC) = 0;
 		// @return 0: empty queue, 1: item peeked, -1: error
 		virtual int qfront(const Bytes &name, std::string *item) = 0;
 		// @return 0: empty queue, 1: item peeked, -1: error
@@ -136,6 +219,24 @@ namespace lv
 		virtual int qget(const Bytes &name, int64_t index, std::string *item) = 0;
 		virtual int qset(const Bytes &name, int64_t index, const Bytes &item, char log_type = BinlogType::SYNC) = 0;
 		virtual int qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type = BinlogType::SYNC) = 0;
+
+		/* async writes */
+
+		// queue the write for the writer thread of the db and return at once,
+		// done runs once it is written. the writes of a container are
+		// applied in the order they were queued
+		// @return 1: queued, -1: the queue is full, nothing is written
+		virtual int async_set(const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_del(const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_incr(const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_hset(const Bytes &name, const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_hdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_hincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_zset(const Bytes &name, const Bytes &key, const Bytes &score, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_zdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_zincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_qpush_front(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
+		virtual int async_qpush_back(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC) = 0;
 	};
 
 
@@ -2,6 +2,7 @@
 
 
 #include <string>
+#include "lvdb/const.h"
 
 
 namespace lv
@@ -25,6 +26,38 @@ namespace lv
 		bool compression;
 		bool binlog;
 		size_t binlog_capacity;
+		// values up to this many bytes are stored in the binlogs of their
+		// writes, so Sync ships them without reading the db. larger ones are
+		// read when shipped, 0 stores no value
+		size_t binlog_inline_value;
+		// the binlogs of a transaction writing several keys are stored as one
+		// BEGIN binlog with a single seq, which replicas apply in one batch.
+		// older replicas can't read them
+		bool binlog_group;
+		// maintain the order-statistics index used by zrank/zrrank
+		bool zset_rank_index;
+		// milliseconds a released leveldb iterator may be reused by the
+		// scans of its thread, and so how late they may see the writes of
+		// the other threads, 0, the default, creates a new iterator for
+		// every scan
+		int iterator_max_age;
+		// ReadPolicy of the get operates, of the scans and of the bulk reads
+		// made by flushdb, the clear operates, Copy and Sync
+		int point_read_policy;
+		int scan_read_policy;
+		int bulk_read_policy;
+		// number of leveldb instances the containers are spread over by name,
+		// kept in dir, open() fails for a dir of another count
+		int shards;
+		// hash, zset and queue counters kept in memory, 0 reads them from
+		// leveldb every time
+		int size_cache;
+		// MB of memory for the values of the hot keys read by get, hget and
+		// zget, 0 disables the cache
+		size_t value_cache;
+		// async writes the writer thread of a db may be behind by, 0 makes
+		// the async_* operates write on the calling thread
+		size_t async_queue;
 
 		Options() {
 			dir = "lvdb/";
@@ -36,6 +69,17 @@ namespace lv
 			binlog = true;
 			max_open_files = 500;
 			binlog_capacity = LOG_QUEUE_SIZE;
+			binlog_inline_value = 0;
+			binlog_group = false;
+			zset_rank_index = true;
+			iterator_max_age = 0;
+			point_read_policy = ReadPolicy::CACHE;
+			scan_read_policy = ReadPolicy::CACHE;
+			bulk_read_policy = ReadPolicy::NO_CACHE;
+			shards = 1;
+			size_cache = 100000;
+			value_cache = 0;
+			async_queue = 65536;
 		};
 
 		static Options load(const char* fn, const char* db);
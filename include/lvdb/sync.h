@@ -4,6 +4,7 @@
 #include "lvdb.h"
 #include "lvdb/binlog.h"
 #include "toolkits/thread.h"
+#include "pthread.h"
 
 
 namespace lv
@@ -11,39 +12,92 @@ namespace lv
 	class Sync;
 	class Copy;
 	class Sync_Processor;
+	class LVDB_Impl;
+
+
+
+	// a binlog with the value it carries to the slave
+	struct Sync_Item
+	{
+		Binlog log;
+		// false for the commands without value, dels, pops and clears
+		bool has_val;
+		std::string val;
+	};
+
+	// packs the items into one buffer for the link, as fixed32 length +
+	// Binlog::repr() + fixed32 length (0xffffffff without value) + value
+	void encode_sync_batch(const std::vector<Sync_Item>& items, std::string* buf);
+	int decode_sync_batch(const Bytes& buf, std::vector<Sync_Item>* items);
 
 
 
 	//////////////////////////////////////////////////////////////////////////
+	// ships the binlogs after the "<name>:sync:seq" checkpoint. svc returns
+	// -1 at the first binlog dropped before it was shipped, the slave needs
+	// a Copy of the same name then
 	class Sync : public toolkit::Thread
 	{
 	public:
+		// db must not be sharded, a Sync runs on one of its shard(i)
 		Sync(const std::string& name, LVDB* db, Sync_Processor*);
 
+		// ask svc to return, it notices within one wait interval
+		void quit();
+		// svc returned, after quit() or at a binlog gap, the db may be released
+		bool stopped() const{
+			return stopped_;
+		}
+
 	private:
 		virtual int svc();
 
 	private:
 		std::string name_;
 		LVDB* db_;
+		// the db of the binlogs, NULL when db is sharded
+		LVDB_Impl* impl_;
 		Sync_Processor *sync_;
+		volatile bool quit_;
+		volatile bool stopped_;
 	};
 
 
 
 	//////////////////////////////////////////////////////////////////////////
+	// full copy of a snapshot of the db
+	//
+	// The key range is split into one shard per processor, each shard is
+	// copied by its own thread and checkpoints its last key in meta, so an
+	// interrupted copy resumes. When every shard is done, "<name>:sync:seq"
+	// is set to the binlog seq of the snapshot, a Sync with the same name
+	// continues from there.
 	class Copy : public toolkit::Thread
 	{
 	public:
+		// db must not be sharded, a Copy runs on one of its shard(i)
 		Copy(const std::string& name, LVDB* db, Sync_Processor*);
+		Copy(const std::string& name, LVDB* db, const std::vector<Sync_Processor*>& syncs);
+
+		// svc returned, finished or stopped by an error
+		bool stopped() const{
+			return stopped_;
+		}
 
 	private:
 		virtual int svc();
 
+		struct Shard;
+		static void* shard_thread(void *arg);
+		int copy_shard(Shard *shard);
+
 	private:
 		std::string name_;
 		LVDB* db_;
-		Sync_Processor *sync_;
+		// the db of the snapshot, NULL when db is sharded
+		LVDB_Impl* impl_;
+		std::vector<Sync_Processor*> syncs_;
+		volatile bool stopped_;
 	};
 
 
@@ -53,6 +107,10 @@ namespace lv
 	{
 	public:
 		virtual int do_sync(Binlog& log, const char* val, int len) = 0;
+
+		// the binlogs read by one sync step, in seq order. the default ships
+		// them one by one through do_sync()
+		virtual int do_sync_batch(std::vector<Sync_Item>& items);
 	};
 
 
@@ -80,22 +138,73 @@ namespace lv
 			return link_->send_lvdb_sync(log.repr(), val);
 		}
 
-	private:
+	protected:
 		LINK *link_;
 	};
 
 
 
+	// ships a sync step in one message, for the links that also implement
+	// send_lvdb_sync_batch(), see encode_sync_batch()
+	template<typename LINK>
+	class Backup_Client_Batch_Processor : public Backup_Client_Processor<LINK>
+	{
+	public:
+		Backup_Client_Batch_Processor(LINK *link) : Backup_Client_Processor<LINK>(link) {}
+
+		virtual int do_sync_batch(std::vector<Sync_Item>& items)
+		{
+			std::string buf;
+			encode_sync_batch(items, &buf);
+			return this->link_->send_lvdb_sync_batch(buf);
+		}
+	};
+
+
+
 	//////////////////////////////////////////////////////////////////////////
 	class Backup_Server_Processor : public Sync_Processor
 	{
 	public:
-		Backup_Server_Processor(LVDB* db);
+		// name: the applied seq of a batch is saved as the "<name>:sync:seq"
+		// meta in the same write, no checkpoint when empty
+		// lanes: threads preparing the writes of a batch. the binlogs of a
+		// container always go to the same lane, in seq order, 1 applies
+		// them on the calling thread. db must not be sharded, every item is
+		// refused otherwise
+		Backup_Server_Processor(LVDB* db, const std::string& name = "", int lanes = 1);
+		virtual ~Backup_Server_Processor();
 
 		virtual int do_sync(Binlog& log, const char* val, int len);
+		// applies the batch with one write, the clears split it
+		virtual int do_sync_batch(std::vector<Sync_Item>& items);
+
+		// the last seq saved by do_sync_batch(), 0 if none
+		uint64_t last_seq();
 
 	protected:
 		LVDB* db_;
+		std::string name_;
+
+	private:
+		// the db the batches are written to, NULL when db is sharded
+		LVDB_Impl* impl_;
+		struct Lane;
+		std::vector<Lane*> lanes_;
+		// guards the fields below and the lanes
+		pthread_mutex_t mutex_;
+		pthread_cond_t work_cond_;
+		pthread_cond_t done_cond_;
+		// the batch handed to the lanes and the last one joined
+		uint64_t round_;
+		uint64_t joined_;
+		// lanes still preparing round_
+		int preparing_;
+		bool quit_;
+
+		// applies items[begin, end) to the batch of the calling thread
+		int apply(std::vector<Sync_Item>& items, size_t begin, size_t end);
+		static void* lane_thread(void *arg);
 	};
 
 
@@ -53,4 +53,22 @@ namespace lv
 		return 0;
 	}
 
+	inline static
+		int decode_hash_key(const Bytes &slice, Bytes *name, Bytes *key){
+		Decoder decoder(slice.data(), slice.size());
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		if (decoder.read_8_data(name) == -1){
+			return -1;
+		}
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		if (decoder.read_data(key) == -1){
+			return -1;
+		}
+		return 0;
+	}
+
 }
@@ -26,5 +26,17 @@ namespace lv
 		return 0;
 	}
 
+	static inline
+		int decode_kv_key(const Bytes &slice, Bytes *key){
+		Decoder decoder(slice.data(), slice.size());
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		if (decoder.read_data(key) == -1){
+			return -1;
+		}
+		return 0;
+	}
+
 }
 
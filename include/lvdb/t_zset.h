@@ -80,6 +80,53 @@ namespace lv
 		return buf;
 	}
 
+	// items per block of the zrank index. A block is split once it holds
+	// twice as many, and folded into the block before it once it holds
+	// less than a quarter
+	static const int ZRANK_BLOCK_ITEMS = 512;
+	static const char ZRANK_ROOT = 'B';
+	static const char ZRANK_BLOCK = 'b';
+
+	// type, len, name, ZRANK_ROOT => version, bumped when the blocks change
+	static inline
+		std::string encode_zrank_root(const Bytes &name){
+		std::string buf;
+		buf.append(1, DataType::ZRANK);
+		buf.append(1, (uint8_t)name.size());
+		buf.append(name.data(), name.size());
+		buf.append(1, ZRANK_ROOT);
+		return buf;
+	}
+
+	// type, len, name, ZRANK_BLOCK, first zscore key without its type and
+	// name => number of items from it to the next block. The first block
+	// starts with an empty key
+	static inline
+		std::string encode_zrank_block(const Bytes &name, const Bytes &zscore_key){
+		std::string buf;
+		buf.append(1, DataType::ZRANK);
+		buf.append(1, (uint8_t)name.size());
+		buf.append(name.data(), name.size());
+		buf.append(1, ZRANK_BLOCK);
+		if (zscore_key.size() > 2 + name.size()){
+			buf.append(zscore_key.data() + 2 + name.size(), zscore_key.size() - 2 - name.size());
+		}
+		return buf;
+	}
+
+	// the first zscore key of a block
+	static inline
+		std::string decode_zrank_block(const Bytes &name, const Bytes &block_key){
+		std::string buf;
+		buf.append(1, DataType::ZSCORE);
+		buf.append(1, (uint8_t)name.size());
+		buf.append(name.data(), name.size());
+		if (block_key.size() > 3 + name.size()){
+			buf.append(block_key.data() + 3 + name.size(), block_key.size() - 3 - name.size());
+		}
+		return buf;
+	}
+
 	static inline
 		int decode_zscore_key(const Bytes &slice, std::string *name, std::string *key, std::string *score){
 		Decoder decoder(slice.data(), slice.size());
@@ -111,4 +158,32 @@ namespace lv
 		return 0;
 	}
 
+	static inline
+		int decode_zscore_key(const Bytes &slice, Bytes *name, Bytes *key, int64_t *score){
+		Decoder decoder(slice.data(), slice.size());
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		if (decoder.read_8_data(name) == -1){
+			return -1;
+		}
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		int64_t s;
+		if (decoder.read_int64(&s) == -1){
+			return -1;
+		}
+		if (score != NULL){
+			*score = decode_score(s);
+		}
+		if (decoder.skip(1) == -1){
+			return -1;
+		}
+		if (decoder.read_data(key) == -1){
+			return -1;
+		}
+		return 0;
+	}
+
 }
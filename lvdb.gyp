@@ -29,6 +29,7 @@
 			'include/lvdb/auto.h',
 			'include/lvdb/binlog.h',
 			'include/lvdb/bytes.h',
+			'include/lvdb/cdc.h',
 			'include/lvdb/const.h',
 			'include/lvdb/iterator.h',
 			'include/lvdb/lvdb.h',
@@ -40,21 +41,38 @@
 			'include/lvdb/t_meta.h',
 			'include/lvdb/t_queue.h',
 			'include/lvdb/t_zset.h',
+			'src/async_writer.h',
+			'src/async_writer.cpp',
 			'src/auto.cpp',
 			'src/binlog.cpp',
 			'src/binlog_queue.h',
 			'src/binlog_queue.cpp',
+			'src/binlog_store.h',
+			'src/binlog_store.cpp',
 			'src/bytes.cpp',
+			'src/cdc.cpp',
 			'src/iterator.cpp',
+			'src/iterator_pool.h',
+			'src/iterator_pool.cpp',
 			'src/lvdb_impl.h',
 			'src/lvdb_impl.cpp',
+			'src/op_stats.h',
+			'src/op_stats.cpp',
 			'src/options.cpp',
+			'src/read_policy.h',
+			'src/read_policy.cpp',
+			'src/sharded_lvdb.h',
+			'src/sharded_lvdb.cpp',
+			'src/size_cache.h',
+			'src/size_cache.cpp',
 			'src/sync.cpp',
 			'src/t_hash.cpp',
 			'src/t_kv.cpp',
 			'src/t_meta.cpp',
 			'src/t_queue.cpp',
 			'src/t_zset.cpp',
+			'src/value_cache.h',
+			'src/value_cache.cpp',
 		 ],
 	},
 	{
@@ -87,9 +105,22 @@
         'type':'executable',
         'dependencies':[ 
 			'lvdb',
+			'<(DEPTH)/third_party/leveldb/leveldb.gyp:leveldb',
 			'<(DEPTH)/third_party/testing/gtest.gyp:gtest',	
 		],
+		# the binlog store is tested directly
+		'include_dirs': [
+			'src',
+		],
 		'sources':['test/main.cpp']
 	},
+	{
+	    'target_name':'lvdb_bench',
+        'type':'executable',
+        'dependencies':[ 
+			'lvdb',
+		],
+		'sources':['test/bench.cpp']
+	},
 	]
 }
@@ -0,0 +1,313 @@
+#include "async_writer.h"
+#include "lvdb_impl.h"
+#include "lvdb/strings.h"
+#include "toolkits/log.h"
+#include <string.h>
+#include <sys/time.h>
+
+
+namespace lv
+{
+	Async_Writer::Async_Writer(LVDB_Impl *db, size_t capacity){
+		size_t n = 2;
+		while (n < capacity){
+			n <<= 1;
+		}
+		this->db = db;
+		this->slots = new Slot[n];
+		this->mask = n - 1;
+		for (size_t i = 0; i < n; i++){
+			slots[i].seq = i;
+			slots[i].op = NULL;
+		}
+		this->tail = 0;
+		this->head = 0;
+		this->sleeping = false;
+		this->quit = false;
+		this->pushed = 0;
+		this->rejected = 0;
+		this->batches = 0;
+		this->retried = 0;
+		pthread_mutex_init(&mutex, NULL);
+		pthread_cond_init(&cond, NULL);
+		int err = pthread_create(&tid, NULL, &Async_Writer::thread_func, this);
+		if (err != 0){
+			LOG_ERROR("can't create thread: " << strerror(err));
+			exit(0);
+		}
+	}
+
+	Async_Writer::~Async_Writer(){
+		pthread_mutex_lock(&mutex);
+		quit = true;
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&mutex);
+		pthread_join(tid, NULL);
+		pthread_cond_destroy(&cond);
+		pthread_mutex_destroy(&mutex);
+		delete[] slots;
+	}
+
+	bool Async_Writer::push(Op *op){
+		size_t pos = tail.load(std::memory_order_relaxed);
+		Slot *slot;
+		while (true){
+			slot = &slots[pos & mask];
+			size_t seq = slot->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0){
+				if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+					break;
+				}
+			}
+			else if (dif < 0){
+				// the writer has not freed this slot yet
+				rejected++;
+				return false;
+			}
+			else{
+				pos = tail.load(std::memory_order_relaxed);
+			}
+		}
+		slot->op = op;
+		slot->seq.store(pos + 1, std::memory_order_release);
+		pushed++;
+
+		// pairs with the fence of the writer going to sleep: either it sees
+		// the op, or this sees it sleeping
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (sleeping.load(std::memory_order_relaxed)){
+			pthread_mutex_lock(&mutex);
+			pthread_cond_signal(&cond);
+			pthread_mutex_unlock(&mutex);
+		}
+		return true;
+	}
+
+	Async_Writer::Op* Async_Writer::pop(){
+		size_t pos = head.load(std::memory_order_relaxed);
+		Slot *slot = &slots[pos & mask];
+		if (slot->seq.load(std::memory_order_acquire) != pos + 1){
+			return NULL;
+		}
+		Op *op = slot->op;
+		slot->op = NULL;
+		slot->seq.store(pos + mask + 1, std::memory_order_release);
+		head.store(pos + 1, std::memory_order_relaxed);
+		return op;
+	}
+
+	int64_t Async_Writer::run(LVDB_Impl *db, Op *op){
+		switch (op->cmd){
+		case SET:
+			return db->set(op->key, op->val, op->log_type);
+		case DEL:
+			return db->del(op->key, op->log_type);
+		case INCR:
+			return db->incr(op->key, op->by, &op->new_val, op->log_type);
+		case HSET:
+			return db->hset(op->name, op->key, op->val, op->log_type);
+		case HDEL:
+			return db->hdel(op->name, op->key, op->log_type);
+		case HINCR:
+			return db->hincr(op->name, op->key, op->by, &op->new_val, op->log_type);
+		case ZSET:
+			return db->zset(op->name, op->key, op->val, op->log_type);
+		case ZDEL:
+			return db->zdel(op->name, op->key, op->log_type);
+		case ZINCR:
+			return db->zincr(op->name, op->key, op->by, &op->new_val, op->log_type);
+		case QPUSH_FRONT:
+			return db->qpush_front(op->name, op->val, op->log_type);
+		case QPUSH_BACK:
+			return db->qpush_back(op->name, op->val, op->log_type);
+		default:
+			return -1;
+		}
+	}
+
+	void Async_Writer::apply_one(LVDB_Impl *db, Op *op){
+		op->new_val = 0;
+		op->ret = run(db, op);
+		if (op->done){
+			op->done(op->ret, op->new_val);
+		}
+		delete op;
+	}
+
+	void Async_Writer::apply(std::vector<Op*> &ops){
+		bool failed = false;
+		{
+			// the writes below join this transaction and are written by one
+			// group commit, as the batches of the sync. only the stripes of
+			// their containers are held, the kv ones are locked by key
+			std::vector<Bytes> names;
+			for (size_t i = 0; i < ops.size(); i++){
+				Op *op = ops[i];
+				bool kv = (op->cmd == SET || op->cmd == DEL || op->cmd == INCR);
+				names.push_back(kv ? Bytes(op->key) : Bytes(op->name));
+			}
+			Transaction trans(db->binlogs, names, 0, 1);
+			db->binlogs->begin_batch();
+			for (size_t i = 0; i < ops.size(); i++){
+				ops[i]->new_val = 0;
+				ops[i]->ret = run(db, ops[i]);
+				if (ops[i]->ret == -1){
+					failed = true;
+					break;
+				}
+			}
+			if (!failed){
+				leveldb::Status s = db->binlogs->commit_batch();
+				if (!s.ok()){
+					LOG_ERROR("async batch error: " << s.ToString());
+					for (size_t i = 0; i < ops.size(); i++){
+						ops[i]->ret = -1;
+					}
+				}
+			}
+		}
+		batches++;
+		if (failed){
+			// the batch was dropped with the transaction, apply the writes
+			// one by one so only the failing ones fail
+			retried++;
+			for (size_t i = 0; i < ops.size(); i++){
+				ops[i]->new_val = 0;
+				ops[i]->ret = run(db, ops[i]);
+			}
+		}
+		for (size_t i = 0; i < ops.size(); i++){
+			if (ops[i]->done){
+				ops[i]->done(ops[i]->ret, ops[i]->new_val);
+			}
+			delete ops[i];
+		}
+		ops.clear();
+	}
+
+	void* Async_Writer::thread_func(void *arg){
+		Async_Writer *writer = (Async_Writer *)arg;
+		std::vector<Op*> ops;
+		while (true){
+			Op *op;
+			while ((int)ops.size() < MAX_BATCH && (op = writer->pop()) != NULL){
+				ops.push_back(op);
+			}
+			if (!ops.empty()){
+				writer->apply(ops);
+				continue;
+			}
+			if (writer->quit){
+				break;
+			}
+
+			pthread_mutex_lock(&writer->mutex);
+			writer->sleeping.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			size_t pos = writer->head.load(std::memory_order_relaxed);
+			Slot *slot = &writer->slots[pos & writer->mask];
+			if (slot->seq.load(std::memory_order_acquire) != pos + 1 && !writer->quit){
+				// the timeout only bounds a missed wakeup
+				struct timeval now;
+				gettimeofday(&now, NULL);
+				struct timespec ts;
+				ts.tv_sec = now.tv_sec + 1;
+				ts.tv_nsec = now.tv_usec * 1000;
+				pthread_cond_timedwait(&writer->cond, &writer->mutex, &ts);
+			}
+			writer->sleeping.store(false, std::memory_order_relaxed);
+			pthread_mutex_unlock(&writer->mutex);
+		}
+		return NULL;
+	}
+
+	std::string Async_Writer::stats() const{
+		std::string s;
+		s.append("    queued   : " + str((uint64_t)(tail.load() - head.load())) + "\n");
+		s.append("    pushed   : " + str((uint64_t)pushed) + "\n");
+		s.append("    rejected : " + str((uint64_t)rejected) + "\n");
+		s.append("    batches  : " + str((uint64_t)batches) + "\n");
+		s.append("    retried  : " + str((uint64_t)retried) + "");
+		return s;
+	}
+
+	/* async operates */
+
+	static Async_Writer::Op* new_op(int cmd, const Bytes &name, const Bytes &key, const Bytes &val,
+		int64_t by, const Async_Callback &done, char log_type)
+	{
+		Async_Writer::Op *op = new Async_Writer::Op();
+		op->cmd = cmd;
+		op->log_type = log_type;
+		op->name.assign(name.data(), name.size());
+		op->key.assign(key.data(), key.size());
+		op->val.assign(val.data(), val.size());
+		op->by = by;
+		op->done = done;
+		op->ret = 0;
+		op->new_val = 0;
+		return op;
+	}
+
+	int LVDB_Impl::async_write(Async_Writer::Op *op){
+		if (conf.async_queue == 0){
+			Async_Writer::apply_one(this, op);
+			return 1;
+		}
+		std::call_once(async_once, [this](){
+			async_writer = new Async_Writer(this, conf.async_queue);
+		});
+		if (!async_writer.load()->push(op)){
+			delete op;
+			return -1;
+		}
+		return 1;
+	}
+
+	int LVDB_Impl::async_set(const Bytes &key, const Bytes &val, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::SET, Bytes(), key, val, 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_del(const Bytes &key, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::DEL, Bytes(), key, Bytes(), 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_incr(const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::INCR, Bytes(), key, Bytes(), by, done, log_type));
+	}
+
+	int LVDB_Impl::async_hset(const Bytes &name, const Bytes &key, const Bytes &val, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::HSET, name, key, val, 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_hdel(const Bytes &name, const Bytes &key, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::HDEL, name, key, Bytes(), 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_hincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::HINCR, name, key, Bytes(), by, done, log_type));
+	}
+
+	int LVDB_Impl::async_zset(const Bytes &name, const Bytes &key, const Bytes &score, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::ZSET, name, key, score, 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_zdel(const Bytes &name, const Bytes &key, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::ZDEL, name, key, Bytes(), 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_zincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::ZINCR, name, key, Bytes(), by, done, log_type));
+	}
+
+	int LVDB_Impl::async_qpush_front(const Bytes &name, const Bytes &item, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::QPUSH_FRONT, name, Bytes(), item, 0, done, log_type));
+	}
+
+	int LVDB_Impl::async_qpush_back(const Bytes &name, const Bytes &item, const Async_Callback &done, char log_type){
+		return async_write(new_op(Async_Writer::QPUSH_BACK, name, Bytes(), item, 0, done, log_type));
+	}
+
+
+}
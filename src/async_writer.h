@@ -0,0 +1,96 @@
+#pragma once
+
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "pthread.h"
+#include "lvdb/lvdb.h"
+
+
+namespace lv
+{
+	class LVDB_Impl;
+
+
+	// runs the async_* writes of a db on a thread of its own
+	//
+	// Callers push their writes into a bounded lock-free ring, which only
+	// takes a mutex to wake the writer thread when it is asleep. The
+	// writer drains the ring in batches and applies each batch as one
+	// transaction batch, so it is written to leveldb and the binlogs by a
+	// single group commit. The writes of one batch are applied in ring
+	// order, the callbacks run on the writer thread once they are written.
+	class Async_Writer
+	{
+	public:
+		enum Cmd{
+			SET, DEL, INCR,
+			HSET, HDEL, HINCR,
+			ZSET, ZDEL, ZINCR,
+			QPUSH_FRONT, QPUSH_BACK,
+		};
+
+		struct Op
+		{
+			int cmd;
+			char log_type;
+			std::string name;
+			std::string key;
+			std::string val;
+			int64_t by;
+			Async_Callback done;
+			// what the synchronous operate returned, and the new value of the incr ones
+			int64_t ret;
+			int64_t new_val;
+		};
+
+		// capacity is rounded up to a power of 2
+		Async_Writer(LVDB_Impl *db, size_t capacity);
+		// applies the writes still queued before it returns
+		~Async_Writer();
+
+		// takes op, false when the ring is full
+		bool push(Op *op);
+		// runs op on the calling thread, for a db without a writer
+		static void apply_one(LVDB_Impl *db, Op *op);
+
+		std::string stats() const;
+
+	private:
+		// ops applied in one transaction batch
+		static const int MAX_BATCH = 256;
+
+		struct Slot
+		{
+			// pos the slot can be pushed at, pos + 1 once it holds the op pushed there
+			std::atomic<size_t> seq;
+			Op *op;
+		};
+
+		LVDB_Impl *db;
+		Slot *slots;
+		size_t mask;
+		std::atomic<size_t> tail;
+		// only moved by the writer thread
+		std::atomic<size_t> head;
+
+		pthread_t tid;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		std::atomic<bool> sleeping;
+		std::atomic<bool> quit;
+
+		std::atomic<uint64_t> pushed;
+		std::atomic<uint64_t> rejected;
+		std::atomic<uint64_t> batches;
+		std::atomic<uint64_t> retried;
+
+		Op* pop();
+		void apply(std::vector<Op*> &ops);
+		static int64_t run(LVDB_Impl *db, Op *op);
+		static void* thread_func(void *arg);
+	};
+
+
+}
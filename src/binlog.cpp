@@ -10,6 +10,7 @@ found in the LICENSE file.
 #include "toolkits/util.h"
 #include "leveldb/slice.h"
 #include "pthread.h"
+#include <algorithm>
 #include <map>
 
 
@@ -28,43 +29,177 @@ namespace lv
 		buf.append(key.data(), key.size());
 	}
 
+	Binlog::Binlog(uint64_t seq, char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val)
+	{
+		uint32_t len = (uint32_t)key.size();
+		buf.append((char *)(&seq), sizeof(uint64_t));
+		buf.push_back(type | VALUE_FLAG);
+		buf.push_back(cmd);
+		buf.append((char *)(&len), sizeof(uint32_t));
+		buf.append(key.data(), key.size());
+		buf.append(val.data(), val.size());
+	}
+
 	uint64_t Binlog::seq() const{
 		return *((uint64_t *)(buf.data()));
 	}
 
 	char Binlog::type() const{
-		return buf[sizeof(uint64_t)];
+		return buf[sizeof(uint64_t)] & ~VALUE_FLAG;
 	}
 
 	char Binlog::cmd() const{
 		return buf[sizeof(uint64_t) + 1];
 	}
 
+	bool Binlog::has_val() const{
+		return (buf[sizeof(uint64_t)] & VALUE_FLAG) != 0;
+	}
+
 	const Bytes Binlog::key() const{
-		return Bytes(buf.data() + HEADER_LEN, buf.size() - HEADER_LEN);
+		if (!has_val()){
+			return Bytes(buf.data() + HEADER_LEN, buf.size() - HEADER_LEN);
+		}
+		uint32_t len = *((uint32_t *)(buf.data() + HEADER_LEN));
+		return Bytes(buf.data() + HEADER_LEN + sizeof(uint32_t), len);
 	}
 
-	int Binlog::load(const Bytes &s){
-		if (s.size() < HEADER_LEN){
+	const Bytes Binlog::name() const{
+		Bytes key = this->key();
+		switch (this->cmd()){
+		case BinlogCommand::HCLEAR:
+		case BinlogCommand::ZCLEAR:
+		case BinlogCommand::QCLEAR:
+		case BinlogCommand::QPOP_BACK:
+		case BinlogCommand::QPOP_FRONT:
+			return key;
+		case BinlogCommand::KSET:
+		case BinlogCommand::KDEL:
+			if (key.size() < 1){
+				return Bytes();
+			}
+			return Bytes(key.data() + 1, key.size() - 1);
+		}
+		// type, name length, name, ...
+		if (key.size() < 2){
+			return Bytes();
+		}
+		int len = std::min((int)(uint8_t)key.data()[1], key.size() - 2);
+		return Bytes(key.data() + 2, len);
+	}
+
+	const Bytes Binlog::val() const{
+		if (!has_val()){
+			return Bytes();
+		}
+		uint32_t len = *((uint32_t *)(buf.data() + HEADER_LEN));
+		size_t off = HEADER_LEN + sizeof(uint32_t) + len;
+		return Bytes(buf.data() + off, buf.size() - off);
+	}
+
+	Binlog Binlog::without_val() const{
+		if (!has_val()){
+			return *this;
+		}
+		Bytes k = key();
+		return Binlog(seq(), type(), cmd(), leveldb::Slice(k.data(), k.size()));
+	}
+
+	void Binlog::add_entry(char type, char cmd, const leveldb::Slice &key){
+		uint32_t len = (uint32_t)key.size();
+		buf.push_back(type);
+		buf.push_back(cmd);
+		buf.append((char *)(&len), sizeof(uint32_t));
+		buf.append(key.data(), key.size());
+		len = UINT32_MAX;
+		buf.append((char *)(&len), sizeof(uint32_t));
+	}
+
+	void Binlog::add_entry(char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val){
+		uint32_t len = (uint32_t)key.size();
+		buf.push_back(type);
+		buf.push_back(cmd);
+		buf.append((char *)(&len), sizeof(uint32_t));
+		buf.append(key.data(), key.size());
+		len = (uint32_t)val.size();
+		buf.append((char *)(&len), sizeof(uint32_t));
+		buf.append(val.data(), val.size());
+	}
+
+	int Binlog::entries(std::vector<Binlog> *logs) const{
+		logs->clear();
+		if (this->cmd() != BinlogCommand::BEGIN || this->has_val()){
 			return -1;
 		}
+		const char *p = buf.data() + HEADER_LEN;
+		const char *end = buf.data() + buf.size();
+		while (p < end){
+			uint32_t len;
+			if ((size_t)(end - p) < 2 + sizeof(uint32_t)){
+				return -1;
+			}
+			char type = p[0];
+			char cmd = p[1];
+			memcpy(&len, p + 2, sizeof(uint32_t));
+			p += 2 + sizeof(uint32_t);
+			if ((size_t)(end - p) < (size_t)len + sizeof(uint32_t)){
+				return -1;
+			}
+			leveldb::Slice key(p, len);
+			p += len;
+			memcpy(&len, p, sizeof(uint32_t));
+			p += sizeof(uint32_t);
+			if (len == UINT32_MAX){
+				logs->push_back(Binlog(this->seq(), type, cmd, key));
+				continue;
+			}
+			if ((size_t)(end - p) < len){
+				return -1;
+			}
+			logs->push_back(Binlog(this->seq(), type, cmd, key, leveldb::Slice(p, len)));
+			p += len;
+		}
+		return (int)logs->size();
+	}
+
+	bool Binlog::valid() const{
+		if (buf.size() < HEADER_LEN){
+			return false;
+		}
+		if (!has_val()){
+			return true;
+		}
+		if (buf.size() < HEADER_LEN + sizeof(uint32_t)){
+			return false;
+		}
+		uint32_t len = *((uint32_t *)(buf.data() + HEADER_LEN));
+		return len <= buf.size() - HEADER_LEN - sizeof(uint32_t);
+	}
+
+	int Binlog::load(const Bytes &s){
 		buf.assign(s.data(), s.size());
+		if (!valid()){
+			buf.clear();
+			return -1;
+		}
 		return 0;
 	}
 
 	int Binlog::load(const leveldb::Slice &s){
-		if (s.size() < HEADER_LEN){
+		buf.assign(s.data(), s.size());
+		if (!valid()){
+			buf.clear();
 			return -1;
 		}
-		buf.assign(s.data(), s.size());
 		return 0;
 	}
 
 	int Binlog::load(const std::string &s){
-		if (s.size() < HEADER_LEN){
+		buf.assign(s.data(), s.size());
+		if (!valid()){
+			buf.clear();
 			return -1;
 		}
-		buf.assign(s.data(), s.size());
 		return 0;
 	}
 
@@ -140,6 +275,11 @@ namespace lv
 		}
 		Bytes b = this->key();
 		str.append(hexmem(b.data(), b.size()));
+		if (this->has_val()){
+			Bytes v = this->val();
+			str.append(" ");
+			str.append(hexmem(v.data(), v.size()));
+		}
 		return str;
 	}
 
@@ -4,12 +4,18 @@ Use of this source code is governed by a BSD-style license that can be
 found in the LICENSE file.
 */
 #include "binlog_queue.h"
+#include "binlog_store.h"
+#include "op_stats.h"
+#include "size_cache.h"
+#include "value_cache.h"
 #include "lvdb/binlog.h"
 #include "lvdb/const.h"
 #include "lvdb/strings.h"
 #include "toolkits/log.h"
 #include "toolkits/util.h"
 #include "pthread.h"
+#include <algorithm>
+#include <chrono>
 #include <map>
 
 
@@ -38,43 +44,80 @@ namespace lv
 		return seq;
 	}
 
-	Binlog_Queue::Binlog_Queue(leveldb::DB *db, bool enabled, int capacity){
+	// the seq of the last binlog whose group reached db, sorts before every
+	// seq key
+	static inline std::string encode_written_seq_key(){
+		return std::string(1, DataType::SYNCLOG);
+	}
+
+	Binlog_Queue::Binlog_Queue(leveldb::DB *db, const std::string &dir, bool enabled, int capacity){
 		this->db = db;
+		this->store = NULL;
+		this->sizes = NULL;
+		this->values = NULL;
+		this->op_stats = NULL;
+		this->inline_value = 0;
+		this->group_logs = false;
 		this->min_seq_ = 0;
 		this->last_seq = 0;
 		this->tran_seq = 0;
 		this->capacity = capacity;
 		this->enabled = enabled;
+		this->pending_batch = new leveldb::WriteBatch();
+		this->writing_batch = new leveldb::WriteBatch();
+		this->pending_keys = 0;
+		this->pending_seq = 0;
+		this->pending_bytes = 0;
+		this->commit_ticket = 0;
+		this->written_ticket = 0;
+		this->writing = false;
+		this->failed_groups = 0;
+		this->clean_seq = 0;
+		this->cleaned_segments = 0;
+		this->thread_quit = false;
+		pthread_mutex_init(&commit_mutex, NULL);
+		pthread_cond_init(&commit_cond, NULL);
+		pthread_cond_init(&log_cond, NULL);
+		pthread_cond_init(&clean_cond, NULL);
 
-		Binlog log;
-		if (this->find_last(&log) == 1){
-			this->last_seq = log.seq();
-		}
-		// 下面这段代码是可能性能非常差!
-		//if(this->find_next(0, &log) == 1){
-		//	this->min_seq_ = log.seq();
-		//}
-		if (this->last_seq > this->capacity){
-			this->min_seq_ = this->last_seq - this->capacity;
-		}
-		else{
-			this->min_seq_ = 0;
-		}
-		if (this->find_next(this->min_seq_, &log) == 1){
-			this->min_seq_ = log.seq();
+		if (this->enabled){
+			this->store = new Binlog_Store(dir);
+			if (this->store->open() == -1){
+				LOG_ERROR("can't open binlogs in " << dir);
+				exit(0);
+			}
+			if (this->import_legacy_binlogs() == -1){
+				LOG_ERROR("can't import legacy binlogs");
+				exit(0);
+			}
+			this->last_seq = this->store->max_seq();
+			std::string val;
+			leveldb::Status s = db->Get(leveldb::ReadOptions(), encode_written_seq_key(), &val);
+			if (s.ok() && val.size() == sizeof(uint64_t)){
+				// the binlogs past it belong to a group lost in a crash
+				uint64_t seq = *((uint64_t *)val.data());
+				int count = this->store->truncate(seq);
+				if (count == -1){
+					LOG_ERROR("can't drop the binlogs after " << seq);
+					exit(0);
+				}
+				if (count > 0){
+					LOG_INFO("drop " << count << " binlogs after " << seq << ", their group was not written");
+				}
+				this->last_seq = std::max(this->store->max_seq(), seq);
+			}
+			this->min_seq_ = this->store->min_seq();
 		}
+		this->tran_seq = this->last_seq;
+		this->pending_seq = this->last_seq;
+		this->clean_seq = this->min_seq_ + this->capacity + CLEAN_STEP;
 		if (this->enabled){
-			LOG_INFO("binlogs capacity: " << this->capacity << ", min: " << this->min_seq_ << ", max: %" << this->last_seq );
-			// 这个方法有性能问题
-			// 但是, 如果不执行清理, 如果将 capacity 修改大, 可能会导致主从同步问题
-			//this->clean_obsolete_binlogs();
+			LOG_INFO("binlogs capacity: " << this->capacity << ", min: " << this->min_seq_ << ", max: " << this->last_seq );
 		}
 
 		// start cleaning thread
 		if (this->enabled){
-			thread_quit = false;
-			pthread_t tid;
-			int err = pthread_create(&tid, NULL, &Binlog_Queue::log_clean_thread_func, this);
+			int err = pthread_create(&clean_tid, NULL, &Binlog_Queue::log_clean_thread_func, this);
 			if (err != 0){
 				LOG_ERROR("can't create thread: " << strerror(err));
 				exit(0);
@@ -84,51 +127,466 @@ namespace lv
 
 	Binlog_Queue::~Binlog_Queue(){
 		if (this->enabled){
+			pthread_mutex_lock(&commit_mutex);
 			thread_quit = true;
-			for (int i = 0; i < 100; i++){
-				if (thread_quit == false){
-					break;
-				}
-				Sleep(10);
-			}
+			pthread_cond_signal(&clean_cond);
+			pthread_mutex_unlock(&commit_mutex);
+			pthread_join(clean_tid, NULL);
 		}
 		db = NULL;
+		delete store;
+		store = NULL;
+		delete pending_batch;
+		delete writing_batch;
+		pthread_cond_destroy(&commit_cond);
+		pthread_cond_destroy(&log_cond);
+		pthread_cond_destroy(&clean_cond);
+		pthread_mutex_destroy(&commit_mutex);
 	}
 
 	std::string Binlog_Queue::stats() const{
+		uint64_t min = min_seq_;
+		uint64_t max = last_seq;
+		// binlogs past the capacity still waiting to be dropped
+		uint64_t first = std::max(min, (uint64_t)1);
+		uint64_t backlog = 0;
+		if (max + 1 > first + capacity){
+			backlog = max + 1 - first - capacity;
+		}
 		std::string s;
 		s.append("    capacity : " + str(capacity) + "\n");
-		s.append("    min_seq  : " + str(min_seq_) + "\n");
-		s.append("    max_seq  : " + str(last_seq) + "");
+		s.append("    min_seq  : " + str(min) + "\n");
+		s.append("    max_seq  : " + str(max) + "\n");
+		s.append("    backlog  : " + str(backlog) + "\n");
+		s.append("    cleaned  : " + str((uint64_t)cleaned_segments) + "");
+		if (store){
+			s.append("\n" + store->stats());
+		}
 		return s;
 	}
 
-	void Binlog_Queue::begin(){
-		tran_seq = last_seq;
-		batch.Clear();
+	// replays a committed transaction into the pending group and the read overlay
+	class Binlog_Queue::Group_Builder : public leveldb::WriteBatch::Handler
+	{
+	public:
+		Group_Builder(Binlog_Queue *logs, uint64_t ticket) : logs(logs), ticket(ticket){}
+
+		virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value){
+			logs->pending_batch->Put(key, value);
+			logs->pending_bytes += key.size() + value.size();
+			Pending_Value &p = logs->pending[key.ToString()];
+			p.deleted = false;
+			p.value.assign(value.data(), value.size());
+			p.ticket = ticket;
+			// a reader missing the caches below looks in `pending` after this
+			logs->pending_keys = logs->pending.size();
+			Bytes name;
+			if (logs->sizes && Size_Cache::counter(key, &name)){
+				logs->sizes->put(key, value, false);
+			}
+			if (logs->values){
+				logs->values->update(key, value);
+			}
+		}
+
+		virtual void Delete(const leveldb::Slice& key){
+			logs->pending_batch->Delete(key);
+			logs->pending_bytes += key.size();
+			Pending_Value &p = logs->pending[key.ToString()];
+			p.deleted = true;
+			p.value.clear();
+			p.ticket = ticket;
+			logs->pending_keys = logs->pending.size();
+			Bytes name;
+			if (logs->sizes && Size_Cache::counter(key, &name)){
+				logs->sizes->put(key, leveldb::Slice(), true);
+			}
+			if (logs->values){
+				logs->values->erase(key);
+			}
+		}
+
+	private:
+		Binlog_Queue *logs;
+		uint64_t ticket;
+	};
+
+	// drops the overlay entries of a written group, unless a later transaction overwrote them
+	class Binlog_Queue::Group_Cleaner : public leveldb::WriteBatch::Handler
+	{
+	public:
+		Group_Cleaner(Binlog_Queue *logs, uint64_t ticket) : logs(logs), ticket(ticket){}
+
+		virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value){
+			this->Delete(key);
+		}
+
+		virtual void Delete(const leveldb::Slice& key){
+			std::map<std::string, Pending_Value>::iterator it = logs->pending.find(key.ToString());
+			if (it != logs->pending.end() && it->second.ticket <= ticket){
+				logs->pending.erase(it);
+			}
+		}
+
+	private:
+		Binlog_Queue *logs;
+		uint64_t ticket;
+	};
+
+	// the transaction of the calling thread, see Transaction
+	static thread_local Binlog_Queue::Tran_State *current_tran = NULL;
+	static thread_local uint64_t thread_writes_ = 0;
+
+	uint64_t Binlog_Queue::thread_writes(){
+		return thread_writes_;
+	}
+
+	void Binlog_Queue::touch(){
+		thread_writes_++;
+		// the keys written around the transactions are not known
+		if (sizes){
+			sizes->clear();
+		}
+		if (values){
+			values->clear();
+		}
+	}
+
+	int Binlog_Queue::stripe_of(const Bytes &name){
+		uint32_t h = 2166136261u;
+		for (int i = 0; i < name.size(); i++){
+			h ^= (uint8_t)name.data()[i];
+			h *= 16777619u;
+		}
+		return h % LOCK_STRIPES;
+	}
+
+	void Binlog_Queue::lock(const std::vector<int> &stripes){
+		int64_t start = op_stats ? Op_Stats::now_ns() : 0;
+		for (size_t i = 0; i < stripes.size(); i++){
+			this->stripes[stripes[i]].lock();
+		}
+		if (op_stats){
+			op_stats->lock_wait(Op_Stats::now_ns() - start);
+		}
+	}
+
+	void Binlog_Queue::unlock(const std::vector<int> &stripes){
+		for (size_t i = stripes.size(); i-- > 0;){
+			this->stripes[stripes[i]].unlock();
+		}
+	}
+
+	void Binlog_Queue::begin(Tran_State *tran){
+		tran->batch.Clear();
+		tran->writes = 0;
+		tran->logs.clear();
+		tran->queue = this;
+		tran->prev = current_tran;
+		tran->batching = false;
+		tran->batch_writes.clear();
+		tran->failed_groups = failed_groups;
+		current_tran = tran;
+		thread_writes_++;
 	}
 
 	void Binlog_Queue::rollback(){
-		tran_seq = 0;
+		Tran_State *tran = current_tran;
+		if (tran->failed_groups != failed_groups){
+			// it may have cached the writes of the failed group
+			if (sizes){
+				sizes->clear();
+			}
+			if (values){
+				values->clear();
+			}
+		}
+		tran->batch.Clear();
+		tran->writes = 0;
+		tran->logs.clear();
+		tran->batching = false;
+		tran->batch_writes.clear();
+		current_tran = tran->prev;
+	}
+
+	void Binlog_Queue::begin_batch(){
+		current_tran->batching = true;
+	}
+
+	leveldb::Status Binlog_Queue::commit_batch(){
+		current_tran->batching = false;
+		current_tran->batch_writes.clear();
+		return this->commit();
+	}
+
+	bool Binlog_Queue::in_batch() const{
+		Tran_State *tran = current_tran;
+		return tran && tran->queue == this && tran->batching;
+	}
+
+	// appends the writes of a batch to another batch
+	class Batch_Appender : public leveldb::WriteBatch::Handler
+	{
+	public:
+		Batch_Appender(leveldb::WriteBatch *batch) : batch(batch){}
+
+		virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value){
+			batch->Put(key, value);
+		}
+
+		virtual void Delete(const leveldb::Slice& key){
+			batch->Delete(key);
+		}
+
+	private:
+		leveldb::WriteBatch *batch;
+	};
+
+	void Binlog_Queue::join_batch(Tran_State *tran){
+		Tran_State *owner = current_tran;
+		Batch_Appender appender(&owner->batch);
+		tran->batch.Iterate(&appender);
+		owner->writes += tran->writes;
+		owner->logs.insert(owner->logs.end(), tran->logs.begin(), tran->logs.end());
+		std::map<std::string, Pending_Value>::const_iterator it;
+		for (it = tran->batch_writes.begin(); it != tran->batch_writes.end(); it++){
+			owner->batch_writes[it->first] = it->second;
+		}
+		tran->batch.Clear();
+		tran->writes = 0;
+		tran->logs.clear();
+		tran->batch_writes.clear();
 	}
 
 	leveldb::Status Binlog_Queue::commit(){
-		leveldb::WriteOptions write_opts;
-		leveldb::Status s = db->Write(write_opts, &batch);
+		if (current_tran->batching){
+			// the writes stay in the batch until commit_batch()
+			return leveldb::Status::OK();
+		}
+		Tran_State *tran = current_tran;
+		if (tran->writes == 0 && tran->logs.empty()){
+			// nothing to write, don't wait for a group
+			return leveldb::Status::OK();
+		}
+		Commit_Writer w;
+		w.done = false;
+
+		pthread_mutex_lock(&commit_mutex);
+		if (!bg_error.ok()){
+			pthread_mutex_unlock(&commit_mutex);
+			return bg_error;
+		}
+		if (tran->failed_groups != failed_groups){
+			// its reads may come from the writes of the failed group
+			pthread_mutex_unlock(&commit_mutex);
+			return leveldb::Status::IOError("a group failed during the transaction");
+		}
+		// the only serial part of a transaction: binlog seqs are handed out
+		// in commit_mutex order, so each group holds a consecutive range, and
+		// the transactions of one container get them in their lock order
+		Group_Builder builder(this, ++commit_ticket);
+		tran->batch.Iterate(&builder);
+		if (group_logs && tran->logs.size() > 1){
+			// one seq for the whole transaction, the entries keep their types
+			tran_seq++;
+			Binlog group(tran_seq, BinlogType::SYNC, BinlogCommand::BEGIN, leveldb::Slice());
+			for (size_t i = 0; i < tran->logs.size(); i++){
+				const Log_Entry &e = tran->logs[i];
+				if (e.has_val){
+					group.add_entry(e.type, e.cmd, e.key, e.val);
+				}
+				else{
+					group.add_entry(e.type, e.cmd, e.key);
+				}
+			}
+			pending_logs.push_back(group);
+		}
+		else{
+			for (size_t i = 0; i < tran->logs.size(); i++){
+				const Log_Entry &e = tran->logs[i];
+				tran_seq++;
+				if (e.has_val){
+					pending_logs.push_back(Binlog(tran_seq, e.type, e.cmd, e.key, e.val));
+				}
+				else{
+					pending_logs.push_back(Binlog(tran_seq, e.type, e.cmd, e.key));
+				}
+			}
+		}
+		pending_seq = tran_seq;
+		pending_keys = pending.size();
+		pending_writers.push_back(&w);
+		tran->batch.Clear();
+		tran->writes = 0;
+		tran->logs.clear();
+
+		// let the next transaction of these containers prepare while this
+		// group is being written, it reads the writes above from `pending`
+		this->unlock(tran->stripes);
+		while (!w.done){
+			if (writing){
+				pthread_cond_wait(&commit_cond, &commit_mutex);
+			}
+			else{
+				write_group();
+			}
+		}
+		pthread_mutex_unlock(&commit_mutex);
+		this->lock(tran->stripes);
+		// the iterators this thread created inside the transaction, before
+		// its writes reached the db, are not handed out again
+		thread_writes_++;
+		return w.status;
+	}
+
+	void Binlog_Queue::write_group(){
+		leveldb::WriteBatch *group = pending_batch;
+		pending_batch = writing_batch;
+		writing_batch = group;
+		std::vector<Commit_Writer*> writers;
+		writers.swap(pending_writers);
+		std::vector<Binlog> logs;
+		logs.swap(pending_logs);
+		uint64_t group_seq = pending_seq;
+		uint64_t group_ticket = commit_ticket;
+		uint64_t group_bytes = pending_bytes;
+		pending_bytes = 0;
+		writing = true;
+		pthread_mutex_unlock(&commit_mutex);
+
+		// binlogs first, they are not visible to the readers until last_seq
+		// moves past them. The group carries the seq of its last binlog, the
+		// binlogs of a group lost in a crash are past it and dropped on open
+		if (!logs.empty()){
+			uint64_t seq = logs.back().seq();
+			group->Put(encode_written_seq_key(), leveldb::Slice((char *)&seq, sizeof(seq)));
+		}
+		int64_t start = op_stats ? Op_Stats::now_ns() : 0;
+		leveldb::Status s;
+		for (size_t i = 0; i < logs.size() && s.ok(); i++){
+			s = store->append(logs[i]);
+		}
+		if (s.ok() && !logs.empty()){
+			s = store->flush();
+		}
 		if (s.ok()){
-			last_seq = tran_seq;
-			tran_seq = 0;
+			leveldb::WriteOptions write_opts;
+			s = db->Write(write_opts, group);
 		}
-		return s;
+		if (op_stats){
+			op_stats->group_write(Op_Stats::now_ns() - start, group_bytes);
+		}
+
+		pthread_mutex_lock(&commit_mutex);
+		if (s.ok()){
+			last_seq = group_seq;
+			pthread_cond_broadcast(&log_cond);
+			if (last_seq >= clean_seq){
+				pthread_cond_signal(&clean_cond);
+			}
+			Group_Cleaner cleaner(this, group_ticket);
+			group->Iterate(&cleaner);
+			written_ticket = group_ticket;
+			for (size_t i = 0; i < writers.size(); i++){
+				writers[i]->status = s;
+				writers[i]->done = true;
+			}
+		}
+		else{
+			fail_group(writers, s);
+		}
+		group->Clear();
+		pending_keys = pending.size();
+		writing = false;
+		pthread_cond_broadcast(&commit_cond);
+	}
+
+	void Binlog_Queue::fail_group(const std::vector<Commit_Writer*> &writers, const leveldb::Status &s){
+		LOG_ERROR("group commit error: " << s.ToString() << ", " << writers.size() << " transactions lost, "
+			<< pending_writers.size() << " queued after them failed");
+		// last_seq doesn't move, the binlogs appended before the error were
+		// never read and their seqs are handed out again
+		if (store && store->max_seq() > last_seq && store->truncate(last_seq) == -1){
+			bg_error = leveldb::Status::IOError("can't drop the binlogs of a failed group", s.ToString());
+		}
+		for (size_t i = 0; i < writers.size(); i++){
+			writers[i]->status = s;
+			writers[i]->done = true;
+		}
+		// the queued transactions may have read the failed writes from `pending`
+		for (size_t i = 0; i < pending_writers.size(); i++){
+			pending_writers[i]->status = leveldb::Status::IOError("an earlier group failed", s.ToString());
+			pending_writers[i]->done = true;
+		}
+		pending_writers.clear();
+		pending_logs.clear();
+		pending_batch->Clear();
+		pending_bytes = 0;
+		pending.clear();
+		tran_seq = last_seq;
+		pending_seq = last_seq;
+		written_ticket = commit_ticket;
+		// the values written through by the lost transactions
+		if (sizes){
+			sizes->clear();
+		}
+		if (values){
+			values->clear();
+		}
+		// after the caches are cleared: a transaction reading the failed
+		// writes from them began before this and fails its commit
+		failed_groups++;
+	}
+
+	void Binlog_Queue::drain(){
+		pthread_mutex_lock(&commit_mutex);
+		while (writing || !pending_writers.empty()){
+			if (writing){
+				pthread_cond_wait(&commit_cond, &commit_mutex);
+			}
+			else{
+				write_group();
+			}
+		}
+		pthread_mutex_unlock(&commit_mutex);
+	}
+
+	void Binlog_Queue::wait_written(){
+		pthread_mutex_lock(&commit_mutex);
+		uint64_t ticket = commit_ticket;
+		while (written_ticket < ticket){
+			if (writing){
+				pthread_cond_wait(&commit_cond, &commit_mutex);
+			}
+			else{
+				write_group();
+			}
+		}
+		pthread_mutex_unlock(&commit_mutex);
 	}
 
 	void Binlog_Queue::add_log(char type, char cmd, const leveldb::Slice &key){
 		if (!enabled){
 			return;
 		}
-		tran_seq++;
-		Binlog log(tran_seq, type, cmd, key);
-		batch.Put(encode_seq_key(tran_seq), log.repr());
+		Log_Entry e;
+		e.type = type;
+		e.cmd = cmd;
+		e.key.assign(key.data(), key.size());
+		e.has_val = false;
+		current_tran->logs.push_back(e);
+	}
+
+	void Binlog_Queue::add_log(char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val){
+		if (!enabled){
+			return;
+		}
+		this->add_log(type, cmd, key);
+		if (inline_value > 0 && val.size() <= inline_value){
+			Log_Entry &e = current_tran->logs.back();
+			e.has_val = true;
+			e.val.assign(val.data(), val.size());
+		}
 	}
 
 	void Binlog_Queue::add_log(char type, char cmd, const std::string &key){
@@ -141,111 +599,257 @@ namespace lv
 
 	// leveldb put
 	void Binlog_Queue::Put(const leveldb::Slice& key, const leveldb::Slice& value){
-		batch.Put(key, value);
+		current_tran->batch.Put(key, value);
+		current_tran->writes++;
+		if (current_tran->batching){
+			Pending_Value &p = current_tran->batch_writes[key.ToString()];
+			p.deleted = false;
+			p.value.assign(value.data(), value.size());
+		}
 	}
 
 	// leveldb delete
 	void Binlog_Queue::Delete(const leveldb::Slice& key){
-		batch.Delete(key);
+		current_tran->batch.Delete(key);
+		current_tran->writes++;
+		if (current_tran->batching){
+			Pending_Value &p = current_tran->batch_writes[key.ToString()];
+			p.deleted = true;
+			p.value.clear();
+		}
 	}
 
-	int Binlog_Queue::find_next(uint64_t next_seq, Binlog *log) const{
-		if (this->get(next_seq, log) == 1){
-			return 1;
+	leveldb::Status Binlog_Queue::Get(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value, bool hot){
+		leveldb::Status s = this->get_cached(options, key, value, hot);
+		if (op_stats && s.ok()){
+			op_stats->bytes_read(value->size());
 		}
-		uint64_t ret = 0;
-		std::string key_str = encode_seq_key(next_seq);
-		leveldb::ReadOptions iterate_options;
-		leveldb::Iterator *it = db->NewIterator(iterate_options);
-		it->Seek(key_str);
-		if (it->Valid()){
-			leveldb::Slice key = it->key();
-			if (decode_seq_key(key) != 0){
-				leveldb::Slice val = it->value();
-				if (log->load(val) == -1){
-					ret = -1;
+		return s;
+	}
+
+	leveldb::Status Binlog_Queue::get_cached(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value, bool hot){
+		if (options.snapshot){
+			// the writes after the snapshot, pending or cached, are not part of it
+			return db->Get(options, key, value);
+		}
+		if (in_batch()){
+			const std::map<std::string, Pending_Value> &batch_writes = current_tran->batch_writes;
+			std::map<std::string, Pending_Value>::const_iterator it = batch_writes.find(key.ToString());
+			if (it != batch_writes.end()){
+				if (it->second.deleted){
+					return leveldb::Status::NotFound(key);
+				}
+				value->assign(it->second.value);
+				return leveldb::Status::OK();
+			}
+		}
+		Bytes name;
+		bool counter = sizes && Size_Cache::counter(key, &name);
+		if (counter){
+			bool deleted;
+			if (sizes->get(key, value, &deleted) == 1){
+				return deleted ? leveldb::Status::NotFound(key) : leveldb::Status::OK();
+			}
+			leveldb::Status s = this->get_pending(options, key, value);
+			// a commit of this container can't come in between, unless the
+			// calling thread doesn't hold its stripe
+			Tran_State *tran = current_tran;
+			if (tran && tran->queue == this && (s.ok() || s.IsNotFound())
+				&& std::binary_search(tran->stripes.begin(), tran->stripes.end(), stripe_of(name))){
+				sizes->put(key, s.ok() ? leveldb::Slice(*value) : leveldb::Slice(), s.IsNotFound());
+			}
+			return s;
+		}
+		if (hot && values){
+			uint64_t lease;
+			if (values->get(key, value, &lease) == 1){
+				return leveldb::Status::OK();
+			}
+			leveldb::Status s = this->get_pending(options, key, value);
+			if (lease != 0){
+				if (s.ok()){
+					values->fill(key, *value, lease);
 				}
 				else{
-					ret = 1;
+					values->cancel(key, lease);
 				}
 			}
+			return s;
 		}
-		delete it;
-		return ret;
+		return this->get_pending(options, key, value);
 	}
 
-	int Binlog_Queue::find_last(Binlog *log) const{
-		uint64_t ret = 0;
-		std::string key_str = encode_seq_key(UINT64_MAX);
-		leveldb::ReadOptions iterate_options;
-		leveldb::Iterator *it = db->NewIterator(iterate_options);
-		it->Seek(key_str);
-		if (!it->Valid()){
-			// Iterator::prev requires Valid, so we seek to last
-			it->SeekToLast();
-		}
-		else{
-			// UINT64_MAX is not used 
-			it->Prev();
-		}
-		if (it->Valid()){
-			leveldb::Slice key = it->key();
-			if (decode_seq_key(key) != 0){
-				leveldb::Slice val = it->value();
-				if (log->load(val) == -1){
-					ret = -1;
+	leveldb::Status Binlog_Queue::get_pending(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value){
+		if (pending_keys > 0){
+			pthread_mutex_lock(&commit_mutex);
+			std::map<std::string, Pending_Value>::const_iterator it = pending.find(key.ToString());
+			if (it != pending.end()){
+				leveldb::Status s;
+				if (it->second.deleted){
+					s = leveldb::Status::NotFound(key);
 				}
 				else{
-					ret = 1;
+					value->assign(it->second.value);
 				}
+				pthread_mutex_unlock(&commit_mutex);
+				return s;
 			}
+			pthread_mutex_unlock(&commit_mutex);
+		}
+		return db->Get(options, key, value);
+	}
+
+	int Binlog_Queue::find_next(uint64_t next_seq, Binlog *log) const{
+		uint64_t seq = last_seq;
+		if (!store || next_seq > seq){
+			return 0;
+		}
+		int ret = store->find_next(next_seq, log);
+		if (ret == 1 && log->seq() > seq){
+			return 0;
 		}
-		delete it;
 		return ret;
 	}
 
-	int Binlog_Queue::get(uint64_t seq, Binlog *log) const{
-		std::string val;
-		leveldb::Status s = db->Get(leveldb::ReadOptions(), encode_seq_key(seq), &val);
-		if (s.ok()){
-			if (log->load(val) != -1){
-				return 1;
+	int Binlog_Queue::find_last(Binlog *log) const{
+		uint64_t seq = last_seq;
+		if (!store || seq == 0){
+			return 0;
+		}
+		return store->get(seq, log);
+	}
+
+	int Binlog_Queue::read_batch(uint64_t seq, uint64_t last, int limit, std::vector<Binlog> *logs) const{
+		last = std::min(last, (uint64_t)last_seq);
+		if (!store || seq > last){
+			return 0;
+		}
+		return store->read_batch(seq, last, limit, logs);
+	}
+
+	uint64_t Binlog_Queue::wait(uint64_t seq, int timeout_ms){
+		std::chrono::system_clock::time_point deadline = std::chrono::system_clock::now() + std::chrono::milliseconds(timeout_ms);
+		std::chrono::nanoseconds ns = deadline.time_since_epoch();
+		struct timespec ts;
+		ts.tv_sec = (time_t)std::chrono::duration_cast<std::chrono::seconds>(ns).count();
+		ts.tv_nsec = (long)(ns.count() % 1000000000);
+
+		pthread_mutex_lock(&commit_mutex);
+		while (last_seq < seq){
+			if (pthread_cond_timedwait(&log_cond, &commit_mutex, &ts) != 0){
+				break;
 			}
 		}
-		return 0;
+		uint64_t ret = last_seq;
+		pthread_mutex_unlock(&commit_mutex);
+		return ret;
 	}
 
-	int Binlog_Queue::update(uint64_t seq, char type, char cmd, const std::string &key){
-		Binlog log(seq, type, cmd, key);
-		leveldb::Status s = db->Put(leveldb::WriteOptions(), encode_seq_key(seq), log.repr());
-		if (s.ok()){
+	const leveldb::Snapshot* Binlog_Queue::snapshot(uint64_t *seq){
+		pthread_mutex_lock(&commit_mutex);
+		while (writing){
+			pthread_cond_wait(&commit_cond, &commit_mutex);
+		}
+		const leveldb::Snapshot *ret = db->GetSnapshot();
+		*seq = last_seq;
+		pthread_mutex_unlock(&commit_mutex);
+		return ret;
+	}
+
+	int Binlog_Cursor::next(std::vector<Binlog> *batch, int limit, int timeout_ms){
+		batch->clear();
+		uint64_t last = logs->max_seq();
+		if (last < next_seq){
+			last = logs->wait(next_seq, timeout_ms);
+			if (last < next_seq){
+				return 0;
+			}
+		}
+		int ret = logs->read_batch(next_seq, last, limit, batch);
+		if (ret > 0){
+			next_seq = batch->back().seq() + 1;
+		}
+		else if (ret == 0){
+			// the binlogs up to last were dropped or never stored
+			next_seq = last + 1;
+		}
+		return ret;
+	}
+
+	int Binlog_Queue::get(uint64_t seq, Binlog *log) const{
+		if (!store || seq > last_seq){
 			return 0;
 		}
-		return -1;
+		return store->get(seq, log) == 1 ? 1 : 0;
 	}
 
-	int Binlog_Queue::del(uint64_t seq){
-		leveldb::Status s = db->Delete(leveldb::WriteOptions(), encode_seq_key(seq));
-		if (!s.ok()){
+	int Binlog_Queue::update(uint64_t seq, char type, char cmd, const std::string &key){
+		if (!store || type != BinlogType::NOOP){
 			return -1;
 		}
+		store->set_noop(seq, seq);
 		return 0;
 	}
 
 	void Binlog_Queue::flush(){
-		del_range(this->min_seq_, this->last_seq);
+		if (store){
+			int count = store->clear();
+			LOG_INFO("flush " << count << " binlog segments");
+			uint64_t seq = this->last_seq;
+			leveldb::Status s = db->Put(leveldb::WriteOptions(), encode_written_seq_key(), leveldb::Slice((char *)&seq, sizeof(seq)));
+			if (!s.ok()){
+				LOG_ERROR("write binlog seq error: " << s.ToString());
+			}
+		}
+		this->min_seq_ = (uint64_t)this->last_seq;
 	}
 
-	int Binlog_Queue::del_range(uint64_t start, uint64_t end){
-		while (start <= end){
+	int Binlog_Queue::import_legacy_binlogs(){
+		uint64_t max_seq = store->max_seq();
+		uint64_t count = 0;
+		uint64_t imported = 0;
+		leveldb::ReadOptions iterate_options;
+		iterate_options.fill_cache = false;
+		leveldb::Iterator *it = db->NewIterator(iterate_options);
+		it->Seek(encode_seq_key(0));
+		leveldb::Status s;
+		while (it->Valid() && s.ok()){
 			leveldb::WriteBatch batch;
-			for (int count = 0; start <= end && count < 1000; start++, count++){
-				batch.Delete(encode_seq_key(start));
+			for (int i = 0; i < 1000 && it->Valid(); i++){
+				uint64_t seq = decode_seq_key(it->key());
+				if (seq == 0){
+					break;
+				}
+				Binlog log;
+				if (seq > max_seq && log.load(it->value()) != -1){
+					s = store->append(log);
+					if (!s.ok()){
+						break;
+					}
+					max_seq = seq;
+					imported++;
+				}
+				batch.Delete(it->key());
+				count++;
+				it->Next();
 			}
-			leveldb::Status s = db->Write(leveldb::WriteOptions(), &batch);
-			if (!s.ok()){
-				return -1;
+			if (s.ok()){
+				s = store->flush();
+			}
+			if (s.ok()){
+				s = db->Write(leveldb::WriteOptions(), &batch);
 			}
+			if (it->Valid() && decode_seq_key(it->key()) == 0){
+				break;
+			}
+		}
+		delete it;
+		if (!s.ok()){
+			LOG_ERROR("import legacy binlogs error: " << s.ToString());
+			return -1;
+		}
+		if (count > 0){
+			LOG_INFO("import " << imported << " of " << count << " legacy binlogs");
 		}
 		return 0;
 	}
@@ -253,57 +857,44 @@ namespace lv
 	void* Binlog_Queue::log_clean_thread_func(void *arg){
 		Binlog_Queue *logs = (Binlog_Queue *)arg;
 
-		while (!logs->thread_quit){
-			if (!logs->db){
+		pthread_mutex_lock(&logs->commit_mutex);
+		while (true){
+			// woken by the commit reaching clean_seq, not by a timer
+			while (!logs->thread_quit && logs->last_seq < logs->clean_seq){
+				pthread_cond_wait(&logs->clean_cond, &logs->commit_mutex);
+			}
+			if (logs->thread_quit){
 				break;
 			}
-			assert(logs->last_seq >= logs->min_seq_);
+			uint64_t last = logs->last_seq;
+			pthread_mutex_unlock(&logs->commit_mutex);
 
-			if (logs->last_seq - logs->min_seq_ < logs->capacity + 10000){
-				Sleep(50);
-				continue;
+			// whole segments only, the active one is never dropped
+			uint64_t start = logs->min_seq_;
+			int count = 0;
+			if (last > (uint64_t)logs->capacity){
+				count = logs->store->drop_before(last - logs->capacity + 1);
+			}
+			if (count > 0){
+				logs->min_seq_ = logs->store->min_seq();
+				LOG_INFO("clean " << count << " segments, logs[" << start << " ~ " << (logs->min_seq_ - 1) << "], " << (last - logs->min_seq_ + 1) << " left, max: " << last);
 			}
 
-			uint64_t start = logs->min_seq_;
-			uint64_t end = logs->last_seq - logs->capacity;
-			logs->del_range(start, end);
-			logs->min_seq_ = end + 1;
-			LOG_INFO("clean " << (end - start + 1) << " logs[" << start << " ~ " << end << "], " << (logs->last_seq - logs->min_seq_ + 1) << " left, max: " << logs->last_seq);
+			pthread_mutex_lock(&logs->commit_mutex);
+			logs->cleaned_segments += count;
+			if (count > 0){
+				logs->clean_seq = logs->min_seq_ + logs->capacity + CLEAN_STEP;
+			}
+			else{
+				// the next segment can't be dropped yet, wait for more commits
+				logs->clean_seq = last + CLEAN_STEP;
+			}
 		}
+		pthread_mutex_unlock(&logs->commit_mutex);
 		LOG_INFO("binlog clean_thread quit");
-
-		logs->thread_quit = false;
 		return (void *)NULL;
 	}
 
-	// 因为老版本可能产生了断续的binlog
-	// 例如, binlog-1 存在, 但后面的被删除了, 然后到 binlog-100000 时又开始存在.
-	void Binlog_Queue::clean_obsolete_binlogs(){
-		std::string key_str = encode_seq_key(this->min_seq_);
-		leveldb::ReadOptions iterate_options;
-		leveldb::Iterator *it = db->NewIterator(iterate_options);
-		it->Seek(key_str);
-		if (it->Valid()){
-			it->Prev();
-		}
-		uint64_t count = 0;
-		while (it->Valid()){
-			leveldb::Slice key = it->key();
-			uint64_t seq = decode_seq_key(key);
-			if (seq == 0){
-				break;
-			}
-			this->del(seq);
-
-			it->Prev();
-			count++;
-		}
-		delete it;
-		if (count > 0){
-			LOG_INFO("clean_obsolete_binlogs: " << count);
-		}
-	}
-
 	// TESTING, slow, so not used
 	void Binlog_Queue::merge(){
 		std::map<std::string, uint64_t> key_map;
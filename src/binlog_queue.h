@@ -1,7 +1,12 @@
 #pragma once
 
 
+#include <algorithm>
+#include <atomic>
+#include <map>
 #include <string>
+#include <vector>
+#include "pthread.h"
 #include "leveldb/db.h"
 #include "leveldb/options.h"
 #include "leveldb/slice.h"
@@ -9,35 +14,129 @@
 #include "leveldb/write_batch.h"
 #include "toolkits/mutex.h"
 #include "lvdb/bytes.h"
+#include "lvdb/binlog.h"
 
 
 namespace lv
 {
-	class Binlog;
+	class Binlog_Store;
+	class Op_Stats;
+	class Size_Cache;
+	class Value_Cache;
 
 
 	// circular queue
+	//
+	// The binlogs are kept in a Binlog_Store next to the db. A transaction
+	// holds the lock stripes of the containers it reads and writes, so the
+	// transactions of unrelated containers are prepared in parallel, each
+	// in a Tran_State of its own thread. They are then handed to a group
+	// commit pipeline: while one committer (the leader) is inside
+	// db->Write, the following transactions are appended to the next group,
+	// and the leader of that group writes all of them with a single Write.
 	class Binlog_Queue
 	{
 	public:
-		toolkit::Mutex mutex;
+		static const int LOCK_STRIPES = 64;
+		// counters cache, NULL when Options::size_cache is 0, not owned
+		Size_Cache *sizes;
+		// hot values cache, NULL when Options::value_cache is 0, not owned
+		Value_Cache *values;
+		// lock waits, group writes and bytes read, NULL to count nothing, not owned
+		Op_Stats *op_stats;
+		// values up to this size are stored in their binlogs, see Options::binlog_inline_value
+		size_t inline_value;
+		// the binlogs of a transaction are packed into one BEGIN binlog, see Options::binlog_group
+		bool group_logs;
 
-		Binlog_Queue(leveldb::DB *db, bool enabled = true, int capacity = 20000000);
+		struct Log_Entry
+		{
+			char type;
+			char cmd;
+			std::string key;
+			bool has_val;
+			std::string val;
+		};
+
+		struct Pending_Value
+		{
+			bool deleted;
+			std::string value;
+			uint64_t ticket;
+		};
+
+		// a transaction being prepared by the calling thread
+		struct Tran_State
+		{
+			leveldb::WriteBatch batch;
+			int writes;
+			std::vector<Log_Entry> logs;
+			// sorted lock stripes held by the transaction
+			std::vector<int> stripes;
+			Binlog_Queue *queue;
+			Tran_State *prev;
+			// inside a batch, see begin_batch()
+			bool batching;
+			// the writes of the batch, seen by Get() of the thread
+			std::map<std::string, Pending_Value> batch_writes;
+			// Binlog_Queue::failed_groups at begin(), the transaction may have
+			// read the writes of a group failed since then
+			uint64_t failed_groups;
+		};
+
+		Binlog_Queue(leveldb::DB *db, const std::string &dir, bool enabled = true, int capacity = 20000000);
 		~Binlog_Queue();
 
-		void begin();
+		// the lock stripe of a container name
+		static int stripe_of(const Bytes &name);
+		// stripes sorted, the same order for every thread
+		void lock(const std::vector<int> &stripes);
+		void unlock(const std::vector<int> &stripes);
+
+		// make tran the transaction of the calling thread, caller holds its stripes
+		void begin(Tran_State *tran);
+		// drop the writes of the transaction and restore the previous one
 		void rollback();
+		// join the following transactions of the calling thread into the
+		// current one, until commit_batch() or rollback(). commit() inside the
+		// batch keeps the writes, and Get() of this thread sees them.
+		// caller holds the stripes of every write of the batch, or is a
+		// worker of the thread holding them
+		void begin_batch();
+		leveldb::Status commit_batch();
+		// whether the calling thread is inside a batch
+		bool in_batch() const;
+		// move the writes of tran, the batch of a worker thread, to the end of
+		// the batch of the calling thread, which holds every stripe
+		void join_batch(Tran_State *tran);
+		// assigns binlog seqs, queues the transaction for the next group and
+		// blocks until that group is written. the stripes of the transaction
+		// are released while waiting.
 		leveldb::Status commit();
+		// block until every committed transaction has been written, caller holds every stripe
+		void drain();
+		// block until the transactions committed so far have been written, so
+		// the db iterators of the calling thread see them
+		void wait_written();
 		// leveldb put
 		void Put(const leveldb::Slice& key, const leveldb::Slice& value);
 		// leveldb delete
 		void Delete(const leveldb::Slice& key);
+		// leveldb get, also sees transactions committed but not yet written,
+		// unless options.snapshot is set.
+		// hot: a point read of a user key, answered from and kept in `values`
+		leveldb::Status Get(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value, bool hot = false);
 		void add_log(char type, char cmd, const leveldb::Slice &key);
 		void add_log(char type, char cmd, const std::string &key);
+		// the binlog of a write of val to key, which carries val when it
+		// is not larger than inline_value
+		void add_log(char type, char cmd, const leveldb::Slice &key, const leveldb::Slice &val);
 
 		int get(uint64_t seq, Binlog *log) const;
+		// the store is append only, a binlog can only be turned into a NOOP
 		int update(uint64_t seq, char type, char cmd, const std::string &key);
 
+		// drop all binlogs, caller holds every stripe and has drained the groups
 		void flush();
 
 		/** @returns
@@ -47,6 +146,14 @@ namespace lv
 		 */
 		int find_next(uint64_t seq, Binlog *log) const;
 		int find_last(Binlog *log) const;
+		// consecutive binlogs from the first one with log.seq >= seq up to
+		// min(last, max_seq()), returns the number appended to logs or -1
+		int read_batch(uint64_t seq, uint64_t last, int limit, std::vector<Binlog> *logs) const;
+		// block until max_seq() >= seq or timeout_ms passed, returns max_seq()
+		uint64_t wait(uint64_t seq, int timeout_ms);
+		// a db snapshot taken between two groups, seq is the last binlog it
+		// includes. release it with db->ReleaseSnapshot()
+		const leveldb::Snapshot* snapshot(uint64_t *seq);
 
 		uint64_t min_seq() const{
 			return min_seq_;
@@ -56,45 +163,182 @@ namespace lv
 			return last_seq;
 		}
 
+		// for the writes made to db outside of the transactions
+		void touch();
+		// bumped when the calling thread begins a transaction or touch()es,
+		// a db iterator it created at an equal count sees its own writes
+		static uint64_t thread_writes();
+
 		std::string stats() const;
 
 	private:
+		struct Commit_Writer
+		{
+			leveldb::Status status;
+			bool done;
+		};
+
+		class Group_Builder;
+		class Group_Cleaner;
+
 		leveldb::DB *db;
-		uint64_t min_seq_;
-		uint64_t last_seq;
+		Binlog_Store *store;
+		// min_seq_, last_seq and cleaned_segments are also read without
+		// commit_mutex, by min_seq(), max_seq() and stats()
+		std::atomic<uint64_t> min_seq_;
+		// last seq written to db, binlogs after it are not visible yet
+		std::atomic<uint64_t> last_seq;
+		// last seq handed out to a committed transaction, >= last_seq
 		uint64_t tran_seq;
 		int capacity;
-		leveldb::WriteBatch batch;
+		toolkit::Mutex stripes[LOCK_STRIPES];
+		// group commit state, guarded by commit_mutex
+		pthread_mutex_t commit_mutex;
+		pthread_cond_t commit_cond;
+		// signalled when last_seq moves
+		pthread_cond_t log_cond;
+		// signalled once last_seq reaches clean_seq
+		pthread_cond_t clean_cond;
+		// last_seq the cleaner waits for before it drops segments again
+		uint64_t clean_seq;
+		std::atomic<uint64_t> cleaned_segments;
+		leveldb::WriteBatch *pending_batch;
+		leveldb::WriteBatch *writing_batch;
+		std::vector<Binlog> pending_logs;
+		std::vector<Commit_Writer*> pending_writers;
+		std::map<std::string, Pending_Value> pending;
+		// pending.size(), read without commit_mutex by get_pending()
+		std::atomic<size_t> pending_keys;
+		uint64_t pending_seq;
+		// key and value bytes of the pending group
+		uint64_t pending_bytes;
+		uint64_t commit_ticket;
+		// commit_ticket of the last group written
+		uint64_t written_ticket;
+		bool writing;
+		// bumped when a group fails, the transactions begun before it fail too
+		std::atomic<uint64_t> failed_groups;
+		// the binlogs of a failed group could not be dropped from the store,
+		// every later commit fails, like leveldb's bg_error
+		leveldb::Status bg_error;
 
-		volatile bool thread_quit;
-		static void* log_clean_thread_func(void *arg);
-		int del(uint64_t seq);
-		// [start, end] includesive
-		int del_range(uint64_t start, uint64_t end);
+		// Get() without the read counts
+		leveldb::Status get_cached(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value, bool hot);
+		// Get() without the caches
+		leveldb::Status get_pending(const leveldb::ReadOptions& options, const leveldb::Slice& key, std::string* value);
+		// write the pending group, called with commit_mutex held
+		void write_group();
+		// drop the failed group and the transactions queued behind it, which
+		// may have read its writes, called with commit_mutex held
+		void fail_group(const std::vector<Commit_Writer*> &writers, const leveldb::Status &s);
 
-		void clean_obsolete_binlogs();
+		// binlogs committed past the capacity before the cleaner runs
+		static const int CLEAN_STEP = 10000;
+		// guarded by commit_mutex
+		bool thread_quit;
+		pthread_t clean_tid;
+		static void* log_clean_thread_func(void *arg);
+		// move the binlogs of older versions, stored as SYNCLOG keys, to the store
+		int import_legacy_binlogs();
 		void merge();
 		bool enabled;
 	};
 
 
+	// reads the binlogs in seq order, waiting for new ones at the end
+	class Binlog_Cursor
+	{
+	public:
+		// the first binlog read is the first one with log.seq >= seq
+		Binlog_Cursor(Binlog_Queue *logs, uint64_t seq) : logs(logs), next_seq(seq){}
+
+		/** @returns
+		 >0: number of binlogs in batch
+		 0 : nothing new within timeout_ms
+		 -1: error
+		 */
+		int next(std::vector<Binlog> *batch, int limit, int timeout_ms);
+
+		uint64_t seq() const{
+			return next_seq;
+		}
+
+	private:
+		Binlog_Queue *logs;
+		uint64_t next_seq;
+	};
+
+
 	class Transaction
 	{
 	public:
+		// locks every stripe, for the operates over the whole db
 		Transaction(Binlog_Queue *logs){
-			this->logs = logs;
-			logs->mutex.lock();
-			logs->begin();
+			std::vector<int> stripes;
+			for (int i = 0; i < Binlog_Queue::LOCK_STRIPES; i++){
+				stripes.push_back(i);
+			}
+			this->init(logs, stripes, true);
+		}
+
+		// locks the stripe of one container
+		Transaction(Binlog_Queue *logs, const Bytes &name){
+			this->init(logs, std::vector<int>(1, Binlog_Queue::stripe_of(name)), true);
+		}
+
+		// locks the stripes of the containers names[offset], names[offset + step]...
+		Transaction(Binlog_Queue *logs, const std::vector<Bytes> &names, int offset, int step){
+			std::vector<int> stripes;
+			for (size_t i = offset; i < names.size(); i += step){
+				stripes.push_back(Binlog_Queue::stripe_of(names[i]));
+			}
+			std::sort(stripes.begin(), stripes.end());
+			stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+			this->init(logs, stripes, true);
+		}
+
+		// a worker of a batch of another thread, which holds the stripes
+		// (sorted) the worker writes, no other worker writes them. the
+		// writes are prepared in a batch of the worker, begin_batch(), and
+		// handed over with Binlog_Queue::join_batch(state())
+		Transaction(Binlog_Queue *logs, const std::vector<int> &stripes, bool lock){
+			this->init(logs, stripes, lock);
 		}
 
 		~Transaction(){
-			// it is safe to call rollback after commit
-			logs->rollback();
-			logs->mutex.unlock();
+			if (!nested){
+				// it is safe to call rollback after commit
+				logs->rollback();
+				if (locked){
+					logs->unlock(tran.stripes);
+				}
+			}
+		}
+
+		Binlog_Queue::Tran_State* state(){
+			return &tran;
 		}
 
 	private:
 		Binlog_Queue *logs;
+		Binlog_Queue::Tran_State tran;
+		bool nested;
+		bool locked;
+
+		void init(Binlog_Queue *logs, const std::vector<int> &stripes, bool lock){
+			this->logs = logs;
+			// part of a batch of this thread, which already holds the stripes
+			// of its writes
+			this->nested = logs->in_batch();
+			this->locked = lock;
+			if (!nested){
+				tran.stripes = stripes;
+				if (locked){
+					logs->lock(tran.stripes);
+				}
+				logs->begin(&tran);
+			}
+		}
 	};
 
 
@@ -0,0 +1,564 @@
+#include "binlog_store.h"
+#include "lvdb/binlog.h"
+#include "lvdb/const.h"
+#include "lvdb/strings.h"
+#include "toolkits/log.h"
+#include <algorithm>
+#include <stdlib.h>
+
+
+namespace lv
+{
+	static const size_t RECORD_HEADER_LEN = sizeof(uint32_t);
+	static const size_t BINLOG_HEADER_LEN = sizeof(uint64_t) + 2;
+
+	Binlog_Store::Binlog_Store(const std::string &dir){
+		this->env = leveldb::Env::Default();
+		this->dir = dir;
+		if (this->dir.empty() || this->dir[this->dir.size() - 1] != '/'){
+			this->dir.push_back('/');
+		}
+		this->active = NULL;
+		this->writer = NULL;
+		pthread_mutex_init(&mutex, NULL);
+	}
+
+	Binlog_Store::~Binlog_Store(){
+		pthread_mutex_lock(&mutex);
+		seal();
+		for (size_t i = 0; i < segments.size(); i++){
+			delete segments[i]->reader;
+			delete segments[i];
+		}
+		segments.clear();
+		pthread_mutex_unlock(&mutex);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	std::string Binlog_Store::segment_path(uint64_t first_seq) const{
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%020" PRIu64 ".log", first_seq);
+		return dir + buf;
+	}
+
+	int Binlog_Store::open(){
+		// fails when the directory exists
+		env->CreateDir(dir);
+
+		std::vector<std::string> names;
+		leveldb::Status s = env->GetChildren(dir, &names);
+		if (!s.ok()){
+			LOG_ERROR("list binlog dir error: " << s.ToString());
+			return -1;
+		}
+		std::vector<uint64_t> seqs;
+		for (size_t i = 0; i < names.size(); i++){
+			const std::string &n = names[i];
+			if (n.size() == 24 && n.compare(20, 4, ".log") == 0){
+				seqs.push_back(strtoull(n.c_str(), NULL, 10));
+			}
+			else if (n.size() == 28 && n.compare(20, 8, ".log.tmp") == 0){
+				// a rewrite stopped before its rename, the segment is intact
+				env->DeleteFile(dir + n);
+			}
+		}
+		std::sort(seqs.begin(), seqs.end());
+
+		pthread_mutex_lock(&mutex);
+		int ret = 0;
+		for (size_t i = 0; i < seqs.size(); i++){
+			if (load_segment(segment_path(seqs[i]), seqs[i]) == -1){
+				ret = -1;
+				break;
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	int Binlog_Store::load_segment(const std::string &path, uint64_t first_seq){
+		leveldb::SequentialFile *file;
+		leveldb::Status s = env->NewSequentialFile(path, &file);
+		if (!s.ok()){
+			LOG_ERROR("open binlog segment error: " << s.ToString());
+			return -1;
+		}
+		std::string data;
+		std::vector<char> scratch(65536);
+		while (1){
+			leveldb::Slice r;
+			s = file->Read(scratch.size(), &r, &scratch[0]);
+			if (!s.ok()){
+				break;
+			}
+			if (r.empty()){
+				break;
+			}
+			data.append(r.data(), r.size());
+		}
+		delete file;
+		if (!s.ok()){
+			LOG_ERROR("read binlog segment error: " << s.ToString());
+			return -1;
+		}
+
+		Segment *seg = new Segment();
+		seg->first_seq = first_seq;
+		seg->path = path;
+		seg->reader = NULL;
+		// stop at the first torn or out of order record, the segment was being
+		// written when the process stopped
+		size_t pos = 0;
+		while (pos + RECORD_HEADER_LEN <= data.size()){
+			uint32_t len;
+			memcpy(&len, data.data() + pos, sizeof(len));
+			if (len < BINLOG_HEADER_LEN || pos + RECORD_HEADER_LEN + len > data.size()){
+				break;
+			}
+			uint64_t seq;
+			memcpy(&seq, data.data() + pos + RECORD_HEADER_LEN, sizeof(seq));
+			if (seq != first_seq + seg->offsets.size()){
+				break;
+			}
+			seg->offsets.push_back((uint32_t)pos);
+			pos += RECORD_HEADER_LEN + len;
+		}
+		seg->size = pos;
+		if (pos < data.size()){
+			LOG_INFO("binlog segment " << path << " truncated at " << pos << " of " << data.size());
+		}
+
+		if (seg->offsets.empty()){
+			delete seg;
+			env->DeleteFile(path);
+			return 0;
+		}
+		if (!segments.empty()){
+			Segment *last = segments.back();
+			if (last->first_seq + last->offsets.size() > first_seq){
+				LOG_ERROR("binlog segment " << path << " overlaps " << last->path << ", skipped");
+				delete seg;
+				return 0;
+			}
+		}
+		s = env->NewRandomAccessFile(path, &seg->reader);
+		if (!s.ok()){
+			LOG_ERROR("open binlog segment error: " << s.ToString());
+			delete seg;
+			return -1;
+		}
+		segments.push_back(seg);
+		return 0;
+	}
+
+	leveldb::Status Binlog_Store::append(const Binlog &log){
+		leveldb::Status s;
+		uint64_t seq = log.seq();
+		pthread_mutex_lock(&mutex);
+		if (active && seq != active->first_seq + active->offsets.size()){
+			// seqs inside a segment are consecutive, start a new one after a gap
+			s = seal();
+		}
+		if (s.ok() && !segments.empty()){
+			Segment *last = segments.back();
+			if (seq < last->first_seq + last->offsets.size()){
+				s = leveldb::Status::Corruption("binlog seq out of order", str(seq));
+			}
+		}
+		if (s.ok() && !active){
+			Segment *seg = new Segment();
+			seg->first_seq = seq;
+			seg->path = segment_path(seq);
+			seg->size = 0;
+			seg->reader = NULL;
+			s = env->NewWritableFile(seg->path, &writer);
+			if (s.ok()){
+				active = seg;
+				active_data.clear();
+				segments.push_back(seg);
+			}
+			else{
+				delete seg;
+			}
+		}
+		if (s.ok()){
+			uint32_t len = (uint32_t)log.size();
+			size_t pos = active_data.size();
+			active_data.append((char *)&len, sizeof(len));
+			active_data.append(log.data(), log.size());
+			s = writer->Append(leveldb::Slice(active_data.data() + pos, active_data.size() - pos));
+			if (s.ok()){
+				active->offsets.push_back((uint32_t)active->size);
+				active->size += active_data.size() - pos;
+			}
+			else{
+				// the file may end with a partial record now, don't append after it
+				active_data.resize(pos);
+				seal();
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+		return s;
+	}
+
+	leveldb::Status Binlog_Store::flush(){
+		leveldb::Status s;
+		pthread_mutex_lock(&mutex);
+		if (writer){
+			s = writer->Flush();
+			if (s.ok() && (active->offsets.size() >= SEGMENT_RECORDS || active->size >= SEGMENT_BYTES)){
+				s = seal();
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+		return s;
+	}
+
+	// called with mutex held
+	leveldb::Status Binlog_Store::seal(){
+		leveldb::Status s;
+		if (!active){
+			return s;
+		}
+		s = writer->Close();
+		delete writer;
+		writer = NULL;
+		Segment *seg = active;
+		active = NULL;
+		std::string().swap(active_data);
+
+		if (seg->offsets.empty()){
+			segments.pop_back();
+			drop(seg);
+			return s;
+		}
+		if (s.ok()){
+			s = env->NewRandomAccessFile(seg->path, &seg->reader);
+		}
+		if (!s.ok()){
+			LOG_ERROR("seal binlog segment " << seg->path << " error: " << s.ToString());
+		}
+		return s;
+	}
+
+	void Binlog_Store::drop(Segment *seg){
+		delete seg->reader;
+		leveldb::Status s = env->DeleteFile(seg->path);
+		if (!s.ok()){
+			LOG_ERROR("delete binlog segment error: " << s.ToString());
+		}
+		delete seg;
+	}
+
+	int Binlog_Store::locate(uint64_t seq) const{
+		int lo = 0, hi = (int)segments.size() - 1, ret = -1;
+		while (lo <= hi){
+			int mid = (lo + hi) / 2;
+			if (segments[mid]->first_seq <= seq){
+				ret = mid;
+				lo = mid + 1;
+			}
+			else{
+				hi = mid - 1;
+			}
+		}
+		return ret;
+	}
+
+	int Binlog_Store::read(const Segment *seg, uint64_t seq, Binlog *log){
+		std::vector<Binlog> logs;
+		if (read_range(seg, seq, 1, &logs) == -1){
+			return -1;
+		}
+		*log = logs[0];
+		return 1;
+	}
+
+	// count records from seq, all inside seg
+	int Binlog_Store::read_range(const Segment *seg, uint64_t seq, int count, std::vector<Binlog> *logs){
+		size_t first = (size_t)(seq - seg->first_seq);
+		size_t last = first + count - 1;
+		uint64_t begin = seg->offsets[first];
+		uint64_t end = (last + 1 < seg->offsets.size()) ? seg->offsets[last + 1] : seg->size;
+		std::string scratch;
+		const char *data;
+		if (seg == active){
+			data = active_data.data() + begin;
+		}
+		else{
+			if (!seg->reader){
+				return -1;
+			}
+			scratch.resize(end - begin);
+			leveldb::Slice r;
+			leveldb::Status s = seg->reader->Read(begin, end - begin, &r, &scratch[0]);
+			if (!s.ok()){
+				LOG_ERROR("read binlog " << seq << " error: " << s.ToString());
+				return -1;
+			}
+			data = r.data();
+		}
+		size_t n = logs->size();
+		logs->resize(n + count);
+		for (size_t i = first; i <= last; i++, n++){
+			uint64_t rec_begin = seg->offsets[i] + RECORD_HEADER_LEN;
+			uint64_t rec_end = (i + 1 < seg->offsets.size()) ? seg->offsets[i + 1] : seg->size;
+			if ((*logs)[n].load(leveldb::Slice(data + (rec_begin - begin), rec_end - rec_begin)) == -1){
+				logs->resize(n);
+				return -1;
+			}
+		}
+		for (size_t i = 0; i < noops.size(); i++){
+			uint64_t from = std::max(noops[i].first, seq);
+			uint64_t to = std::min(noops[i].second, seq + count - 1);
+			for (; from <= to; from++){
+				(*logs)[logs->size() - count + (from - seq)] = Binlog(from, BinlogType::NOOP, BinlogCommand::NONE, leveldb::Slice());
+			}
+		}
+		return count;
+	}
+
+	int Binlog_Store::get(uint64_t seq, Binlog *log){
+		int ret = 0;
+		pthread_mutex_lock(&mutex);
+		int idx = locate(seq);
+		if (idx >= 0 && seq < segments[idx]->first_seq + segments[idx]->offsets.size()){
+			ret = read(segments[idx], seq, log);
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	int Binlog_Store::find_next(uint64_t seq, Binlog *log){
+		int ret = 0;
+		pthread_mutex_lock(&mutex);
+		int idx = locate(seq);
+		if (idx >= 0 && seq < segments[idx]->first_seq + segments[idx]->offsets.size()){
+			ret = read(segments[idx], seq, log);
+		}
+		else if (idx + 1 < (int)segments.size()){
+			// seq is in a gap or before the first segment
+			Segment *seg = segments[idx + 1];
+			ret = read(seg, seg->first_seq, log);
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	int Binlog_Store::read_batch(uint64_t seq, uint64_t last, int limit, std::vector<Binlog> *logs){
+		if (limit <= 0){
+			return 0;
+		}
+		int ret = 0;
+		pthread_mutex_lock(&mutex);
+		int idx = locate(seq);
+		if (idx < 0 || seq >= segments[idx]->first_seq + segments[idx]->offsets.size()){
+			// seq is in a gap or before the first segment
+			idx++;
+			if (idx < (int)segments.size()){
+				seq = segments[idx]->first_seq;
+			}
+		}
+		if (idx < (int)segments.size() && seq <= last){
+			Segment *seg = segments[idx];
+			uint64_t count = seg->first_seq + seg->offsets.size() - seq;
+			count = std::min(count, last - seq + 1);
+			count = std::min(count, (uint64_t)limit);
+			ret = read_range(seg, seq, (int)count, logs);
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	uint64_t Binlog_Store::min_seq(){
+		uint64_t ret = 0;
+		pthread_mutex_lock(&mutex);
+		if (!segments.empty()){
+			ret = segments.front()->first_seq;
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	uint64_t Binlog_Store::max_seq(){
+		uint64_t ret = 0;
+		pthread_mutex_lock(&mutex);
+		if (!segments.empty()){
+			Segment *last = segments.back();
+			ret = last->first_seq + last->offsets.size() - 1;
+		}
+		pthread_mutex_unlock(&mutex);
+		return ret;
+	}
+
+	int Binlog_Store::drop_before(uint64_t seq){
+		int count = 0;
+		pthread_mutex_lock(&mutex);
+		while (!segments.empty() && segments.front() != active){
+			Segment *seg = segments.front();
+			if (seg->first_seq + seg->offsets.size() > seq){
+				break;
+			}
+			segments.erase(segments.begin());
+			drop(seg);
+			count++;
+		}
+		while (!noops.empty() && noops.front().second < seq){
+			noops.erase(noops.begin());
+		}
+		pthread_mutex_unlock(&mutex);
+		return count;
+	}
+
+	int Binlog_Store::clear(){
+		pthread_mutex_lock(&mutex);
+		seal();
+		int count = (int)segments.size();
+		for (size_t i = 0; i < segments.size(); i++){
+			drop(segments[i]);
+		}
+		segments.clear();
+		noops.clear();
+		pthread_mutex_unlock(&mutex);
+		return count;
+	}
+
+	// called with mutex held
+	leveldb::Status Binlog_Store::read_all(const Segment *seg, std::string *data){
+		if (!seg->reader){
+			return leveldb::Status::IOError("binlog segment not open", seg->path);
+		}
+		std::string scratch(seg->size, '\0');
+		leveldb::Slice r;
+		leveldb::Status s = seg->reader->Read(0, seg->size, &r, &scratch[0]);
+		if (s.ok() && r.size() != seg->size){
+			s = leveldb::Status::Corruption("short binlog segment", seg->path);
+		}
+		if (s.ok()){
+			data->assign(r.data(), r.size());
+		}
+		return s;
+	}
+
+	// called with mutex held, the new file replaces the old one by a rename
+	leveldb::Status Binlog_Store::rewrite(Segment *seg, const std::string &data, const std::vector<uint32_t> &offsets){
+		std::string tmp = seg->path + ".tmp";
+		leveldb::WritableFile *file;
+		leveldb::Status s = env->NewWritableFile(tmp, &file);
+		if (!s.ok()){
+			return s;
+		}
+		s = file->Append(data);
+		if (s.ok()){
+			s = file->Sync();
+		}
+		if (s.ok()){
+			s = file->Close();
+		}
+		delete file;
+		if (s.ok()){
+			s = env->RenameFile(tmp, seg->path);
+		}
+		if (!s.ok()){
+			env->DeleteFile(tmp);
+			return s;
+		}
+		delete seg->reader;
+		seg->reader = NULL;
+		seg->offsets = offsets;
+		seg->size = data.size();
+		return env->NewRandomAccessFile(seg->path, &seg->reader);
+	}
+
+	int Binlog_Store::truncate(uint64_t seq){
+		int count = 0;
+		pthread_mutex_lock(&mutex);
+		seal();
+		while (!segments.empty()){
+			Segment *seg = segments.back();
+			if (seg->first_seq > seq){
+				count += (int)seg->offsets.size();
+				segments.pop_back();
+				drop(seg);
+				continue;
+			}
+			size_t keep = (size_t)(seq - seg->first_seq + 1);
+			if (keep < seg->offsets.size()){
+				int dropped = (int)(seg->offsets.size() - keep);
+				std::string data;
+				leveldb::Status s = read_all(seg, &data);
+				if (s.ok()){
+					data.resize(seg->offsets[keep]);
+					std::vector<uint32_t> offsets(seg->offsets.begin(), seg->offsets.begin() + keep);
+					s = rewrite(seg, data, offsets);
+				}
+				if (!s.ok()){
+					LOG_ERROR("truncate binlog segment " << seg->path << " error: " << s.ToString());
+					count = -1;
+					break;
+				}
+				count += dropped;
+			}
+			break;
+		}
+		pthread_mutex_unlock(&mutex);
+		return count;
+	}
+
+	void Binlog_Store::set_noop(uint64_t start, uint64_t end){
+		pthread_mutex_lock(&mutex);
+		noops.push_back(std::make_pair(start, end));
+		if (active && active->first_seq <= end && active->first_seq + active->offsets.size() > start){
+			// the active segment can only be appended to, it is rewritten sealed
+			seal();
+		}
+		for (size_t i = 0; i < segments.size(); i++){
+			Segment *seg = segments[i];
+			uint64_t seg_end = seg->first_seq + seg->offsets.size() - 1;
+			if (seg_end < start || seg->first_seq > end){
+				continue;
+			}
+			std::string data;
+			leveldb::Status s = read_all(seg, &data);
+			std::string out;
+			std::vector<uint32_t> offsets;
+			for (size_t j = 0; s.ok() && j < seg->offsets.size(); j++){
+				uint64_t seq = seg->first_seq + j;
+				offsets.push_back((uint32_t)out.size());
+				if (seq >= start && seq <= end){
+					Binlog noop(seq, BinlogType::NOOP, BinlogCommand::NONE, leveldb::Slice());
+					uint32_t len = (uint32_t)noop.size();
+					out.append((char *)&len, sizeof(len));
+					out.append(noop.data(), noop.size());
+				}
+				else{
+					uint64_t rec_end = (j + 1 < seg->offsets.size()) ? seg->offsets[j + 1] : seg->size;
+					out.append(data, seg->offsets[j], rec_end - seg->offsets[j]);
+				}
+			}
+			if (s.ok()){
+				s = rewrite(seg, out, offsets);
+			}
+			if (!s.ok()){
+				LOG_ERROR("mask binlogs " << start << " ~ " << end << " in " << seg->path << " error: " << s.ToString());
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+	}
+
+	std::string Binlog_Store::stats(){
+		uint64_t bytes = 0;
+		pthread_mutex_lock(&mutex);
+		size_t count = segments.size();
+		for (size_t i = 0; i < segments.size(); i++){
+			bytes += segments[i]->size;
+		}
+		pthread_mutex_unlock(&mutex);
+		std::string s;
+		s.append("    segments : " + str((uint64_t)count) + "\n");
+		s.append("    bytes    : " + str(bytes) + "");
+		return s;
+	}
+
+
+}
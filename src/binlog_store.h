@@ -0,0 +1,110 @@
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include "pthread.h"
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+
+
+namespace lv
+{
+	class Binlog;
+
+
+	// append-only binlog files
+	//
+	// The binlogs are written to segment files named by the seq of their first
+	// record, each record is a fixed32 length followed by Binlog::repr(). A
+	// segment is sealed once it holds SEGMENT_RECORDS records or SEGMENT_BYTES
+	// bytes, sealed segments are read through leveldb::RandomAccessFile (mmap
+	// on posix) and dropped whole once they fall out of the binlog capacity.
+	// Seqs inside a segment are consecutive, so a record is found with the
+	// segment's in-memory offset index.
+	class Binlog_Store
+	{
+	public:
+		static const int SEGMENT_RECORDS = 65536;
+		static const int SEGMENT_BYTES = 32 * 1024 * 1024;
+
+		Binlog_Store(const std::string &dir);
+		~Binlog_Store();
+
+		// load the existing segments, new records always go to a new segment
+		int open();
+
+		// seq must be greater than the last appended one
+		leveldb::Status append(const Binlog &log);
+		// make the appended records readable from the files
+		leveldb::Status flush();
+
+		/** @returns
+		 1 : found
+		 0 : not found
+		 -1: error
+		 */
+		int get(uint64_t seq, Binlog *log);
+		// first record with log.seq >= seq
+		int find_next(uint64_t seq, Binlog *log);
+		// consecutive records from the first one with log.seq >= seq, up to
+		// seq `last` and `limit` records, read from one segment with a single
+		// file read. returns the number of records appended to logs or -1
+		int read_batch(uint64_t seq, uint64_t last, int limit, std::vector<Binlog> *logs);
+
+		// first and last seq stored, 0 when empty
+		uint64_t min_seq();
+		uint64_t max_seq();
+
+		// drop the segments whose records are all before seq
+		int drop_before(uint64_t seq);
+		// drop every segment
+		int clear();
+		// drop the records after seq, returns the number dropped or -1
+		int truncate(uint64_t seq);
+		// replace the records from start to end with NOOP records, the
+		// segments holding them are rewritten
+		void set_noop(uint64_t start, uint64_t end);
+
+		std::string stats();
+
+	private:
+		struct Segment
+		{
+			uint64_t first_seq;
+			std::string path;
+			// offset of each record, indexed by seq - first_seq
+			std::vector<uint32_t> offsets;
+			uint64_t size;
+			// sealed segments only
+			leveldb::RandomAccessFile *reader;
+		};
+
+		leveldb::Env *env;
+		std::string dir;
+		pthread_mutex_t mutex;
+		// ordered by first_seq, the last one may be the active segment
+		std::vector<Segment*> segments;
+		// the active segment, its records are kept in memory until it is sealed
+		Segment *active;
+		leveldb::WritableFile *writer;
+		std::string active_data;
+		// masked at once, in case the rewrite of their segment fails
+		std::vector<std::pair<uint64_t, uint64_t> > noops;
+
+		std::string segment_path(uint64_t first_seq) const;
+		int load_segment(const std::string &path, uint64_t first_seq);
+		leveldb::Status seal();
+		// the whole file of a sealed segment
+		leveldb::Status read_all(const Segment *seg, std::string *data);
+		// replace the file of a sealed segment with data, records at offsets
+		leveldb::Status rewrite(Segment *seg, const std::string &data, const std::vector<uint32_t> &offsets);
+		void drop(Segment *seg);
+		// locate seq, returns the segment index or -1
+		int locate(uint64_t seq) const;
+		int read(const Segment *seg, uint64_t seq, Binlog *log);
+		int read_range(const Segment *seg, uint64_t seq, int count, std::vector<Binlog> *logs);
+	};
+
+
+}
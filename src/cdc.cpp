@@ -0,0 +1,175 @@
+#include "lvdb/cdc.h"
+#include "lvdb_impl.h"
+#include "toolkits/log.h"
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+
+
+namespace lv
+{
+	// the data type written by cmd, 0 for the binlogs of no data
+	static char data_type(char cmd)
+	{
+		switch (cmd) {
+		case BinlogCommand::KSET:
+		case BinlogCommand::KDEL:
+			return DataType::KV;
+		case BinlogCommand::HSET:
+		case BinlogCommand::HDEL:
+		case BinlogCommand::HCLEAR:
+			return DataType::HASH;
+		case BinlogCommand::ZSET:
+		case BinlogCommand::ZDEL:
+		case BinlogCommand::ZCLEAR:
+			return DataType::ZSET;
+		case BinlogCommand::QPUSH_BACK:
+		case BinlogCommand::QPUSH_FRONT:
+		case BinlogCommand::QPOP_BACK:
+		case BinlogCommand::QPOP_FRONT:
+		case BinlogCommand::QSET:
+		case BinlogCommand::QCLEAR:
+			return DataType::QUEUE;
+		}
+		return 0;
+	}
+
+	bool Cdc_Filter::match(const Binlog& log) const
+	{
+		if (log.type() == BinlogType::NOOP || log.type() == BinlogType::CTRL) {
+			return false;
+		}
+		char cmd = log.cmd();
+		if (!cmds.empty() && cmds.find(cmd) == std::string::npos) {
+			return false;
+		}
+		char type = data_type(cmd);
+		if (type == 0) {
+			return false;
+		}
+		if (!types.empty() && types.find(type) == std::string::npos) {
+			return false;
+		}
+		if (prefix.empty()) {
+			return true;
+		}
+		Bytes name = log.name();
+		return name.size() >= (int)prefix.size() && memcmp(name.data(), prefix.data(), prefix.size()) == 0;
+	}
+
+
+
+	Cdc_Cursor::Cdc_Cursor(LVDB* db, const std::string& name, const Cdc_Filter& filter) :
+		db_(db),
+		impl_(NULL),
+		seq_key_(name + ":cdc:seq"),
+		filter_(filter),
+		next_seq_(1),
+		lost_begin_(0),
+		lost_end_(0)
+	{
+		if (db_->shards() > 1) {
+			LOG_ERROR(name << " can't subscribe to a db of " << db_->shards() << " shards, subscribe to each shard(i)");
+			return;
+		}
+		impl_ = (LVDB_Impl*)db_->shard(0);
+		std::string val;
+		uint64_t last_seq = 0;
+		if (db_->meta_get(seq_key_, &val) == 1) {
+			Bytes_uint64::FromString(last_seq, val);
+		}
+		else {
+			// registered from here, a restart before the first commit
+			// doesn't miss the writes in between
+			last_seq = impl_->binlogs->max_seq();
+			db_->meta_set(seq_key_, Bytes_uint64(last_seq));
+		}
+		next_seq_ = last_seq + 1;
+		LOG_INFO(name << " cdc from seq: " << next_seq_);
+	}
+
+	int Cdc_Cursor::next(std::vector<Binlog>* logs, int limit, int timeout_ms)
+	{
+		logs->clear();
+		if (!impl_) {
+			return -1;
+		}
+		Binlog_Cursor cursor(impl_->binlogs, next_seq_);
+		std::vector<Binlog> batch;
+		std::vector<Binlog> entries;
+		std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+		// the binlogs filtered out don't end the wait
+		while (logs->empty()) {
+			int64_t left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+			int ret = cursor.next(&batch, limit, (int)std::max(left, (int64_t)0));
+			if (ret == -1) {
+				return -1;
+			}
+			if (ret == 0) {
+				// every binlog up to the last one was dropped
+				if (cursor.seq() > next_seq_) {
+					return lost(next_seq_, cursor.seq());
+				}
+				break;
+			}
+			for (size_t i = 0; i < batch.size(); i++) {
+				const Binlog &log = batch[i];
+				if (log.seq() > next_seq_) {
+					// reported by the next call, after the binlogs before it
+					if (!logs->empty()) {
+						return (int)logs->size();
+					}
+					return lost(next_seq_, log.seq());
+				}
+				next_seq_ = log.seq() + 1;
+				if (log.cmd() != BinlogCommand::BEGIN) {
+					if (filter_.match(log)) {
+						logs->push_back(log);
+					}
+					continue;
+				}
+				if (log.entries(&entries) == -1) {
+					LOG_ERROR("skip corrupt binlog group " << log.seq());
+					continue;
+				}
+				for (size_t j = 0; j < entries.size(); j++) {
+					if (filter_.match(entries[j])) {
+						logs->push_back(entries[j]);
+					}
+				}
+			}
+			if (left <= 0) {
+				break;
+			}
+		}
+		return (int)logs->size();
+	}
+
+	// the binlogs [begin, end) are gone, the cursor goes on at end
+	int Cdc_Cursor::lost(uint64_t begin, uint64_t end)
+	{
+		LOG_WARN(seq_key_ << " binlogs [" << begin << ", " << (end - 1) << "] lost");
+		lost_begin_ = begin;
+		lost_end_ = end - 1;
+		next_seq_ = end;
+		return -2;
+	}
+
+	int Cdc_Cursor::commit()
+	{
+		return db_->meta_set(seq_key_, Bytes_uint64(next_seq_ - 1));
+	}
+
+	int Cdc_Cursor::remove()
+	{
+		return db_->meta_del(seq_key_);
+	}
+
+
+
+	Cdc_Cursor* LVDB_Impl::subscribe(const std::string &name, const Cdc_Filter &filter){
+		return new Cdc_Cursor(this, name, filter);
+	}
+
+
+}
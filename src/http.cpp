@@ -87,6 +87,7 @@ namespace lv
 	DEF_PROC(flushdb);
 	DEF_PROC(size);
 	DEF_PROC(info);
+	DEF_PROC(stats);
 	DEF_PROC(compact);
 	DEF_PROC(keyrange);
 
@@ -98,6 +99,7 @@ namespace lv
 
 	//kv
 	DEF_PROC(get);
+	DEF_PROC(multiget);
 	DEF_PROC(getset);
 	DEF_PROC(set);
 	DEF_PROC(setnx);
@@ -112,9 +114,17 @@ namespace lv
 	DEF_PROC(hdel);
 	DEF_PROC(hclear);
 	DEF_PROC(hget);
+	DEF_PROC(multihget);
 	DEF_PROC(hscan);
 	DEF_PROC(hrscan);
 
+	//zset
+	DEF_PROC(zclear);
+	DEF_PROC(multizget);
+
+	//queue
+	DEF_PROC(qclear);
+
 	bool HTTP_Dispatcher::dispatch(const std::string& path, toolkit::WebSocket_Server* ws)
 	{
 		HTTP_HANDLER_MAP::iterator it = handlers_.find(path);
@@ -149,6 +159,7 @@ namespace lv
 		DEF_PROC(flushdb);
 		DEF_PROC(size);
 		DEF_PROC(info);
+		DEF_PROC(stats);
 		DEF_PROC(compact);
 		DEF_PROC(keyrange);
 
@@ -160,6 +171,7 @@ namespace lv
 
 		//kv
 		DEF_PROC(get);
+		DEF_PROC(multiget);
 		DEF_PROC(getset);
 		DEF_PROC(set);
 		DEF_PROC(setnx);
@@ -174,9 +186,17 @@ namespace lv
 		DEF_PROC(hdel);
 		DEF_PROC(hclear);
 		DEF_PROC(hget);
+		DEF_PROC(multihget);
 		DEF_PROC(hscan);
 		DEF_PROC(hrscan);
 
+		//zset
+		DEF_PROC(zclear);
+		DEF_PROC(multizget);
+
+		//queue
+		DEF_PROC(qclear);
+
 #undef DEF_PROC
 #pragma pop_macro("DEF_PROC")
 
@@ -225,6 +245,24 @@ namespace lv
 		return 0;
 	}
 
+	// the op_stats of info(), of each shard for a sharded db
+	DEF_PROC(stats)
+	{
+		static const std::string suffix = ".op_stats";
+		std::vector<std::string> vs = db->info();
+		std::string content;
+		for (size_t i = 0; i + 1 < vs.size(); i += 2) {
+			const std::string &name = vs[i];
+			if (name != "op_stats" && !(name.size() > suffix.size()
+				&& name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)) {
+				continue;
+			}
+			content.append(name).append("\n").append(vs[i + 1]).append("\n");
+		}
+		ws->http_response(200, content.c_str(), content.length());
+		return 0;
+	}
+
 	DEF_PROC(compact)
 	{
 		HTTP_RESPONSE_NOT_IMPL;
@@ -286,6 +324,58 @@ namespace lv
 	}
 
 
+	// the keys of a multi get are sent as a dbapipb::Request in the body
+	static int multi_keys_arg(toolkit::WebSocket_Server* ws, dbapipb::Request *req, std::vector<Bytes> *keys)
+	{
+		if (!req->ParseFromArray(ws->http_body(), ws->http_body_length())) {
+			return -1;
+		}
+		for (int i = 0; i < req->key_size(); ++i) {
+			keys->push_back(Bytes(req->key(i)));
+		}
+		return 0;
+	}
+
+	static void multi_response(toolkit::WebSocket_Server* ws, int ret, const std::vector<Bytes> &keys, const Multi_Values &vals)
+	{
+		dbapipb::Response res;
+		res.set_errcode(ret);
+		res.set_success(ret >= 0);
+		for (size_t i = 0; ret >= 0 && i < vals.size(); ++i) {
+			if (vals.found(i)) {
+				Bytes v = vals.value(i);
+				dbapipb::KV* kv = res.add_values();
+				kv->set_key(keys[i].data(), keys[i].size());
+				kv->set_value(v.data(), v.size());
+			}
+		}
+		PB_RESPONSE(ret >= 0 ? 200 : 500, res);
+	}
+
+
+	// write "key\nval\n" rows straight from the iterator views, the rows are
+	// packed into one buffer as the views don't outlive the next next_view()
+	template<typename T>
+	static void scan_response(toolkit::WebSocket_Server* ws, T *it)
+	{
+		std::string buf;
+		while (it->next_view()){
+			Bytes k = it->key_view();
+			Bytes v = it->val_view();
+			buf.append(k.data(), k.size());
+			buf.append(1, '\n');
+			buf.append(v.data(), v.size());
+			buf.append(1, '\n');
+		}
+		it->release();
+
+		iovec vec;
+		vec.iov_base = (void*)buf.data();
+		vec.iov_len = buf.size();
+		ws->http_responsev(200, &vec, 1);
+	}
+
+
 	//////////////////////////////////////////////////////////////////////////
 	//kv
 	DEF_PROC(get)
@@ -310,6 +400,20 @@ namespace lv
 		return 0;
 	}
 
+	DEF_PROC(multiget)
+	{
+		dbapipb::Request req;
+		std::vector<Bytes> keys;
+		if (multi_keys_arg(ws, &req, &keys) < 0) {
+			HTTP_RESPONSE_URI_ARG;
+			return -3;
+		}
+		Multi_Values vals;
+		int ret = db->multi_get(keys, &vals);
+		multi_response(ws, ret, keys, vals);
+		return 0;
+	}
+
 	DEF_PROC(getset)
 	{
 		KEY_ARG;
@@ -403,22 +507,7 @@ namespace lv
 		KEY_ARG_NTH(2);
 		LIMIT_ARG;
 		KIterator *it = db->scan(*key1, *key2, limit);
-		std::vector<std::string> vs;
-		while (it->next()){
-			vs.push_back(it->key);
-			vs.push_back(it->val);
-		}
-		delete it;
-
-		iovec *vec = STACK_ARRAY(iovec, vs.size() * 2);
-		static const std::string newline = "\n";
-		for (int i = 0; i < vs.size(); ++i) {
-			vec[2 * i].iov_base = (void*)vs[i].c_str();
-			vec[2 * i].iov_len = vs[i].length();
-			vec[2 * i + 1].iov_base = (void*)newline.c_str();
-			vec[2 * i + 1].iov_len = 1;
-		}
-		ws->http_responsev(200, vec, vs.size() * 2);
+		scan_response(ws, it);
 
 		return 0;
 	}
@@ -429,22 +518,7 @@ namespace lv
 		KEY_ARG_NTH(2);
 		LIMIT_ARG;
 		KIterator *it = db->rscan(*key1, *key2, limit);
-		std::vector<std::string> vs;
-		while (it->next()){
-			vs.push_back(it->key);
-			vs.push_back(it->val);
-		}
-		delete it;
-
-		iovec *vec = STACK_ARRAY(iovec, vs.size() * 2);
-		static const std::string newline = "\n";
-		for (int i = 0; i < vs.size(); ++i) {
-			vec[2 * i].iov_base = (void*)vs[i].c_str();
-			vec[2 * i].iov_len = vs[i].length();
-			vec[2 * i + 1].iov_base = (void*)newline.c_str();
-			vec[2 * i + 1].iov_len = 1;
-		}
-		ws->http_responsev(200, vec, vs.size() * 2);
+		scan_response(ws, it);
 
 		return 0;
 	}
@@ -513,6 +587,21 @@ namespace lv
 		return 0;
 	}
 
+	DEF_PROC(multihget)
+	{
+		URI_ARG(name);
+		dbapipb::Request req;
+		std::vector<Bytes> keys;
+		if (multi_keys_arg(ws, &req, &keys) < 0) {
+			HTTP_RESPONSE_URI_ARG;
+			return -3;
+		}
+		Multi_Values vals;
+		int ret = db->multi_hget(name, keys, &vals);
+		multi_response(ws, ret, keys, vals);
+		return 0;
+	}
+
 	DEF_PROC(hscan)
 	{
 		URI_ARG(name);
@@ -520,22 +609,7 @@ namespace lv
 		KEY_ARG_NTH(2);
 		LIMIT_ARG;
 		HIterator *it = db->hscan(name, *key1, *key2, limit);
-		std::vector<std::string> vs;
-		while (it->next()){
-			vs.push_back(it->key);
-			vs.push_back(it->val);
-		}
-		delete it;
-
-		iovec *vec = STACK_ARRAY(iovec, vs.size() * 2);
-		static const std::string newline = "\n";
-		for (int i = 0; i < vs.size(); ++i) {
-			vec[2 * i].iov_base = (void*)vs[i].c_str();
-			vec[2 * i].iov_len = vs[i].length();
-			vec[2 * i + 1].iov_base = (void*)newline.c_str();
-			vec[2 * i + 1].iov_len = 1;
-		}
-		ws->http_responsev(200, vec, vs.size() * 2);
+		scan_response(ws, it);
 		return 0;
 	}
 
@@ -546,26 +620,48 @@ namespace lv
 		KEY_ARG_NTH(2);
 		LIMIT_ARG;
 		HIterator *it = db->hrscan(name, *key1, *key2, limit);
-		std::vector<std::string> vs;
-		while (it->next()){
-			vs.push_back(it->key);
-			vs.push_back(it->val);
-		}
-		delete it;
+		scan_response(ws, it);
+		return 0;
+	}
 
-		iovec *vec = STACK_ARRAY(iovec, vs.size() * 2);
-		static const std::string newline = "\n";
-		for (int i = 0; i < vs.size(); ++i) {
-			vec[2 * i].iov_base = (void*)vs[i].c_str();
-			vec[2 * i].iov_len = vs[i].length();
-			vec[2 * i + 1].iov_base = (void*)newline.c_str();
-			vec[2 * i + 1].iov_len = 1;
+
+
+	//////////////////////////////////////////////////////////////////////////
+	//zset
+	DEF_PROC(zclear)
+	{
+		URI_ARG(name);
+		std::string ret = str(db->zclear(name));
+		HTTP_RESPONSE(200, ret);
+		return 0;
+	}
+
+	DEF_PROC(multizget)
+	{
+		URI_ARG(name);
+		dbapipb::Request req;
+		std::vector<Bytes> keys;
+		if (multi_keys_arg(ws, &req, &keys) < 0) {
+			HTTP_RESPONSE_URI_ARG;
+			return -3;
 		}
-		ws->http_responsev(200, vec, vs.size() * 2);
+		Multi_Values scores;
+		int ret = db->multi_zget(name, keys, &scores);
+		multi_response(ws, ret, keys, scores);
 		return 0;
 	}
 
 
 
+	//////////////////////////////////////////////////////////////////////////
+	//queue
+	DEF_PROC(qclear)
+	{
+		URI_ARG(name);
+		std::string ret = str(db->qclear(name));
+		HTTP_RESPONSE(200, ret);
+		return 0;
+	}
+
 
 }
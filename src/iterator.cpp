@@ -5,6 +5,8 @@
 #include "lvdb/t_zset.h"
 #include "lvdb/t_queue.h"
 #include "leveldb/iterator.h"
+#include "iterator_pool.h"
+#include "read_policy.h"
 
 
 namespace lv
@@ -12,9 +14,13 @@ namespace lv
 	Iterator::Iterator(leveldb::Iterator *it,
 		const std::string &end,
 		uint64_t limit,
-		Direction direction)
+		Direction direction,
+		Iterator_Pool *pool,
+		int policy)
 	{
 		this->it = it;
+		this->pool = pool;
+		this->policy = policy;
 		this->end = end;
 		this->limit = limit;
 		this->is_first = true;
@@ -22,7 +28,12 @@ namespace lv
 	}
 
 	Iterator::~Iterator(){
-		delete it;
+		if (pool){
+			pool->put(it);
+		}
+		else{
+			delete it;
+		}
 	}
 
 	Bytes Iterator::key(){
@@ -48,6 +59,7 @@ namespace lv
 		if (limit == 0){
 			return false;
 		}
+		Read_Scope scope(policy);
 		if (is_first){
 			is_first = false;
 		}
@@ -107,19 +119,28 @@ namespace lv
 	}
 
 	bool KIterator::next(){
+		if (!next_view()){
+			return false;
+		}
+		this->key.assign(key_view_.data(), key_view_.size());
+		if (return_val_){
+			this->val.assign(val_view_.data(), val_view_.size());
+		}
+		return true;
+	}
+
+	bool KIterator::next_view(){
 		while (it->next()){
 			Bytes ks = it->key();
-			Bytes vs = it->val();
 			//dump(ks.data(), ks.size(), "z.next");
-			//dump(vs.data(), vs.size(), "z.next");
 			if (ks.data()[0] != DataType::KV){
 				return false;
 			}
-			if (decode_kv_key(ks, &this->key) == -1){
+			if (decode_kv_key(ks, &key_view_) == -1){
 				continue;
 			}
 			if (return_val_){
-				this->val.assign(vs.data(), vs.size());
+				val_view_ = it->val();
 			}
 			return true;
 		}
@@ -150,23 +171,32 @@ namespace lv
 	}
 
 	bool HIterator::next(){
+		if (!next_view()){
+			return false;
+		}
+		this->key.assign(key_view_.data(), key_view_.size());
+		if (return_val_){
+			this->val.assign(val_view_.data(), val_view_.size());
+		}
+		return true;
+	}
+
+	bool HIterator::next_view(){
 		while (it->next()){
 			Bytes ks = it->key();
-			Bytes vs = it->val();
 			//dump(ks.data(), ks.size(), "z.next");
-			//dump(vs.data(), vs.size(), "z.next");
 			if (ks.data()[0] != DataType::HASH){
 				return false;
 			}
-			std::string n;
-			if (decode_hash_key(ks, &n, &key) == -1){
+			Bytes n;
+			if (decode_hash_key(ks, &n, &key_view_) == -1){
 				continue;
 			}
-			if (n != this->name){
+			if (n.compare(this->name) != 0){
 				return false;
 			}
 			if (return_val_){
-				this->val.assign(vs.data(), vs.size());
+				val_view_ = it->val();
 			}
 			return true;
 		}
@@ -185,6 +215,7 @@ namespace lv
 	ZIterator::ZIterator(Iterator *it, const Bytes &name){
 		this->it = it;
 		this->name.assign(name.data(), name.size());
+		this->score_value_ = 0;
 	}
 
 	ZIterator::~ZIterator(){
@@ -201,15 +232,22 @@ namespace lv
 	}
 
 	bool ZIterator::next(){
+		if (!next_view()){
+			return false;
+		}
+		this->key.assign(key_view_.data(), key_view_.size());
+		this->score = str(score_value_);
+		return true;
+	}
+
+	bool ZIterator::next_view(){
 		while (it->next()){
 			Bytes ks = it->key();
-			//Bytes vs = it->val();
 			//dump(ks.data(), ks.size(), "z.next");
-			//dump(vs.data(), vs.size(), "z.next");
 			if (ks.data()[0] != DataType::ZSCORE){
 				return false;
 			}
-			if (decode_zscore_key(ks, NULL, &key, &score) == -1){
+			if (decode_zscore_key(ks, NULL, &key_view_, &score_value_) == -1){
 				continue;
 			}
 			return true;
@@ -0,0 +1,149 @@
+#include "iterator_pool.h"
+#include "binlog_queue.h"
+#include "lvdb/strings.h"
+#include <algorithm>
+#include <chrono>
+
+
+namespace lv
+{
+	// lent entries of iterators released on other threads are never taken
+	// back, they are dropped past this count
+	static const size_t MAX_LENT = 64;
+
+	static int64_t now_ms(){
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	Iterator_Pool::Iterator_Pool(leveldb::DB *db, int max_age_ms){
+		this->db = db;
+		this->max_age_ms = max_age_ms;
+		pthread_key_create(&key, &Iterator_Pool::free_cache);
+		pthread_mutex_init(&mutex, NULL);
+	}
+
+	Iterator_Pool::~Iterator_Pool(){
+		pthread_key_delete(key);
+		pthread_mutex_lock(&mutex);
+		for (size_t i = 0; i < caches.size(); i++){
+			Thread_Cache *c = caches[i];
+			for (size_t j = 0; j < c->idle.size(); j++){
+				delete c->idle[j].it;
+			}
+			delete c;
+		}
+		caches.clear();
+		pthread_mutex_unlock(&mutex);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	void Iterator_Pool::free_cache(void *arg){
+		Thread_Cache *c = (Thread_Cache *)arg;
+		Iterator_Pool *pool = c->pool;
+		pthread_mutex_lock(&pool->mutex);
+		pool->caches.erase(std::remove(pool->caches.begin(), pool->caches.end(), c), pool->caches.end());
+		pthread_mutex_unlock(&pool->mutex);
+		for (size_t i = 0; i < c->idle.size(); i++){
+			delete c->idle[i].it;
+		}
+		delete c;
+	}
+
+	Iterator_Pool::Thread_Cache* Iterator_Pool::cache(){
+		Thread_Cache *c = (Thread_Cache *)pthread_getspecific(key);
+		if (c == NULL){
+			c = new Thread_Cache();
+			c->pool = this;
+			c->hits = 0;
+			c->misses = 0;
+			pthread_setspecific(key, c);
+			pthread_mutex_lock(&mutex);
+			caches.push_back(c);
+			pthread_mutex_unlock(&mutex);
+		}
+		return c;
+	}
+
+	bool Iterator_Pool::fresh(const Entry &e, uint64_t writes, int64_t now) const{
+		return e.writes == writes && now - e.ctime < max_age_ms;
+	}
+
+	leveldb::Iterator* Iterator_Pool::get(bool fill_cache){
+		Thread_Cache *c = cache();
+		uint64_t writes = Binlog_Queue::thread_writes();
+		int64_t now = now_ms();
+		Entry e;
+		e.it = NULL;
+		for (size_t i = c->idle.size(); i-- > 0;){
+			Entry last = c->idle[i];
+			if (fresh(last, writes, now)){
+				if (last.fill_cache == fill_cache){
+					c->idle.erase(c->idle.begin() + i);
+					e = last;
+					break;
+				}
+				continue;
+			}
+			// stale, or pinning tables that may have been compacted away
+			c->idle.erase(c->idle.begin() + i);
+			delete last.it;
+		}
+		if (e.it){
+			c->hits++;
+		}
+		else{
+			leveldb::ReadOptions iterate_options;
+			iterate_options.fill_cache = fill_cache;
+			e.it = db->NewIterator(iterate_options);
+			e.writes = writes;
+			e.ctime = now;
+			e.fill_cache = fill_cache;
+			c->misses++;
+		}
+		if (c->lent.size() >= MAX_LENT){
+			c->lent.erase(c->lent.begin());
+		}
+		c->lent.push_back(e);
+		return e.it;
+	}
+
+	void Iterator_Pool::put(leveldb::Iterator *it){
+		Thread_Cache *c = cache();
+		for (size_t i = 0; i < c->lent.size(); i++){
+			if (c->lent[i].it != it){
+				continue;
+			}
+			Entry e = c->lent[i];
+			c->lent.erase(c->lent.begin() + i);
+			if (c->idle.size() < THREAD_ITERATORS && fresh(e, Binlog_Queue::thread_writes(), now_ms())){
+				c->idle.push_back(e);
+				return;
+			}
+			break;
+		}
+		delete it;
+	}
+
+	std::string Iterator_Pool::stats(){
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		size_t idle = 0;
+		pthread_mutex_lock(&mutex);
+		for (size_t i = 0; i < caches.size(); i++){
+			hits += caches[i]->hits;
+			misses += caches[i]->misses;
+			idle += caches[i]->idle.size();
+		}
+		size_t threads = caches.size();
+		pthread_mutex_unlock(&mutex);
+		std::string s;
+		s.append("    threads  : " + str((uint64_t)threads) + "\n");
+		s.append("    idle     : " + str((uint64_t)idle) + "\n");
+		s.append("    hits     : " + str(hits) + "\n");
+		s.append("    misses   : " + str(misses) + "");
+		return s;
+	}
+
+
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include "pthread.h"
+#include "leveldb/db.h"
+#include "leveldb/iterator.h"
+
+
+namespace lv
+{
+	// per-thread cache of leveldb iterators
+	//
+	// NewIterator pins the current version and builds a merging iterator
+	// over every table, which costs more than a short scan itself. An
+	// iterator released by lv::Iterator is kept by its thread and handed out
+	// again to be re-seeked while it is younger than max_age_ms, so the
+	// writes of the other threads show up in a scan at most max_age_ms
+	// late, and the old tables are never pinned for long. A thread that
+	// began a transaction or wrote since the iterator was created gets a new
+	// one, so it reads its own writes and a clear never sees again the
+	// items it deleted.
+	class Iterator_Pool
+	{
+	public:
+		// idle iterators kept by each thread
+		static const int THREAD_ITERATORS = 4;
+
+		Iterator_Pool(leveldb::DB *db, int max_age_ms);
+		~Iterator_Pool();
+
+		// an unpositioned iterator, Seek() before use
+		leveldb::Iterator* get(bool fill_cache);
+		// give back an iterator from get(), on any thread
+		void put(leveldb::Iterator *it);
+
+		std::string stats();
+
+	private:
+		struct Entry
+		{
+			leveldb::Iterator *it;
+			// Binlog_Queue::thread_writes() of the creating thread
+			uint64_t writes;
+			int64_t ctime;
+			bool fill_cache;
+		};
+
+		struct Thread_Cache
+		{
+			Iterator_Pool *pool;
+			std::vector<Entry> idle;
+			// handed out by get(), to tag them back in put()
+			std::vector<Entry> lent;
+			uint64_t hits;
+			uint64_t misses;
+		};
+
+		leveldb::DB *db;
+		int max_age_ms;
+		pthread_key_t key;
+		pthread_mutex_t mutex;
+		// every thread cache, guarded by mutex
+		std::vector<Thread_Cache*> caches;
+
+		Thread_Cache* cache();
+		bool fresh(const Entry &e, uint64_t writes, int64_t now) const;
+		static void free_cache(void *arg);
+	};
+
+
+}
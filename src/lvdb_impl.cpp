@@ -1,4 +1,5 @@
 #include "lvdb_impl.h"
+#include "sharded_lvdb.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "leveldb/cache.h"
@@ -13,6 +14,7 @@
 
 #include "toolkits/log.h"
 #include "toolkits/util.h"
+#include <algorithm>
 
 namespace
 {
@@ -59,12 +61,34 @@ namespace lv
 	LVDB_Impl::LVDB_Impl(){
 		ldb = NULL;
 		binlogs = NULL;
+		iterators = NULL;
+		sizes = NULL;
+		values = NULL;
+		op_stats = NULL;
+		async_writer = NULL;
+		block_cache = NULL;
 	}
 
 	LVDB_Impl::~LVDB_Impl(){
+		// its queued writes go to the db first
+		if (async_writer){
+			delete async_writer.load();
+		}
+		if (iterators){
+			delete iterators;
+		}
 		if (binlogs){
 			delete binlogs;
 		}
+		if (sizes){
+			delete sizes;
+		}
+		if (values){
+			delete values;
+		}
+		if (op_stats){
+			delete op_stats;
+		}
 		if (ldb){
 			delete ldb;
 		}
@@ -77,11 +101,25 @@ namespace lv
 	}
 
 	LVDB* LVDB::open(const Options &opt){
+		if (opt.shards > 1){
+			return ShardedLVDB::open(opt);
+		}
+		{
+			std::string dir = opt.dir;
+			if (dir.empty() || dir[dir.size() - 1] != '/'){
+				dir.push_back('/');
+			}
+			if (ShardedLVDB::check_shards(dir, 1) == -1){
+				return NULL;
+			}
+		}
 		LVDB_Impl *ssdb = new LVDB_Impl();
+		ssdb->conf = opt;
 		ssdb->options.create_if_missing = true;
 		ssdb->options.max_open_files = opt.max_open_files;
 		ssdb->options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-		ssdb->options.block_cache = leveldb::NewLRUCache(opt.cache_size * 1048576);
+		ssdb->block_cache = new Policy_Cache(leveldb::NewLRUCache(opt.cache_size * 1048576));
+		ssdb->options.block_cache = ssdb->block_cache;
 		ssdb->options.block_size = opt.block_size * 1024;
 		ssdb->options.write_buffer_size = opt.write_buffer_size * 1024 * 1024;
 		//ssdb->options.compaction_speed = opt.compaction_speed;
@@ -98,7 +136,30 @@ namespace lv
 			LOG_ERROR("open db failed: " << status.ToString());
 			goto err;
 		}
-		ssdb->binlogs = new Binlog_Queue(ssdb->ldb, opt.binlog, opt.binlog_capacity);
+		{
+			// the binlog segments live in a sub directory of the db
+			std::string binlog_dir = opt.dir;
+			if (binlog_dir.empty() || binlog_dir[binlog_dir.size() - 1] != '/'){
+				binlog_dir.push_back('/');
+			}
+			binlog_dir.append("binlog/");
+			ssdb->binlogs = new Binlog_Queue(ssdb->ldb, binlog_dir, opt.binlog, opt.binlog_capacity);
+			ssdb->binlogs->inline_value = opt.binlog_inline_value;
+			ssdb->binlogs->group_logs = opt.binlog_group;
+		}
+		if (opt.iterator_max_age > 0){
+			ssdb->iterators = new Iterator_Pool(ssdb->ldb, opt.iterator_max_age);
+		}
+		if (opt.size_cache > 0){
+			ssdb->sizes = new Size_Cache(opt.size_cache);
+			ssdb->binlogs->sizes = ssdb->sizes;
+		}
+		if (opt.value_cache > 0){
+			ssdb->values = new Value_Cache(opt.value_cache * 1048576);
+			ssdb->binlogs->values = ssdb->values;
+		}
+		ssdb->op_stats = new Op_Stats();
+		ssdb->binlogs->op_stats = ssdb->op_stats;
 
 		return ssdb;
 	err:
@@ -115,55 +176,147 @@ namespace lv
 	}
 
 	int LVDB_Impl::flushdb(){
+		Op_Timer timer(op_stats, Op_Stats::FLUSHDB);
 		Transaction trans(binlogs);
+		binlogs->drain();
 		int ret = 0;
-		bool stop = false;
-		while (!stop){
-			leveldb::Iterator *it;
-			leveldb::ReadOptions iterate_options;
-			iterate_options.fill_cache = false;
-			leveldb::WriteOptions write_opts;
+		Read_Scope scope(read_policy(conf.bulk_read_policy));
+		leveldb::ReadOptions iterate_options = scope.options();
+		leveldb::WriteOptions write_opts;
 
-			it = ldb->NewIterator(iterate_options);
-			it->SeekToFirst();
-			for (int i = 0; i < 10000; i++){
-				if (!it->Valid()){
-					stop = true;
-					break;
-				}
+		// one iterator over the whole db, it reads from its own snapshot so
+		// it doesn't have to skip the keys deleted by the previous batches
+		leveldb::Iterator *it = ldb->NewIterator(iterate_options);
+		it->SeekToFirst();
+		while (it->Valid()){
+			leveldb::WriteBatch batch;
+			for (int i = 0; i < SSDB_CLEAR_BATCH && it->Valid(); i++){
 				//log_debug("%s", hexmem(it->key().data(), it->key().size()).c_str());
-				leveldb::Status s = ldb->Delete(write_opts, it->key());
-				if (!s.ok()){
-					LOG_ERROR("del error: " << s.ToString());
-					stop = true;
-					ret = -1;
-					break;
-				}
+				batch.Delete(it->key());
 				it->Next();
 			}
-			delete it;
+			leveldb::Status s = ldb->Write(write_opts, &batch);
+			binlogs->touch();
+			if (!s.ok()){
+				LOG_ERROR("del error: " << s.ToString());
+				ret = -1;
+				break;
+			}
 		}
+		delete it;
 		binlogs->flush();
 		return ret;
 	}
 
 	Iterator* LVDB_Impl::iterator(const std::string &start, const std::string &end, uint64_t limit){
+		Read_Scope scope(read_policy(conf.scan_read_policy));
+		leveldb::ReadOptions iterate_options = scope.options();
 		leveldb::Iterator *it;
-		leveldb::ReadOptions iterate_options;
-		iterate_options.fill_cache = false;
-		it = ldb->NewIterator(iterate_options);
+		if (iterators){
+			it = iterators->get(iterate_options.fill_cache);
+		}
+		else{
+			it = ldb->NewIterator(iterate_options);
+		}
 		it->Seek(start);
 // 		if (it->Valid() && it->key() == start){
 // 			it->Next();
 // 		}
-		return new Iterator(it, end, limit);
+		return new Iterator(it, end, limit, Iterator::FORWARD, iterators, Read_Scope::current());
+	}
+
+	leveldb::Iterator* LVDB_Impl::db_iterator(){
+		Read_Scope scope(read_policy(conf.scan_read_policy));
+		return ldb->NewIterator(scope.options());
+	}
+
+	Iterator* LVDB_Impl::iterator(const std::string &start, const std::string &end, uint64_t limit, const leveldb::Snapshot *snapshot){
+		// only the bulk reads iterate a snapshot
+		Read_Scope scope(read_policy(conf.bulk_read_policy));
+		leveldb::ReadOptions iterate_options = scope.options();
+		iterate_options.snapshot = snapshot;
+		leveldb::Iterator *it = ldb->NewIterator(iterate_options);
+		it->Seek(start);
+		return new Iterator(it, end, limit, Iterator::FORWARD, NULL, Read_Scope::current());
+	}
+
+	const leveldb::Snapshot* LVDB_Impl::get_snapshot(uint64_t *seq){
+		return binlogs->snapshot(seq);
+	}
+
+	void LVDB_Impl::release_snapshot(const leveldb::Snapshot *snapshot){
+		ldb->ReleaseSnapshot(snapshot);
+	}
+
+	// the first 8 bytes of a key as a number, for bisecting the key space
+	static uint64_t key_to_uint64(const std::string &key){
+		uint64_t v = 0;
+		for (size_t i = 0; i < sizeof(v); i++){
+			v = (v << 8) | (i < key.size() ? (uint8_t)key[i] : 0);
+		}
+		return v;
+	}
+
+	static std::string uint64_to_key(uint64_t v){
+		std::string key;
+		for (int i = sizeof(v) - 1; i >= 0; i--){
+			key.push_back((char)((v >> (i * 8)) & 0xff));
+		}
+		while (key.size() > 1 && key[key.size() - 1] == 0){
+			key.resize(key.size() - 1);
+		}
+		return key;
+	}
+
+	void LVDB_Impl::split_range(const std::string &start, const std::string &end, int n, std::vector<std::string> *splits){
+		splits->clear();
+		leveldb::Range range(start, end);
+		uint64_t total;
+		ldb->GetApproximateSizes(&range, 1, &total);
+		uint64_t lo = key_to_uint64(start);
+		uint64_t hi = key_to_uint64(end);
+		for (int i = 1; i < n && lo < hi; i++){
+			uint64_t split;
+			if (total == 0){
+				// all in the memtable, nothing to weigh
+				split = key_to_uint64(start) + (hi - key_to_uint64(start)) / n * i;
+			}
+			else{
+				uint64_t target = total / n * i;
+				uint64_t l = lo, h = hi;
+				while (l < h){
+					uint64_t mid = l + (h - l) / 2;
+					std::string key = uint64_to_key(mid);
+					leveldb::Range r(start, key);
+					uint64_t size;
+					ldb->GetApproximateSizes(&r, 1, &size);
+					if (size < target){
+						l = mid + 1;
+					}
+					else{
+						h = mid;
+					}
+				}
+				split = l;
+			}
+			if (split <= lo || split >= hi){
+				continue;
+			}
+			splits->push_back(uint64_to_key(split));
+			lo = split;
+		}
 	}
 
 	Iterator* LVDB_Impl::rev_iterator(const std::string &start, const std::string &end, uint64_t limit){
+		Read_Scope scope(read_policy(conf.scan_read_policy));
+		leveldb::ReadOptions iterate_options = scope.options();
 		leveldb::Iterator *it;
-		leveldb::ReadOptions iterate_options;
-		iterate_options.fill_cache = false;
-		it = ldb->NewIterator(iterate_options);
+		if (iterators){
+			it = iterators->get(iterate_options.fill_cache);
+		}
+		else{
+			it = ldb->NewIterator(iterate_options);
+		}
 		it->Seek(start);
 		if (!it->Valid()){
 			it->SeekToLast();
@@ -171,14 +324,16 @@ namespace lv
 // 		else{
 // 			it->Prev();
 // 		}
-		return new Iterator(it, end, limit, Iterator::BACKWARD);
+		return new Iterator(it, end, limit, Iterator::BACKWARD, iterators, Read_Scope::current());
 	}
 
 	/* raw operates */
 
 	int LVDB_Impl::raw_set(const Bytes &key, const Bytes &val){
+		Op_Timer timer(op_stats, Op_Stats::RAW_SET);
 		leveldb::WriteOptions write_opts;
 		leveldb::Status s = ldb->Put(write_opts, slice(key), slice(val));
+		binlogs->touch();
 		if (!s.ok()){
 			LOG_ERROR("set error: " << s.ToString());
 			return -1;
@@ -187,8 +342,10 @@ namespace lv
 	}
 
 	int LVDB_Impl::raw_del(const Bytes &key){
+		Op_Timer timer(op_stats, Op_Stats::RAW_DEL);
 		leveldb::WriteOptions write_opts;
 		leveldb::Status s = ldb->Delete(write_opts, slice(key));
+		binlogs->touch();
 		if (!s.ok()){
 			LOG_ERROR("del error: " << s.ToString());
 			return -1;
@@ -197,9 +354,10 @@ namespace lv
 	}
 
 	int LVDB_Impl::raw_get(const Bytes &key, std::string *val){
-		leveldb::ReadOptions opts;
-		opts.fill_cache = false;
-		leveldb::Status s = ldb->Get(opts, slice(key), val);
+		Op_Timer timer(op_stats, Op_Stats::RAW_GET);
+		// the values read by Sync and Copy
+		Read_Scope scope(read_policy(conf.bulk_read_policy));
+		leveldb::Status s = ldb->Get(scope.options(), slice(key), val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -210,6 +368,56 @@ namespace lv
 		return 1;
 	}
 
+	struct Multi_Key_Less{
+		const std::vector<std::string> *keys;
+		bool operator()(size_t a, size_t b) const{
+			return (*keys)[a] < (*keys)[b];
+		}
+	};
+
+	int LVDB_Impl::multi_read(const std::vector<std::string> &keys, Multi_Values *vals){
+		vals->clear();
+		vals->items.resize(keys.size(), std::make_pair((size_t)0, -1));
+
+		// seek in key order so neighbouring keys hit the same cached blocks
+		std::vector<size_t> order(keys.size());
+		for (size_t i = 0; i < order.size(); i++){
+			order[i] = i;
+		}
+		Multi_Key_Less less = { &keys };
+		std::sort(order.begin(), order.end(), less);
+
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		leveldb::ReadOptions opts = scope.options();
+		// taken between groups, so a group half written to ldb is not seen
+		uint64_t seq;
+		opts.snapshot = this->get_snapshot(&seq);
+		int found = 0;
+		std::string val;
+		for (size_t i = 0; i < order.size(); i++){
+			size_t n = order[i];
+			if (i > 0 && keys[n] == keys[order[i - 1]]){
+				vals->items[n] = vals->items[order[i - 1]];
+				found += vals->items[n].second >= 0 ? 1 : 0;
+				continue;
+			}
+			leveldb::Status s = ldb->Get(opts, keys[n], &val);
+			if (s.IsNotFound()){
+				continue;
+			}
+			if (!s.ok()){
+				LOG_ERROR("multi get error: " << s.ToString());
+				found = -1;
+				break;
+			}
+			vals->items[n] = std::make_pair(vals->arena.size(), (int)val.size());
+			vals->arena.append(val);
+			found++;
+		}
+		this->release_snapshot(opts.snapshot);
+		return found;
+	}
+
 	uint64_t LVDB_Impl::size(){
 		std::string s = "A";
 		std::string e(1, 'z' + 1);
@@ -247,15 +455,40 @@ namespace lv
 				info.push_back(val);
 			}
 		}
+		info.push_back("block_cache");
+		info.push_back(block_cache->stats());
+		if (iterators){
+			info.push_back("iterator_pool");
+			info.push_back(iterators->stats());
+		}
+		if (sizes){
+			info.push_back("size_cache");
+			info.push_back(sizes->stats());
+		}
+		if (values){
+			info.push_back("value_cache");
+			info.push_back(values->stats());
+		}
+		info.push_back("binlogs");
+		info.push_back(binlogs->stats());
+		info.push_back("op_stats");
+		info.push_back(op_stats->stats());
+		Async_Writer *writer = async_writer;
+		if (writer){
+			info.push_back("async_writer");
+			info.push_back(writer->stats());
+		}
 
 		return info;
 	}
 
 	void LVDB_Impl::compact(){
+		Op_Timer timer(op_stats, Op_Stats::COMPACT);
 		ldb->CompactRange(NULL, NULL);
 	}
 
 	int LVDB_Impl::key_range(std::vector<std::string> *keys){
+		Op_Timer timer(op_stats, Op_Stats::KEY_RANGE);
 		int ret = 0;
 		std::string kstart, kend;
 		std::string hstart, hend;
@@ -1,7 +1,13 @@
 #pragma once
 
 
+#include "async_writer.h"
 #include "binlog_queue.h"
+#include "iterator_pool.h"
+#include "op_stats.h"
+#include "read_policy.h"
+#include "size_cache.h"
+#include "value_cache.h"
 
 #include "lvdb/lvdb.h"
 #include "lvdb/binlog.h"
@@ -13,6 +19,8 @@
 
 #include "leveldb/db.h"
 #include "leveldb/slice.h"
+#include <mutex>
+#include <set>
 
 
 namespace lv
@@ -32,6 +40,18 @@ namespace lv
 
 	public:
 		Binlog_Queue *binlogs;
+		// NULL when options.iterator_max_age is 0
+		Iterator_Pool *iterators;
+		// NULL when options.size_cache is 0
+		Size_Cache *sizes;
+		// NULL when options.value_cache is 0
+		Value_Cache *values;
+		// latencies and counters of the operates
+		Op_Stats *op_stats;
+		// options.block_cache, counts the lookups of each read policy
+		Policy_Cache *block_cache;
+		// the lvdb options the db was opened with
+		Options conf;
 
 		virtual ~LVDB_Impl();
 
@@ -39,9 +59,33 @@ namespace lv
 
 		virtual int flushdb();
 
+		// policy, one of the conf policies, unless the calling thread set a Read_Hint
+		int read_policy(int policy) const{
+			int hint = Read_Hint::current();
+			return hint == ReadPolicy::DEFAULT ? policy : hint;
+		}
+
 		// return (start, end], not include start
 		virtual Iterator* iterator(const std::string &start, const std::string &end, uint64_t limit);
 		virtual Iterator* rev_iterator(const std::string &start, const std::string &end, uint64_t limit);
+		Iterator* iterator(const std::string &start, const std::string &end, uint64_t limit, const leveldb::Snapshot *snapshot);
+		// an unpositioned leveldb iterator with the scan policy, not pooled
+		leveldb::Iterator* db_iterator();
+
+		// a snapshot of the db and the last binlog seq it includes
+		const leveldb::Snapshot* get_snapshot(uint64_t *seq);
+		void release_snapshot(const leveldb::Snapshot *snapshot);
+		// up to n - 1 keys splitting [start, end) into ranges of about the
+		// same size on disk
+		void split_range(const std::string &start, const std::string &end, int n, std::vector<std::string> *splits);
+		// puts the item of a copied queue at seq, a seq past either end grows
+		// the queue, so shipping an item again overwrites it
+		int qcopy_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type = BinlogType::SYNC);
+		// recount the zrank index of a zset from its items, the caller holds
+		// the stripe of the zset and its commits have been written
+		int zrank_rebuild(const Bytes &name);
+		// zrank/zrange of a zset can't use its index, logged once per zset
+		void zrank_fallback(const Bytes &name);
 
 		//void flushdb();
 		virtual uint64_t size();
@@ -61,6 +105,7 @@ namespace lv
 		virtual int meta_get(const Bytes &key, std::string *val);
 		virtual int meta_del(const Bytes &key);
 		virtual int meta_list(std::vector<std::string> *list);
+		virtual Cdc_Cursor* subscribe(const std::string &name, const Cdc_Filter &filter);
 
 		/* key value */
 
@@ -75,6 +120,7 @@ namespace lv
 		virtual int get_bit(const Bytes &key, int bitoffset);
 
 		virtual int get(const Bytes &key, std::string *val);
+		virtual int multi_get(const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0);
 		virtual int getset(const Bytes &key, std::string *val, const Bytes &newval, char log_type = BinlogType::SYNC);
 		// return (start, end]
 		virtual KIterator* scan(const Bytes &start, const Bytes &end, uint64_t limit);
@@ -86,12 +132,13 @@ namespace lv
 		virtual int hdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC);
 		// -1: error, 1: ok, 0: value is not an integer or out of range
 		virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC);
-		//int multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
-		//int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
+		virtual int multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC);
 
 		virtual int64_t hsize(const Bytes &name);
-		virtual int64_t hclear(const Bytes &name);
+		virtual int64_t hclear(const Bytes &name, char log_type = BinlogType::SYNC);
 		virtual int hget(const Bytes &name, const Bytes &key, std::string *val);
+		virtual int multi_hget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0);
 		virtual int hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 			std::vector<std::string> *list);
 		virtual int hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
@@ -105,14 +152,16 @@ namespace lv
 		virtual int zdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC);
 		// -1: error, 1: ok, 0: value is not an integer or out of range
 		virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC);
-		//int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset=0, char log_type=BinlogType::SYNC);
-		//int multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset=0, char log_type=BinlogType::SYNC);
+		virtual int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC);
 
 		virtual int64_t zsize(const Bytes &name);
+		virtual int64_t zclear(const Bytes &name, char log_type = BinlogType::SYNC);
 		/**
 		 * @return -1: error; 0: not found; 1: found
 		 */
 		virtual int zget(const Bytes &name, const Bytes &key, std::string *score);
+		virtual int multi_zget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *scores, int offset = 0);
 		virtual int64_t zrank(const Bytes &name, const Bytes &key);
 		virtual int64_t zrrank(const Bytes &name, const Bytes &key);
 		virtual ZIterator* zrange(const Bytes &name, uint64_t offset, uint64_t limit);
@@ -132,6 +181,7 @@ namespace lv
 		virtual int64_t zfix(const Bytes &name);
 
 		virtual int64_t qsize(const Bytes &name);
+		virtual int64_t qclear(const Bytes &name, char log_type = BinlogType::SYNC);
 		// @return 0: empty queue, 1: item peeked, -1: error
 		virtual int qfront(const Bytes &name, std::string *item);
 		// @return 0: empty queue, 1: item peeked, -1: error
@@ -153,9 +203,31 @@ namespace lv
 		virtual int qset(const Bytes &name, int64_t index, const Bytes &item, char log_type = BinlogType::SYNC);
 		virtual int qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type = BinlogType::SYNC);
 
+		virtual int async_set(const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_del(const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_incr(const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hset(const Bytes &name, const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zset(const Bytes &name, const Bytes &key, const Bytes &score, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_qpush_front(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_qpush_back(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+
 	private:
+		// read the encoded keys from one snapshot in key order
+		int multi_read(const std::vector<std::string> &keys, Multi_Values *vals);
 		int64_t _qpush(const Bytes &name, const Bytes &item, uint64_t front_or_back_seq, char log_type = BinlogType::SYNC);
 		int _qpop(const Bytes &name, std::string *item, uint64_t front_or_back_seq, char log_type = BinlogType::SYNC);
+		// hands op to the writer, started by the first async write
+		int async_write(Async_Writer::Op *op);
+
+		std::atomic<Async_Writer*> async_writer;
+		std::once_flag async_once;
+		// the zsets logged by zrank_fallback()
+		std::mutex zrank_mutex;
+		std::set<std::string> zrank_fallbacks;
 	};
 
 
@@ -0,0 +1,237 @@
+#include "op_stats.h"
+#include "lvdb/strings.h"
+#include <algorithm>
+#include <chrono>
+
+
+namespace lv
+{
+	static const char *op_names[] = {
+		"flushdb", "compact", "key_range",
+		"raw_set", "raw_del", "raw_get",
+		"meta_set", "meta_get", "meta_del", "meta_list",
+		"set", "setnx", "del", "incr", "multi_set", "multi_del", "set_bit", "get_bit",
+		"get", "multi_get", "getset", "scan", "rscan",
+		"hset", "hdel", "hincr", "multi_hset", "multi_hdel", "hsize", "hclear", "hget",
+		"multi_hget", "hlist", "hrlist", "hscan", "hrscan",
+		"zset", "zdel", "zincr", "multi_zset", "multi_zdel", "zsize", "zclear", "zget",
+		"multi_zget", "zrank", "zrrank", "zrange", "zrrange", "zscan", "zrscan", "zlist",
+		"zrlist", "zfix",
+		"qsize", "qclear", "qfront", "qback", "qpush_front", "qpush_back", "qpop_front",
+		"qpop_back", "qfix", "qlist", "qrlist", "qslice", "qget", "qset", "qset_by_seq",
+	};
+	static_assert(sizeof(op_names) / sizeof(op_names[0]) == Op_Stats::COUNT, "one name for each Op_Stats::Op");
+
+	// nesting of the Op_Timer of the calling thread
+	static thread_local int timer_depth = 0;
+
+	Op_Stats::Op_Stats(){
+		pthread_key_create(&key, &Op_Stats::free_stats);
+		pthread_mutex_init(&mutex, NULL);
+		retired = new_stats(this);
+	}
+
+	Op_Stats::~Op_Stats(){
+		pthread_key_delete(key);
+		pthread_mutex_lock(&mutex);
+		for (size_t i = 0; i < threads.size(); i++){
+			delete threads[i];
+		}
+		threads.clear();
+		pthread_mutex_unlock(&mutex);
+		pthread_mutex_destroy(&mutex);
+		delete retired;
+	}
+
+	int64_t Op_Stats::now_ns(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	Op_Stats::Thread_Stats* Op_Stats::new_stats(Op_Stats *stats){
+		Thread_Stats *t = new Thread_Stats();
+		t->stats = stats;
+		Counter *counters[COUNT + 2];
+		for (int i = 0; i < COUNT; i++){
+			counters[i] = &t->ops[i];
+		}
+		counters[COUNT] = &t->lock_waits;
+		counters[COUNT + 1] = &t->group_writes;
+		for (int i = 0; i < COUNT + 2; i++){
+			counters[i]->calls = 0;
+			counters[i]->ns = 0;
+			for (int j = 0; j < BUCKETS; j++){
+				counters[i]->buckets[j] = 0;
+			}
+		}
+		t->read_bytes = 0;
+		t->written_bytes = 0;
+		return t;
+	}
+
+	void Op_Stats::free_stats(void *arg){
+		Thread_Stats *t = (Thread_Stats *)arg;
+		Op_Stats *stats = t->stats;
+		pthread_mutex_lock(&stats->mutex);
+		stats->threads.erase(std::remove(stats->threads.begin(), stats->threads.end(), t), stats->threads.end());
+		merge(stats->retired, t);
+		pthread_mutex_unlock(&stats->mutex);
+		delete t;
+	}
+
+	Op_Stats::Thread_Stats* Op_Stats::thread_stats(){
+		Thread_Stats *t = (Thread_Stats *)pthread_getspecific(key);
+		if (t == NULL){
+			t = new_stats(this);
+			pthread_setspecific(key, t);
+			pthread_mutex_lock(&mutex);
+			threads.push_back(t);
+			pthread_mutex_unlock(&mutex);
+		}
+		return t;
+	}
+
+	void Op_Stats::add(Counter *c, int64_t ns){
+		if (ns < 0){
+			ns = 0;
+		}
+		uint64_t us = (uint64_t)ns / 1000;
+		int b = 0;
+		while (b < BUCKETS - 1 && us >= ((uint64_t)1 << b)){
+			b++;
+		}
+		// only the owner thread writes, no need for a read-modify-write
+		c->calls.store(c->calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		c->ns.store(c->ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+		c->buckets[b].store(c->buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	void Op_Stats::merge(Thread_Stats *to, const Thread_Stats *from){
+		const Counter *src[COUNT + 2];
+		Counter *dst[COUNT + 2];
+		for (int i = 0; i < COUNT; i++){
+			src[i] = &from->ops[i];
+			dst[i] = &to->ops[i];
+		}
+		src[COUNT] = &from->lock_waits;
+		dst[COUNT] = &to->lock_waits;
+		src[COUNT + 1] = &from->group_writes;
+		dst[COUNT + 1] = &to->group_writes;
+		for (int i = 0; i < COUNT + 2; i++){
+			dst[i]->calls += src[i]->calls.load(std::memory_order_relaxed);
+			dst[i]->ns += src[i]->ns.load(std::memory_order_relaxed);
+			for (int j = 0; j < BUCKETS; j++){
+				dst[i]->buckets[j] += src[i]->buckets[j].load(std::memory_order_relaxed);
+			}
+		}
+		to->read_bytes += from->read_bytes.load(std::memory_order_relaxed);
+		to->written_bytes += from->written_bytes.load(std::memory_order_relaxed);
+	}
+
+	void Op_Stats::record(int op, int64_t ns){
+		add(&thread_stats()->ops[op], ns);
+	}
+
+	void Op_Stats::lock_wait(int64_t ns){
+		add(&thread_stats()->lock_waits, ns);
+	}
+
+	void Op_Stats::group_write(int64_t ns, uint64_t bytes){
+		Thread_Stats *t = thread_stats();
+		add(&t->group_writes, ns);
+		t->written_bytes.store(t->written_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+	}
+
+	void Op_Stats::bytes_read(uint64_t bytes){
+		Thread_Stats *t = thread_stats();
+		t->read_bytes.store(t->read_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+	}
+
+	// upper bound in us of the bucket holding the p-th latency
+	static uint64_t percentile(const uint64_t *buckets, int n, uint64_t calls, double p){
+		uint64_t rank = (uint64_t)(calls * p);
+		uint64_t seen = 0;
+		for (int i = 0; i < n; i++){
+			seen += buckets[i];
+			if (seen > rank){
+				return (uint64_t)1 << i;
+			}
+		}
+		return (uint64_t)1 << (n - 1);
+	}
+
+	static std::string format(const char *name, uint64_t calls, uint64_t ns, const uint64_t *buckets, int n){
+		std::string s = "    ";
+		s.append(name);
+		if (s.size() < 17){
+			s.append(17 - s.size(), ' ');
+		}
+		s.append(": calls " + str(calls));
+		s.append(", avg " + str(calls ? ns / calls / 1000 : (uint64_t)0) + "us");
+		s.append(", p50 " + str(percentile(buckets, n, calls, 0.5)) + "us");
+		s.append(", p99 " + str(percentile(buckets, n, calls, 0.99)) + "us");
+		s.append(", p999 " + str(percentile(buckets, n, calls, 0.999)) + "us");
+		return s;
+	}
+
+	std::string Op_Stats::stats(){
+		Thread_Stats *sum = new_stats(this);
+		pthread_mutex_lock(&mutex);
+		merge(sum, retired);
+		for (size_t i = 0; i < threads.size(); i++){
+			merge(sum, threads[i]);
+		}
+		pthread_mutex_unlock(&mutex);
+
+		std::vector<std::string> lines;
+		const Counter *counters[COUNT + 2];
+		const char *names[COUNT + 2];
+		for (int i = 0; i < COUNT; i++){
+			counters[i] = &sum->ops[i];
+			names[i] = op_names[i];
+		}
+		counters[COUNT] = &sum->lock_waits;
+		names[COUNT] = "lock_wait";
+		counters[COUNT + 1] = &sum->group_writes;
+		names[COUNT + 1] = "group_write";
+		for (int i = 0; i < COUNT + 2; i++){
+			uint64_t calls = counters[i]->calls;
+			if (calls == 0){
+				continue;
+			}
+			uint64_t buckets[BUCKETS];
+			for (int j = 0; j < BUCKETS; j++){
+				buckets[j] = counters[i]->buckets[j];
+			}
+			lines.push_back(format(names[i], calls, counters[i]->ns, buckets, BUCKETS));
+		}
+		lines.push_back("    bytes_read   : " + str((uint64_t)sum->read_bytes));
+		lines.push_back("    bytes_written: " + str((uint64_t)sum->written_bytes));
+		delete sum;
+
+		std::string s;
+		for (size_t i = 0; i < lines.size(); i++){
+			if (i > 0){
+				s.append("\n");
+			}
+			s.append(lines[i]);
+		}
+		return s;
+	}
+
+	Op_Timer::Op_Timer(Op_Stats *stats, int op){
+		// only the outermost operate of the thread is timed
+		this->stats = (timer_depth++ == 0) ? stats : NULL;
+		this->op = op;
+		this->start = this->stats ? Op_Stats::now_ns() : 0;
+	}
+
+	Op_Timer::~Op_Timer(){
+		timer_depth--;
+		if (stats){
+			stats->record(op, Op_Stats::now_ns() - start);
+		}
+	}
+
+
+}
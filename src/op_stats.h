@@ -0,0 +1,100 @@
+#pragma once
+
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "pthread.h"
+
+
+namespace lv
+{
+	// call counters and latency histograms of the LVDB operates
+	//
+	// Each thread counts in a block of its own, written with relaxed atomics
+	// and only summed up by stats(), so recording takes no lock. Latencies
+	// go to log2 buckets of microseconds, the percentiles are the upper
+	// bound of the bucket they fall in.
+	class Op_Stats
+	{
+	public:
+		enum Op{
+			FLUSHDB, COMPACT, KEY_RANGE,
+			RAW_SET, RAW_DEL, RAW_GET,
+			META_SET, META_GET, META_DEL, META_LIST,
+			SET, SETNX, DEL, INCR, MULTI_SET, MULTI_DEL, SET_BIT, GET_BIT,
+			GET, MULTI_GET, GETSET, SCAN, RSCAN,
+			HSET, HDEL, HINCR, MULTI_HSET, MULTI_HDEL, HSIZE, HCLEAR, HGET,
+			MULTI_HGET, HLIST, HRLIST, HSCAN, HRSCAN,
+			ZSET, ZDEL, ZINCR, MULTI_ZSET, MULTI_ZDEL, ZSIZE, ZCLEAR, ZGET,
+			MULTI_ZGET, ZRANK, ZRRANK, ZRANGE, ZRRANGE, ZSCAN, ZRSCAN, ZLIST,
+			ZRLIST, ZFIX,
+			QSIZE, QCLEAR, QFRONT, QBACK, QPUSH_FRONT, QPUSH_BACK, QPOP_FRONT,
+			QPOP_BACK, QFIX, QLIST, QRLIST, QSLICE, QGET, QSET, QSET_BY_SEQ,
+			COUNT
+		};
+		// bucket i counts the latencies under 2^i us, the last one the rest
+		static const int BUCKETS = 24;
+
+		Op_Stats();
+		~Op_Stats();
+
+		void record(int op, int64_t ns);
+		// transactions waiting for their lock stripes
+		void lock_wait(int64_t ns);
+		// groups written to leveldb and their binlogs
+		void group_write(int64_t ns, uint64_t bytes);
+		void bytes_read(uint64_t bytes);
+
+		static int64_t now_ns();
+		std::string stats();
+
+	private:
+		struct Counter
+		{
+			std::atomic<uint64_t> calls;
+			std::atomic<uint64_t> ns;
+			std::atomic<uint64_t> buckets[BUCKETS];
+		};
+
+		struct Thread_Stats
+		{
+			Op_Stats *stats;
+			Counter ops[COUNT];
+			Counter lock_waits;
+			Counter group_writes;
+			std::atomic<uint64_t> read_bytes;
+			std::atomic<uint64_t> written_bytes;
+		};
+
+		pthread_key_t key;
+		pthread_mutex_t mutex;
+		// every thread block, guarded by mutex
+		std::vector<Thread_Stats*> threads;
+		// the counts of the threads gone, guarded by mutex
+		Thread_Stats *retired;
+
+		Thread_Stats* thread_stats();
+		static Thread_Stats* new_stats(Op_Stats *stats);
+		static void add(Counter *c, int64_t ns);
+		static void merge(Thread_Stats *to, const Thread_Stats *from);
+		static void free_stats(void *arg);
+	};
+
+
+	// times the operate of its scope, the operates it calls are only
+	// counted as part of it
+	class Op_Timer
+	{
+	public:
+		Op_Timer(Op_Stats *stats, int op);
+		~Op_Timer();
+
+	private:
+		Op_Stats *stats;
+		int op;
+		int64_t start;
+	};
+
+
+}
@@ -32,6 +32,20 @@ namespace
 		return false;
 	}
 
+	void update_policy(const YAML::Node& node, const std::string& subkey, int& policy)
+	{
+		std::string s;
+		if (!update_vaule<std::string>(node, "read_policy", subkey, s)) {
+			return;
+		}
+		if (s == "cache") {
+			policy = lv::ReadPolicy::CACHE;
+		}
+		else if (s == "no_cache") {
+			policy = lv::ReadPolicy::NO_CACHE;
+		}
+	}
+
 	void load_value(lv::Options& opt, const YAML::Node& root) {
 		if (!root.IsDefined())
 			return;
@@ -44,9 +58,23 @@ namespace
 		update_vaule<bool>(root, "compression", opt.compression);
 		update_vaule<bool>(root, "replication", "binlog", opt.binlog);
 		update_vaule<size_t>(root, "replication", "capacity", opt.binlog_capacity);
+		update_vaule<size_t>(root, "replication", "inline_value", opt.binlog_inline_value);
+		update_vaule<bool>(root, "replication", "group", opt.binlog_group);
+		update_vaule<bool>(root, "zset_rank_index", opt.zset_rank_index);
+		update_vaule<int>(root, "iterator_max_age", opt.iterator_max_age);
+		update_vaule<int>(root, "size_cache", opt.size_cache);
+		update_vaule<size_t>(root, "value_cache", opt.value_cache);
+		update_vaule<size_t>(root, "async_queue", opt.async_queue);
+		update_policy(root, "point", opt.point_read_policy);
+		update_policy(root, "scan", opt.scan_read_policy);
+		update_policy(root, "bulk", opt.bulk_read_policy);
+		update_vaule<int>(root, "shards", opt.shards);
 		if (opt.binlog_capacity <= 0){
 			opt.binlog_capacity = lv::Options::LOG_QUEUE_SIZE;
 		}
+		if (opt.shards <= 0){
+			opt.shards = 1;
+		}
 		if (opt.cache_size <= 0){
 			opt.cache_size = 16;
 		}
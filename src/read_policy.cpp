@@ -0,0 +1,111 @@
+#include "read_policy.h"
+#include "lvdb/lvdb.h"
+#include "lvdb/strings.h"
+
+
+namespace lv
+{
+	static thread_local int hint_policy = ReadPolicy::DEFAULT;
+	static thread_local int scope_policy = ReadPolicy::DEFAULT;
+
+	Read_Hint::Read_Hint(int policy){
+		this->prev = hint_policy;
+		hint_policy = policy;
+	}
+
+	Read_Hint::~Read_Hint(){
+		hint_policy = prev;
+	}
+
+	int Read_Hint::current(){
+		return hint_policy;
+	}
+
+	Read_Scope::Read_Scope(int policy){
+		this->policy = policy;
+		this->prev = scope_policy;
+		scope_policy = policy;
+	}
+
+	Read_Scope::~Read_Scope(){
+		scope_policy = prev;
+	}
+
+	int Read_Scope::current(){
+		return scope_policy;
+	}
+
+	static int policy_index(int policy){
+		if (policy < 0 || policy >= ReadPolicy::COUNT){
+			return ReadPolicy::COUNT;
+		}
+		return policy;
+	}
+
+	Policy_Cache::Policy_Cache(leveldb::Cache *cache){
+		this->cache = cache;
+		for (int i = 0; i <= ReadPolicy::COUNT; i++){
+			hits[i] = 0;
+			misses[i] = 0;
+		}
+	}
+
+	Policy_Cache::~Policy_Cache(){
+		delete cache;
+	}
+
+	leveldb::Cache::Handle* Policy_Cache::Insert(const leveldb::Slice& key, void* value, size_t charge,
+		void(*deleter)(const leveldb::Slice& key, void* value)){
+		return cache->Insert(key, value, charge, deleter);
+	}
+
+	leveldb::Cache::Handle* Policy_Cache::Lookup(const leveldb::Slice& key){
+		Handle *h = cache->Lookup(key);
+		int i = policy_index(scope_policy);
+		if (h){
+			hits[i]++;
+		}
+		else{
+			misses[i]++;
+		}
+		return h;
+	}
+
+	void Policy_Cache::Release(Handle* handle){
+		cache->Release(handle);
+	}
+
+	void* Policy_Cache::Value(Handle* handle){
+		return cache->Value(handle);
+	}
+
+	void Policy_Cache::Erase(const leveldb::Slice& key){
+		cache->Erase(key);
+	}
+
+	uint64_t Policy_Cache::NewId(){
+		return cache->NewId();
+	}
+
+	void Policy_Cache::Prune(){
+		cache->Prune();
+	}
+
+	size_t Policy_Cache::TotalCharge() const{
+		return cache->TotalCharge();
+	}
+
+	std::string Policy_Cache::stats() const{
+		static const char *names[ReadPolicy::COUNT + 1] = { "cache   ", "no_cache", "internal" };
+		std::string s;
+		for (int i = 0; i <= ReadPolicy::COUNT; i++){
+			if (i > 0){
+				s.append("\n");
+			}
+			s.append("    " + std::string(names[i]) + " : hits " + str((uint64_t)hits[i]) + ", misses " + str((uint64_t)misses[i]));
+		}
+		return s;
+	}
+
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+
+#include <atomic>
+#include <string>
+#include "leveldb/cache.h"
+#include "leveldb/options.h"
+#include "lvdb/const.h"
+
+
+namespace lv
+{
+	// the policy of the leveldb reads made by the calling thread while it
+	// is alive, the block cache lookups of those reads are counted for it
+	class Read_Scope
+	{
+	public:
+		Read_Scope(int policy);
+		~Read_Scope();
+
+		leveldb::ReadOptions options() const{
+			leveldb::ReadOptions opts;
+			opts.fill_cache = (policy != ReadPolicy::NO_CACHE);
+			return opts;
+		}
+
+		// ReadPolicy::DEFAULT outside of any scope
+		static int current();
+
+	private:
+		int policy;
+		int prev;
+	};
+
+
+	// block cache counting the hits and misses of each read policy, the
+	// reads made outside of a Read_Scope are counted as internal
+	class Policy_Cache : public leveldb::Cache
+	{
+	public:
+		// takes the ownership of cache
+		Policy_Cache(leveldb::Cache *cache);
+		virtual ~Policy_Cache();
+
+		virtual Handle* Insert(const leveldb::Slice& key, void* value, size_t charge,
+			void(*deleter)(const leveldb::Slice& key, void* value));
+		virtual Handle* Lookup(const leveldb::Slice& key);
+		virtual void Release(Handle* handle);
+		virtual void* Value(Handle* handle);
+		virtual void Erase(const leveldb::Slice& key);
+		virtual uint64_t NewId();
+		virtual void Prune();
+		virtual size_t TotalCharge() const;
+
+		std::string stats() const;
+
+	private:
+		leveldb::Cache *cache;
+		// indexed by policy, ReadPolicy::COUNT for the internal reads
+		std::atomic<uint64_t> hits[ReadPolicy::COUNT + 1];
+		std::atomic<uint64_t> misses[ReadPolicy::COUNT + 1];
+	};
+
+
+}
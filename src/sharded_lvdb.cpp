@@ -0,0 +1,802 @@
+#include "sharded_lvdb.h"
+#include "leveldb/env.h"
+#include "lvdb/strings.h"
+#include "toolkits/log.h"
+#include "toolkits/util.h"
+#include <algorithm>
+#include <functional>
+
+
+namespace lv
+{
+	// merges the sorted iterators of the shards, like leveldb does with the
+	// tables of one db. moving back after moving forward (or the reverse)
+	// re-seeks every other iterator around the current key
+	class Merging_Iterator : public leveldb::Iterator
+	{
+	public:
+		Merging_Iterator(const std::vector<leveldb::Iterator*> &children){
+			this->children = children;
+			this->current = NULL;
+			this->forward = true;
+		}
+
+		virtual ~Merging_Iterator(){
+			for (size_t i = 0; i < children.size(); i++){
+				delete children[i];
+			}
+		}
+
+		virtual bool Valid() const{
+			return current != NULL;
+		}
+
+		virtual void SeekToFirst(){
+			for (size_t i = 0; i < children.size(); i++){
+				children[i]->SeekToFirst();
+			}
+			find_smallest();
+			forward = true;
+		}
+
+		virtual void SeekToLast(){
+			for (size_t i = 0; i < children.size(); i++){
+				children[i]->SeekToLast();
+			}
+			find_largest();
+			forward = false;
+		}
+
+		virtual void Seek(const leveldb::Slice& target){
+			for (size_t i = 0; i < children.size(); i++){
+				children[i]->Seek(target);
+			}
+			find_smallest();
+			forward = true;
+		}
+
+		virtual void Next(){
+			if (!forward){
+				// the other iterators are before key(), move them after it
+				for (size_t i = 0; i < children.size(); i++){
+					leveldb::Iterator *child = children[i];
+					if (child == current){
+						continue;
+					}
+					child->Seek(key());
+					if (child->Valid() && child->key().compare(key()) == 0){
+						child->Next();
+					}
+				}
+				forward = true;
+			}
+			current->Next();
+			find_smallest();
+		}
+
+		virtual void Prev(){
+			if (forward){
+				// the other iterators are after key(), move them before it
+				for (size_t i = 0; i < children.size(); i++){
+					leveldb::Iterator *child = children[i];
+					if (child == current){
+						continue;
+					}
+					child->Seek(key());
+					if (child->Valid()){
+						child->Prev();
+					}
+					else{
+						child->SeekToLast();
+					}
+				}
+				forward = false;
+			}
+			current->Prev();
+			find_largest();
+		}
+
+		virtual leveldb::Slice key() const{
+			return current->key();
+		}
+
+		virtual leveldb::Slice value() const{
+			return current->value();
+		}
+
+		virtual leveldb::Status status() const{
+			for (size_t i = 0; i < children.size(); i++){
+				leveldb::Status s = children[i]->status();
+				if (!s.ok()){
+					return s;
+				}
+			}
+			return leveldb::Status();
+		}
+
+	private:
+		std::vector<leveldb::Iterator*> children;
+		leveldb::Iterator *current;
+		bool forward;
+
+		void find_smallest(){
+			current = NULL;
+			for (size_t i = 0; i < children.size(); i++){
+				if (children[i]->Valid() && (current == NULL || children[i]->key().compare(current->key()) < 0)){
+					current = children[i];
+				}
+			}
+		}
+
+		void find_largest(){
+			current = NULL;
+			for (size_t i = 0; i < children.size(); i++){
+				if (children[i]->Valid() && (current == NULL || children[i]->key().compare(current->key()) > 0)){
+					current = children[i];
+				}
+			}
+		}
+	};
+
+
+	int ShardedLVDB::check_shards(const std::string &dir, int shards){
+		leveldb::Env *env = leveldb::Env::Default();
+		std::string path = dir + "SHARDS";
+		std::string buf;
+		if (env->FileExists(path)){
+			leveldb::Status s = leveldb::ReadFileToString(env, path, &buf);
+			if (!s.ok()){
+				LOG_ERROR("read " << path << " error: " << s.ToString());
+				return -1;
+			}
+			int count = str_to_int(buf);
+			if (count != shards){
+				LOG_ERROR(dir << " holds " << count << " shards, can't open it with " << shards);
+				return -1;
+			}
+			return 0;
+		}
+
+		// the dirs sharded before the count was kept
+		std::vector<std::string> names;
+		env->GetChildren(dir, &names);
+		int count = 0;
+		while (std::find(names.begin(), names.end(), "shard" + str(count)) != names.end()){
+			count++;
+		}
+		if (count == 0 && shards == 1){
+			return 0;
+		}
+		if (count > 0 && count != shards){
+			LOG_ERROR(dir << " holds " << count << " shards, can't open it with " << shards);
+			return -1;
+		}
+		// a db opened unsharded has its leveldb files in dir itself
+		if (count == 0 && env->FileExists(dir + "CURRENT")){
+			LOG_ERROR(dir << " holds an unsharded db, can't open it with " << shards << " shards");
+			return -1;
+		}
+		leveldb::Status s = leveldb::WriteStringToFile(env, str(shards), path);
+		if (!s.ok()){
+			LOG_ERROR("write " << path << " error: " << s.ToString());
+			return -1;
+		}
+		return 0;
+	}
+
+	LVDB* ShardedLVDB::open(const Options &opt){
+		std::string dir = opt.dir;
+		if (dir.empty() || dir[dir.size() - 1] != '/'){
+			dir.push_back('/');
+		}
+		toolkit::ensure_dir(dir.c_str());
+		if (check_shards(dir, opt.shards) == -1){
+			return NULL;
+		}
+		ShardedLVDB *db = new ShardedLVDB();
+		for (int i = 0; i < opt.shards; i++){
+			Options shard_opt = opt;
+			shard_opt.shards = 1;
+			shard_opt.dir = dir + "shard" + str(i) + "/";
+			// the shards share the configured cache sizes
+			shard_opt.cache_size = std::max<size_t>(opt.cache_size / opt.shards, 1);
+			if (opt.size_cache > 0){
+				shard_opt.size_cache = std::max(opt.size_cache / opt.shards, 1);
+			}
+			if (opt.value_cache > 0){
+				shard_opt.value_cache = std::max<size_t>(opt.value_cache / opt.shards, 1);
+			}
+			LVDB *shard = LVDB::open(shard_opt);
+			if (shard == NULL){
+				LOG_ERROR("open shard " << i << " failed");
+				delete db;
+				return NULL;
+			}
+			db->dbs.push_back((LVDB_Impl *)shard);
+		}
+		return db;
+	}
+
+	ShardedLVDB::~ShardedLVDB(){
+		for (size_t i = 0; i < dbs.size(); i++){
+			dbs[i]->release();
+		}
+	}
+
+	int ShardedLVDB::release()
+	{
+		delete this;
+		return 0;
+	}
+
+	size_t ShardedLVDB::index_of(const Bytes &name) const{
+		// FNV-1a, the shard of a name must not change between versions
+		uint32_t h = 2166136261u;
+		for (int i = 0; i < name.size(); i++){
+			h ^= (uint8_t)name.data()[i];
+			h *= 16777619u;
+		}
+		return h % dbs.size();
+	}
+
+	LVDB_Impl* ShardedLVDB::db_of_raw(const Bytes &key) const{
+		if (key.empty()){
+			return dbs[0];
+		}
+		const char *p = key.data() + 1;
+		int size = key.size() - 1;
+		switch (key.data()[0]){
+		case DataType::KV:
+		case DataType::HSIZE:
+		case DataType::ZSIZE:
+		case DataType::QSIZE:
+			return db_of(Bytes(p, size));
+		case DataType::HASH:
+		case DataType::ZSET:
+		case DataType::ZSCORE:
+		case DataType::ZRANK:
+		case DataType::QUEUE:
+			if (size < 1 || size - 1 < (uint8_t)p[0]){
+				return dbs[0];
+			}
+			return db_of(Bytes(p + 1, (uint8_t)p[0]));
+		default:
+			return dbs[0];
+		}
+	}
+
+	leveldb::Iterator* ShardedLVDB::merged_iterator(){
+		std::vector<leveldb::Iterator*> children;
+		for (size_t i = 0; i < dbs.size(); i++){
+			children.push_back(dbs[i]->db_iterator());
+		}
+		return new Merging_Iterator(children);
+	}
+
+	int ShardedLVDB::merge_lists(int(LVDB::*f)(const Bytes&, const Bytes&, uint64_t, std::vector<std::string>*),
+		bool reverse, const Bytes &name_s, const Bytes &name_e, uint64_t limit, std::vector<std::string> *list){
+		std::vector<std::string> names;
+		for (size_t i = 0; i < dbs.size(); i++){
+			if ((dbs[i]->*f)(name_s, name_e, limit, &names) == -1){
+				return -1;
+			}
+		}
+		if (reverse){
+			std::sort(names.begin(), names.end(), std::greater<std::string>());
+		}
+		else{
+			std::sort(names.begin(), names.end());
+		}
+		if (names.size() > limit){
+			names.resize(limit);
+		}
+		list->insert(list->end(), names.begin(), names.end());
+		return 0;
+	}
+
+	int ShardedLVDB::flushdb(){
+		int ret = 0;
+		for (size_t i = 0; i < dbs.size(); i++){
+			if (dbs[i]->flushdb() == -1){
+				ret = -1;
+			}
+		}
+		return ret;
+	}
+
+	Iterator* ShardedLVDB::iterator(const std::string &start, const std::string &end, uint64_t limit){
+		Read_Scope scope(dbs[0]->read_policy(dbs[0]->conf.scan_read_policy));
+		leveldb::Iterator *it = merged_iterator();
+		it->Seek(start);
+		return new Iterator(it, end, limit, Iterator::FORWARD, NULL, Read_Scope::current());
+	}
+
+	Iterator* ShardedLVDB::rev_iterator(const std::string &start, const std::string &end, uint64_t limit){
+		Read_Scope scope(dbs[0]->read_policy(dbs[0]->conf.scan_read_policy));
+		leveldb::Iterator *it = merged_iterator();
+		it->Seek(start);
+		if (!it->Valid()){
+			it->SeekToLast();
+		}
+		return new Iterator(it, end, limit, Iterator::BACKWARD, NULL, Read_Scope::current());
+	}
+
+	uint64_t ShardedLVDB::size(){
+		uint64_t size = 0;
+		for (size_t i = 0; i < dbs.size(); i++){
+			size += dbs[i]->size();
+		}
+		return size;
+	}
+
+	std::vector<std::string> ShardedLVDB::info(){
+		std::vector<std::string> info;
+		for (size_t i = 0; i < dbs.size(); i++){
+			std::vector<std::string> shard = dbs[i]->info();
+			for (size_t j = 0; j + 1 < shard.size(); j += 2){
+				info.push_back("shard" + str((uint64_t)i) + "." + shard[j]);
+				info.push_back(shard[j + 1]);
+			}
+		}
+		return info;
+	}
+
+	void ShardedLVDB::compact(){
+		for (size_t i = 0; i < dbs.size(); i++){
+			dbs[i]->compact();
+		}
+	}
+
+	int ShardedLVDB::key_range(std::vector<std::string> *keys){
+		// pairs of first and last key of each data type, empty when none
+		std::vector<std::string> range;
+		for (size_t i = 0; i < dbs.size(); i++){
+			std::vector<std::string> shard;
+			if (dbs[i]->key_range(&shard) == -1){
+				return -1;
+			}
+			if (range.empty()){
+				range = shard;
+				continue;
+			}
+			for (size_t j = 0; j + 1 < shard.size() && j + 1 < range.size(); j += 2){
+				if (!shard[j].empty() && (range[j].empty() || shard[j] < range[j])){
+					range[j] = shard[j];
+				}
+				if (shard[j + 1] > range[j + 1]){
+					range[j + 1] = shard[j + 1];
+				}
+			}
+		}
+		keys->insert(keys->end(), range.begin(), range.end());
+		return 0;
+	}
+
+	/* raw operates */
+
+	int ShardedLVDB::raw_set(const Bytes &key, const Bytes &val){
+		return db_of_raw(key)->raw_set(key, val);
+	}
+
+	int ShardedLVDB::raw_del(const Bytes &key){
+		return db_of_raw(key)->raw_del(key);
+	}
+
+	int ShardedLVDB::raw_get(const Bytes &key, std::string *val){
+		return db_of_raw(key)->raw_get(key, val);
+	}
+
+	/* meta operates */
+
+	int ShardedLVDB::meta_set(const Bytes &key, const Bytes &val){
+		return dbs[0]->meta_set(key, val);
+	}
+
+	int ShardedLVDB::meta_get(const Bytes &key, std::string *val){
+		return dbs[0]->meta_get(key, val);
+	}
+
+	int ShardedLVDB::meta_del(const Bytes &key){
+		return dbs[0]->meta_del(key);
+	}
+
+	int ShardedLVDB::meta_list(std::vector<std::string> *list){
+		return dbs[0]->meta_list(list);
+	}
+
+	Cdc_Cursor* ShardedLVDB::subscribe(const std::string &name, const Cdc_Filter &filter){
+		// the seqs of the shards are unrelated, subscribe to each shard
+		LOG_ERROR(name << " can't subscribe to a db of " << dbs.size() << " shards, subscribe to each shard(i)");
+		return NULL;
+	}
+
+	/* key value */
+
+	int ShardedLVDB::set(const Bytes &key, const Bytes &val, char log_type){
+		return db_of(key)->set(key, val, log_type);
+	}
+
+	int ShardedLVDB::setnx(const Bytes &key, const Bytes &val, char log_type){
+		return db_of(key)->setnx(key, val, log_type);
+	}
+
+	int ShardedLVDB::del(const Bytes &key, char log_type){
+		return db_of(key)->del(key, log_type);
+	}
+
+	int ShardedLVDB::incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type){
+		return db_of(key)->incr(key, by, new_val, log_type);
+	}
+
+	int ShardedLVDB::multi_set(const std::vector<Bytes> &kvs, int offset, char log_type){
+		// one transaction per shard, the pairs keep their order in each of them
+		std::vector<std::vector<Bytes> > parts(dbs.size());
+		for (size_t i = offset; i + 1 < kvs.size(); i += 2){
+			// rejected before any shard is written, as a single db does
+			if (kvs[i].empty()){
+				LOG_INFO("empty key!");
+				return 0;
+			}
+			std::vector<Bytes> &part = parts[index_of(kvs[i])];
+			part.push_back(kvs[i]);
+			part.push_back(kvs[i + 1]);
+		}
+		int count = 0;
+		for (size_t i = 0; i < dbs.size(); i++){
+			if (parts[i].empty()){
+				continue;
+			}
+			int ret = dbs[i]->multi_set(parts[i], 0, log_type);
+			if (ret == -1){
+				// the shards before stay written, see LVDB::multi_set()
+				if (count > 0){
+					LOG_ERROR("multi_set stopped at shard " << i << ", " << count << " keys written");
+				}
+				return count > 0 ? count : -1;
+			}
+			count += ret;
+		}
+		return count;
+	}
+
+	int ShardedLVDB::multi_del(const std::vector<Bytes> &keys, int offset, char log_type){
+		std::vector<std::vector<Bytes> > parts(dbs.size());
+		for (size_t i = offset; i < keys.size(); i++){
+			parts[index_of(keys[i])].push_back(keys[i]);
+		}
+		int count = 0;
+		for (size_t i = 0; i < dbs.size(); i++){
+			if (parts[i].empty()){
+				continue;
+			}
+			int ret = dbs[i]->multi_del(parts[i], 0, log_type);
+			if (ret == -1){
+				if (count > 0){
+					LOG_ERROR("multi_del stopped at shard " << i << ", " << count << " keys deleted");
+				}
+				return count > 0 ? count : -1;
+			}
+			count += ret;
+		}
+		return count;
+	}
+
+	int ShardedLVDB::set_bit(const Bytes &key, int bitoffset, int on, char log_type){
+		return db_of(key)->set_bit(key, bitoffset, on, log_type);
+	}
+
+	int ShardedLVDB::get_bit(const Bytes &key, int bitoffset){
+		return db_of(key)->get_bit(key, bitoffset);
+	}
+
+	int ShardedLVDB::get(const Bytes &key, std::string *val){
+		return db_of(key)->get(key, val);
+	}
+
+	int ShardedLVDB::multi_get(const std::vector<Bytes> &keys, Multi_Values *vals, int offset){
+		// each shard reads its keys from its own snapshot
+		std::vector<std::vector<Bytes> > parts(dbs.size());
+		std::vector<std::vector<size_t> > index(dbs.size());
+		for (size_t i = offset; i < keys.size(); i++){
+			size_t n = index_of(keys[i]);
+			parts[n].push_back(keys[i]);
+			index[n].push_back(i - offset);
+		}
+		vals->clear();
+		vals->items.resize(keys.size() - offset, std::make_pair((size_t)0, -1));
+		int found = 0;
+		Multi_Values part;
+		for (size_t i = 0; i < dbs.size(); i++){
+			if (parts[i].empty()){
+				continue;
+			}
+			int ret = dbs[i]->multi_get(parts[i], &part);
+			if (ret == -1){
+				return -1;
+			}
+			found += ret;
+			for (size_t j = 0; j < part.size(); j++){
+				if (!part.found(j)){
+					continue;
+				}
+				Bytes v = part.value(j);
+				vals->items[index[i][j]] = std::make_pair(vals->arena.size(), v.size());
+				vals->arena.append(v.data(), v.size());
+			}
+		}
+		return found;
+	}
+
+	int ShardedLVDB::getset(const Bytes &key, std::string *val, const Bytes &newval, char log_type){
+		return db_of(key)->getset(key, val, newval, log_type);
+	}
+
+	KIterator* ShardedLVDB::scan(const Bytes &start, const Bytes &end, uint64_t limit){
+		std::string key_start, key_end;
+		key_start = encode_kv_key(start);
+		if (!end.empty()){
+			key_end = encode_kv_key(end);
+		}
+		return new KIterator(this->iterator(key_start, key_end, limit));
+	}
+
+	KIterator* ShardedLVDB::rscan(const Bytes &start, const Bytes &end, uint64_t limit){
+		std::string key_start, key_end;
+		key_start = encode_kv_key(start);
+		if (start.empty()){
+			key_start.append(1, 255);
+		}
+		if (!end.empty()){
+			key_end = encode_kv_key(end);
+		}
+		return new KIterator(this->rev_iterator(key_start, key_end, limit));
+	}
+
+	/* hash */
+
+	int ShardedLVDB::hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type){
+		return db_of(name)->hset(name, key, val, log_type);
+	}
+
+	int ShardedLVDB::hdel(const Bytes &name, const Bytes &key, char log_type){
+		return db_of(name)->hdel(name, key, log_type);
+	}
+
+	int ShardedLVDB::hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
+		return db_of(name)->hincr(name, key, by, new_val, log_type);
+	}
+
+	int ShardedLVDB::multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset, char log_type){
+		return db_of(name)->multi_hset(name, kvs, offset, log_type);
+	}
+
+	int ShardedLVDB::multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset, char log_type){
+		return db_of(name)->multi_hdel(name, keys, offset, log_type);
+	}
+
+	int64_t ShardedLVDB::hsize(const Bytes &name){
+		return db_of(name)->hsize(name);
+	}
+
+	int64_t ShardedLVDB::hclear(const Bytes &name, char log_type){
+		return db_of(name)->hclear(name, log_type);
+	}
+
+	int ShardedLVDB::hget(const Bytes &name, const Bytes &key, std::string *val){
+		return db_of(name)->hget(name, key, val);
+	}
+
+	int ShardedLVDB::multi_hget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *vals, int offset){
+		return db_of(name)->multi_hget(name, keys, vals, offset);
+	}
+
+	int ShardedLVDB::hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::hlist, false, name_s, name_e, limit, list);
+	}
+
+	int ShardedLVDB::hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::hrlist, true, name_s, name_e, limit, list);
+	}
+
+	HIterator* ShardedLVDB::hscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
+		return db_of(name)->hscan(name, start, end, limit);
+	}
+
+	HIterator* ShardedLVDB::hrscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
+		return db_of(name)->hrscan(name, start, end, limit);
+	}
+
+	/* zset */
+
+	int ShardedLVDB::zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type){
+		return db_of(name)->zset(name, key, score, log_type);
+	}
+
+	int ShardedLVDB::zdel(const Bytes &name, const Bytes &key, char log_type){
+		return db_of(name)->zdel(name, key, log_type);
+	}
+
+	int ShardedLVDB::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
+		return db_of(name)->zincr(name, key, by, new_val, log_type);
+	}
+
+	int ShardedLVDB::multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset, char log_type){
+		return db_of(name)->multi_zset(name, kvs, offset, log_type);
+	}
+
+	int ShardedLVDB::multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset, char log_type){
+		return db_of(name)->multi_zdel(name, keys, offset, log_type);
+	}
+
+	int64_t ShardedLVDB::zsize(const Bytes &name){
+		return db_of(name)->zsize(name);
+	}
+
+	int64_t ShardedLVDB::zclear(const Bytes &name, char log_type){
+		return db_of(name)->zclear(name, log_type);
+	}
+
+	int ShardedLVDB::zget(const Bytes &name, const Bytes &key, std::string *score){
+		return db_of(name)->zget(name, key, score);
+	}
+
+	int ShardedLVDB::multi_zget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *scores, int offset){
+		return db_of(name)->multi_zget(name, keys, scores, offset);
+	}
+
+	int64_t ShardedLVDB::zrank(const Bytes &name, const Bytes &key){
+		return db_of(name)->zrank(name, key);
+	}
+
+	int64_t ShardedLVDB::zrrank(const Bytes &name, const Bytes &key){
+		return db_of(name)->zrrank(name, key);
+	}
+
+	ZIterator* ShardedLVDB::zrange(const Bytes &name, uint64_t offset, uint64_t limit){
+		return db_of(name)->zrange(name, offset, limit);
+	}
+
+	ZIterator* ShardedLVDB::zrrange(const Bytes &name, uint64_t offset, uint64_t limit){
+		return db_of(name)->zrrange(name, offset, limit);
+	}
+
+	ZIterator* ShardedLVDB::zscan(const Bytes &name, const Bytes &key,
+		const Bytes &score_start, const Bytes &score_end, uint64_t limit){
+		return db_of(name)->zscan(name, key, score_start, score_end, limit);
+	}
+
+	ZIterator* ShardedLVDB::zrscan(const Bytes &name, const Bytes &key,
+		const Bytes &score_start, const Bytes &score_end, uint64_t limit){
+		return db_of(name)->zrscan(name, key, score_start, score_end, limit);
+	}
+
+	int ShardedLVDB::zlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::zlist, false, name_s, name_e, limit, list);
+	}
+
+	int ShardedLVDB::zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::zrlist, true, name_s, name_e, limit, list);
+	}
+
+	int64_t ShardedLVDB::zfix(const Bytes &name){
+		return db_of(name)->zfix(name);
+	}
+
+	/* queue */
+
+	int64_t ShardedLVDB::qsize(const Bytes &name){
+		return db_of(name)->qsize(name);
+	}
+
+	int64_t ShardedLVDB::qclear(const Bytes &name, char log_type){
+		return db_of(name)->qclear(name, log_type);
+	}
+
+	int ShardedLVDB::qfront(const Bytes &name, std::string *item){
+		return db_of(name)->qfront(name, item);
+	}
+
+	int ShardedLVDB::qback(const Bytes &name, std::string *item){
+		return db_of(name)->qback(name, item);
+	}
+
+	int64_t ShardedLVDB::qpush_front(const Bytes &name, const Bytes &item, char log_type){
+		return db_of(name)->qpush_front(name, item, log_type);
+	}
+
+	int64_t ShardedLVDB::qpush_back(const Bytes &name, const Bytes &item, char log_type){
+		return db_of(name)->qpush_back(name, item, log_type);
+	}
+
+	int ShardedLVDB::qpop_front(const Bytes &name, std::string *item, char log_type){
+		return db_of(name)->qpop_front(name, item, log_type);
+	}
+
+	int ShardedLVDB::qpop_back(const Bytes &name, std::string *item, char log_type){
+		return db_of(name)->qpop_back(name, item, log_type);
+	}
+
+	int ShardedLVDB::qfix(const Bytes &name){
+		return db_of(name)->qfix(name);
+	}
+
+	int ShardedLVDB::qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::qlist, false, name_s, name_e, limit, list);
+	}
+
+	int ShardedLVDB::qrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+		std::vector<std::string> *list){
+		return merge_lists(&LVDB::qrlist, true, name_s, name_e, limit, list);
+	}
+
+	int ShardedLVDB::qslice(const Bytes &name, int64_t offset, int64_t limit,
+		std::vector<std::string> *list){
+		return db_of(name)->qslice(name, offset, limit, list);
+	}
+
+	int ShardedLVDB::qget(const Bytes &name, int64_t index, std::string *item){
+		return db_of(name)->qget(name, index, item);
+	}
+
+	int ShardedLVDB::qset(const Bytes &name, int64_t index, const Bytes &item, char log_type){
+		return db_of(name)->qset(name, index, item, log_type);
+	}
+
+	int ShardedLVDB::qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type){
+		return db_of(name)->qset_by_seq(name, seq, item, log_type);
+	}
+
+
+	/* async writes, queued to the writer of the shard */
+
+	int ShardedLVDB::async_set(const Bytes &key, const Bytes &val, const Async_Callback &done, char log_type){
+		return db_of(key)->async_set(key, val, done, log_type);
+	}
+
+	int ShardedLVDB::async_del(const Bytes &key, const Async_Callback &done, char log_type){
+		return db_of(key)->async_del(key, done, log_type);
+	}
+
+	int ShardedLVDB::async_incr(const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return db_of(key)->async_incr(key, by, done, log_type);
+	}
+
+	int ShardedLVDB::async_hset(const Bytes &name, const Bytes &key, const Bytes &val, const Async_Callback &done, char log_type){
+		return db_of(name)->async_hset(name, key, val, done, log_type);
+	}
+
+	int ShardedLVDB::async_hdel(const Bytes &name, const Bytes &key, const Async_Callback &done, char log_type){
+		return db_of(name)->async_hdel(name, key, done, log_type);
+	}
+
+	int ShardedLVDB::async_hincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return db_of(name)->async_hincr(name, key, by, done, log_type);
+	}
+
+	int ShardedLVDB::async_zset(const Bytes &name, const Bytes &key, const Bytes &score, const Async_Callback &done, char log_type){
+		return db_of(name)->async_zset(name, key, score, done, log_type);
+	}
+
+	int ShardedLVDB::async_zdel(const Bytes &name, const Bytes &key, const Async_Callback &done, char log_type){
+		return db_of(name)->async_zdel(name, key, done, log_type);
+	}
+
+	int ShardedLVDB::async_zincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done, char log_type){
+		return db_of(name)->async_zincr(name, key, by, done, log_type);
+	}
+
+	int ShardedLVDB::async_qpush_front(const Bytes &name, const Bytes &item, const Async_Callback &done, char log_type){
+		return db_of(name)->async_qpush_front(name, item, done, log_type);
+	}
+
+	int ShardedLVDB::async_qpush_back(const Bytes &name, const Bytes &item, const Async_Callback &done, char log_type){
+		return db_of(name)->async_qpush_back(name, item, done, log_type);
+	}
+
+
+}
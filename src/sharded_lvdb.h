@@ -0,0 +1,173 @@
+#pragma once
+
+
+#include <vector>
+#include "lvdb_impl.h"
+
+
+namespace lv
+{
+	// LVDB over Options::shards LVDB_Impl, each with its own leveldb and
+	// binlogs in dir/shard<i>/
+	//
+	// Everything of one container (a kv key, a hash, a zset or a queue name)
+	// lives in the shard its name hashes to, so the operates of a container
+	// are handled by a single shard. The scans and lists over several
+	// containers read every shard and merge the results in key order, the
+	// meta keys are kept in shard 0.
+	class ShardedLVDB : public LVDB
+	{
+	public:
+		static LVDB* open(const Options &opt);
+		// the shard count of dir is kept in dir/SHARDS from its first sharded
+		// open, another count would look the names up in the wrong shards.
+		// -1 if dir holds a db of another count, sharded or not
+		static int check_shards(const std::string &dir, int shards);
+		virtual ~ShardedLVDB();
+
+		virtual int shards() const{
+			return (int)dbs.size();
+		}
+		virtual LVDB* shard(int i){
+			return dbs[i];
+		}
+
+		virtual int release();
+
+		virtual int flushdb();
+
+		virtual Iterator* iterator(const std::string &start, const std::string &end, uint64_t limit);
+		virtual Iterator* rev_iterator(const std::string &start, const std::string &end, uint64_t limit);
+
+		virtual uint64_t size();
+		virtual std::vector<std::string> info();
+		virtual void compact();
+		virtual int key_range(std::vector<std::string> *keys);
+
+		/* raw operates */
+
+		virtual int raw_set(const Bytes &key, const Bytes &val);
+		virtual int raw_del(const Bytes &key);
+		virtual int raw_get(const Bytes &key, std::string *val);
+
+		/* meta operates */
+		virtual int meta_set(const Bytes &key, const Bytes &val);
+		virtual int meta_get(const Bytes &key, std::string *val);
+		virtual int meta_del(const Bytes &key);
+		virtual int meta_list(std::vector<std::string> *list);
+		virtual Cdc_Cursor* subscribe(const std::string &name, const Cdc_Filter &filter);
+
+		/* key value */
+
+		virtual int set(const Bytes &key, const Bytes &val, char log_type = BinlogType::SYNC);
+		virtual int setnx(const Bytes &key, const Bytes &val, char log_type = BinlogType::SYNC);
+		virtual int del(const Bytes &key, char log_type = BinlogType::SYNC);
+		virtual int incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC);
+		virtual int multi_set(const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int multi_del(const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int set_bit(const Bytes &key, int bitoffset, int on, char log_type = BinlogType::SYNC);
+		virtual int get_bit(const Bytes &key, int bitoffset);
+
+		virtual int get(const Bytes &key, std::string *val);
+		virtual int multi_get(const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0);
+		virtual int getset(const Bytes &key, std::string *val, const Bytes &newval, char log_type = BinlogType::SYNC);
+		virtual KIterator* scan(const Bytes &start, const Bytes &end, uint64_t limit);
+		virtual KIterator* rscan(const Bytes &start, const Bytes &end, uint64_t limit);
+
+		/* hash */
+
+		virtual int hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type = BinlogType::SYNC);
+		virtual int hdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC);
+		virtual int hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC);
+		virtual int multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC);
+
+		virtual int64_t hsize(const Bytes &name);
+		virtual int64_t hclear(const Bytes &name, char log_type = BinlogType::SYNC);
+		virtual int hget(const Bytes &name, const Bytes &key, std::string *val);
+		virtual int multi_hget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *vals, int offset = 0);
+		virtual int hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual int hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual HIterator* hscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit);
+		virtual HIterator* hrscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit);
+
+		/* zset */
+
+		virtual int zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type = BinlogType::SYNC);
+		virtual int zdel(const Bytes &name, const Bytes &key, char log_type = BinlogType::SYNC);
+		virtual int zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type = BinlogType::SYNC);
+		virtual int multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset = 0, char log_type = BinlogType::SYNC);
+		virtual int multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset = 0, char log_type = BinlogType::SYNC);
+
+		virtual int64_t zsize(const Bytes &name);
+		virtual int64_t zclear(const Bytes &name, char log_type = BinlogType::SYNC);
+		virtual int zget(const Bytes &name, const Bytes &key, std::string *score);
+		virtual int multi_zget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *scores, int offset = 0);
+		virtual int64_t zrank(const Bytes &name, const Bytes &key);
+		virtual int64_t zrrank(const Bytes &name, const Bytes &key);
+		virtual ZIterator* zrange(const Bytes &name, uint64_t offset, uint64_t limit);
+		virtual ZIterator* zrrange(const Bytes &name, uint64_t offset, uint64_t limit);
+		virtual ZIterator* zscan(const Bytes &name, const Bytes &key,
+			const Bytes &score_start, const Bytes &score_end, uint64_t limit);
+		virtual ZIterator* zrscan(const Bytes &name, const Bytes &key,
+			const Bytes &score_start, const Bytes &score_end, uint64_t limit);
+		virtual int zlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual int zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual int64_t zfix(const Bytes &name);
+
+		virtual int64_t qsize(const Bytes &name);
+		virtual int64_t qclear(const Bytes &name, char log_type = BinlogType::SYNC);
+		virtual int qfront(const Bytes &name, std::string *item);
+		virtual int qback(const Bytes &name, std::string *item);
+		virtual int64_t qpush_front(const Bytes &name, const Bytes &item, char log_type = BinlogType::SYNC);
+		virtual int64_t qpush_back(const Bytes &name, const Bytes &item, char log_type = BinlogType::SYNC);
+		virtual int qpop_front(const Bytes &name, std::string *item, char log_type = BinlogType::SYNC);
+		virtual int qpop_back(const Bytes &name, std::string *item, char log_type = BinlogType::SYNC);
+		virtual int qfix(const Bytes &name);
+		virtual int qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual int qrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
+			std::vector<std::string> *list);
+		virtual int qslice(const Bytes &name, int64_t offset, int64_t limit,
+			std::vector<std::string> *list);
+		virtual int qget(const Bytes &name, int64_t index, std::string *item);
+		virtual int qset(const Bytes &name, int64_t index, const Bytes &item, char log_type = BinlogType::SYNC);
+		virtual int qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type = BinlogType::SYNC);
+
+		virtual int async_set(const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_del(const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_incr(const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hset(const Bytes &name, const Bytes &key, const Bytes &val, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_hincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zset(const Bytes &name, const Bytes &key, const Bytes &score, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zdel(const Bytes &name, const Bytes &key, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_zincr(const Bytes &name, const Bytes &key, int64_t by, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_qpush_front(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+		virtual int async_qpush_back(const Bytes &name, const Bytes &item, const Async_Callback &done = Async_Callback(), char log_type = BinlogType::SYNC);
+
+	private:
+		std::vector<LVDB_Impl*> dbs;
+
+		ShardedLVDB(){}
+
+		// the shard of a container name
+		size_t index_of(const Bytes &name) const;
+		LVDB_Impl* db_of(const Bytes &name) const{
+			return dbs[index_of(name)];
+		}
+		// the shard of an encoded db key
+		LVDB_Impl* db_of_raw(const Bytes &key) const;
+		// an iterator merging the iterators of every shard
+		leveldb::Iterator* merged_iterator();
+		// one list from every shard, merged in order and cut to limit
+		int merge_lists(int(LVDB::*f)(const Bytes&, const Bytes&, uint64_t, std::vector<std::string>*),
+			bool reverse, const Bytes &name_s, const Bytes &name_e, uint64_t limit, std::vector<std::string> *list);
+	};
+
+
+}
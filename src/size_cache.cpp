@@ -0,0 +1,125 @@
+#include "size_cache.h"
+#include "lvdb/const.h"
+#include "lvdb/strings.h"
+#include "lvdb/t_queue.h"
+#include <algorithm>
+
+
+namespace lv
+{
+	Size_Cache::Size_Cache(size_t capacity){
+		this->shard_capacity = std::max<size_t>(capacity / SHARDS, 1);
+		this->hits = 0;
+		this->misses = 0;
+		for (int i = 0; i < SHARDS; i++){
+			pthread_mutex_init(&shards[i].mutex, NULL);
+		}
+	}
+
+	Size_Cache::~Size_Cache(){
+		for (int i = 0; i < SHARDS; i++){
+			pthread_mutex_destroy(&shards[i].mutex);
+		}
+	}
+
+	bool Size_Cache::counter(const leveldb::Slice &key, Bytes *name){
+		if (key.empty()){
+			return false;
+		}
+		switch (key.data()[0]){
+		case DataType::HSIZE:
+		case DataType::ZSIZE:
+		case DataType::QSIZE:
+			*name = Bytes(key.data() + 1, key.size() - 1);
+			return true;
+		case DataType::QUEUE:{
+			Decoder decoder(key.data(), key.size());
+			uint64_t seq;
+			if (decoder.skip(1) == -1 || decoder.read_8_data(name) == -1 || decoder.read_uint64(&seq) == -1){
+				return false;
+			}
+			seq = big_endian(seq);
+			return seq == QFRONT_SEQ || seq == QBACK_SEQ;
+		}
+		default:
+			return false;
+		}
+	}
+
+	Size_Cache::Shard& Size_Cache::shard(const leveldb::Slice &key){
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < key.size(); i++){
+			h ^= (uint8_t)key.data()[i];
+			h *= 16777619u;
+		}
+		return shards[h % SHARDS];
+	}
+
+	int Size_Cache::get(const leveldb::Slice &key, std::string *val, bool *deleted){
+		Shard &s = shard(key);
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(key.ToString());
+		if (it == s.entries.end()){
+			pthread_mutex_unlock(&s.mutex);
+			misses++;
+			return 0;
+		}
+		s.lru.splice(s.lru.begin(), s.lru, it->second.pos);
+		*deleted = it->second.deleted;
+		if (!it->second.deleted){
+			val->assign(it->second.val);
+		}
+		pthread_mutex_unlock(&s.mutex);
+		hits++;
+		return 1;
+	}
+
+	void Size_Cache::put(const leveldb::Slice &key, const leveldb::Slice &val, bool deleted){
+		Shard &s = shard(key);
+		std::string k = key.ToString();
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(k);
+		if (it == s.entries.end()){
+			if (s.entries.size() >= shard_capacity){
+				s.entries.erase(s.lru.back());
+				s.lru.pop_back();
+			}
+			s.lru.push_front(k);
+			it = s.entries.insert(std::make_pair(k, Entry())).first;
+			it->second.pos = s.lru.begin();
+		}
+		else{
+			s.lru.splice(s.lru.begin(), s.lru, it->second.pos);
+		}
+		it->second.deleted = deleted;
+		it->second.val.assign(val.data(), val.size());
+		pthread_mutex_unlock(&s.mutex);
+	}
+
+	void Size_Cache::clear(){
+		for (int i = 0; i < SHARDS; i++){
+			Shard &s = shards[i];
+			pthread_mutex_lock(&s.mutex);
+			s.entries.clear();
+			s.lru.clear();
+			pthread_mutex_unlock(&s.mutex);
+		}
+	}
+
+	std::string Size_Cache::stats() const{
+		size_t entries = 0;
+		for (int i = 0; i < SHARDS; i++){
+			Shard &s = const_cast<Shard &>(shards[i]);
+			pthread_mutex_lock(&s.mutex);
+			entries += s.entries.size();
+			pthread_mutex_unlock(&s.mutex);
+		}
+		std::string s;
+		s.append("    entries  : " + str((uint64_t)entries) + "\n");
+		s.append("    hits     : " + str((uint64_t)hits) + "\n");
+		s.append("    misses   : " + str((uint64_t)misses) + "");
+		return s;
+	}
+
+
+}
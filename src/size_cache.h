@@ -0,0 +1,67 @@
+#pragma once
+
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "pthread.h"
+#include "leveldb/slice.h"
+#include "lvdb/bytes.h"
+
+
+namespace lv
+{
+	// bounded cache of the container counters: the HSIZE, ZSIZE and QSIZE
+	// values and the QFRONT_SEQ/QBACK_SEQ items of the queues
+	//
+	// Binlog_Queue writes a counter through when a transaction writing it
+	// is committed, and fills a miss only for a transaction holding the
+	// stripe of its container, so a cached value is never older than the
+	// db and the pending groups. An absent counter is cached too, the first
+	// write to a new container then needs no leveldb lookup either.
+	class Size_Cache
+	{
+	public:
+		Size_Cache(size_t capacity);
+		~Size_Cache();
+
+		// the container name of a counter key, false for any other key
+		static bool counter(const leveldb::Slice &key, Bytes *name);
+
+		// 1: cached, *deleted when the counter is absent, 0: not cached
+		int get(const leveldb::Slice &key, std::string *val, bool *deleted);
+		void put(const leveldb::Slice &key, const leveldb::Slice &val, bool deleted);
+		void clear();
+
+		std::string stats() const;
+
+	private:
+		static const int SHARDS = 16;
+
+		struct Entry
+		{
+			std::string val;
+			bool deleted;
+			// position in Shard::lru
+			std::list<std::string>::iterator pos;
+		};
+
+		struct Shard
+		{
+			pthread_mutex_t mutex;
+			std::unordered_map<std::string, Entry> entries;
+			// most recently used first
+			std::list<std::string> lru;
+		};
+
+		size_t shard_capacity;
+		Shard shards[SHARDS];
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+
+		Shard& shard(const leveldb::Slice &key);
+	};
+
+
+}
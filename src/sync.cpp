@@ -1,22 +1,190 @@
 #include "lvdb/sync.h"
 #include "lvdb_impl.h"
 #include "toolkits/log.h"
+#include "toolkits/util.h"
+#include <algorithm>
+#include <chrono>
 
 
 namespace lv
 {
 
+	void encode_sync_batch(const std::vector<Sync_Item>& items, std::string* buf)
+	{
+		buf->clear();
+		for (size_t i = 0; i < items.size(); i++) {
+			const Sync_Item &item = items[i];
+			uint32_t len = (uint32_t)item.log.size();
+			buf->append((char *)&len, sizeof(len));
+			buf->append(item.log.data(), item.log.size());
+			len = item.has_val ? (uint32_t)item.val.size() : UINT32_MAX;
+			buf->append((char *)&len, sizeof(len));
+			if (item.has_val) {
+				buf->append(item.val);
+			}
+		}
+	}
+
+	int decode_sync_batch(const Bytes& buf, std::vector<Sync_Item>* items)
+	{
+		items->clear();
+		const char *p = buf.data();
+		const char *end = p + buf.size();
+		while (p < end) {
+			uint32_t len;
+			if (end - p < (int)sizeof(len)) {
+				return -1;
+			}
+			memcpy(&len, p, sizeof(len));
+			p += sizeof(len);
+			if ((uint64_t)(end - p) < len) {
+				return -1;
+			}
+			items->push_back(Sync_Item());
+			Sync_Item &item = items->back();
+			if (item.log.load(Bytes(p, len)) == -1) {
+				return -1;
+			}
+			p += len;
+			if (end - p < (int)sizeof(len)) {
+				return -1;
+			}
+			memcpy(&len, p, sizeof(len));
+			p += sizeof(len);
+			item.has_val = (len != UINT32_MAX);
+			if (item.has_val) {
+				if ((uint64_t)(end - p) < len) {
+					return -1;
+				}
+				item.val.assign(p, len);
+				p += len;
+			}
+		}
+		return (int)items->size();
+	}
+
+
+
+	int Sync_Processor::do_sync_batch(std::vector<Sync_Item>& items)
+	{
+		int ret = 0;
+		for (size_t i = 0; i < items.size(); i++) {
+			Sync_Item &item = items[i];
+			const char *val = item.has_val ? item.val.data() : NULL;
+			if (do_sync(item.log, val, (int)item.val.size()) == -1) {
+				ret = -1;
+			}
+		}
+		return ret;
+	}
+
+
+
+	// adds the item shipping log, skips the binlogs of no interest
+	static void add_sync_item(LVDB_Impl *db, const Binlog &log, std::vector<Sync_Item> *items)
+	{
+		if (log.type() == BinlogType::NOOP || log.type() == BinlogType::CTRL) {
+			return;
+		}
+		switch (log.cmd()) {
+		case BinlogCommand::KSET:
+		case BinlogCommand::HSET:
+		case BinlogCommand::ZSET:
+		case BinlogCommand::QSET:
+		case BinlogCommand::QPUSH_BACK:
+		case BinlogCommand::QPUSH_FRONT:
+		{
+			items->push_back(Sync_Item());
+			Sync_Item &item = items->back();
+			if (log.has_val()) {
+				// the value at this seq, shipped once in item.val
+				item.log = log.without_val();
+				item.val = log.val().String();
+				item.has_val = true;
+				break;
+			}
+			int ret = db->raw_get(log.key(), &item.val);
+			if (ret == -1) {
+				LOG_ERROR(" raw_get error!");
+				items->pop_back();
+				break;
+			}
+			else if (ret == 0) {
+				LOG_ERROR("skip not found, " << log.dumps());
+				items->pop_back();
+			}
+			else {
+				item.log = log;
+				item.has_val = true;
+			}
+			break;
+		}
+
+		case BinlogCommand::KDEL:
+		case BinlogCommand::HDEL:
+		case BinlogCommand::ZDEL:
+		case BinlogCommand::QPOP_BACK:
+		case BinlogCommand::QPOP_FRONT:
+		case BinlogCommand::HCLEAR:
+		case BinlogCommand::ZCLEAR:
+		case BinlogCommand::QCLEAR:
+		{
+			items->push_back(Sync_Item());
+			Sync_Item &item = items->back();
+			item.log = log;
+			item.has_val = false;
+			break;
+		}
+		}
+	}
+
+
+
+	// the binlogs and snapshots are those of one LVDB_Impl, each shard of a
+	// sharded db has its own
+	static LVDB_Impl* impl_of(const std::string& name, LVDB* db)
+	{
+		if (db->shards() > 1) {
+			LOG_ERROR(name << " can't run on a db of " << db->shards() << " shards, run one per shard(i)");
+			return NULL;
+		}
+		return (LVDB_Impl*)db->shard(0);
+	}
+
 	Sync::Sync(const std::string& name, LVDB* db, Sync_Processor* sync) :
 		name_(name),
 		db_(db),
-		sync_(sync)
+		impl_(impl_of(name, db)),
+		sync_(sync),
+		quit_(false),
+		stopped_(false)
 	{
 
 	}
 
+	void Sync::quit()
+	{
+		quit_ = true;
+	}
+
+	// sets the flag once svc returned, on every path
+	struct Stopped_Flag
+	{
+		volatile bool *flag;
+
+		~Stopped_Flag()
+		{
+			*flag = true;
+		}
+	};
+
 	int Sync::svc()
 	{
-		LVDB_Impl* db = (LVDB_Impl*)db_;
+		Stopped_Flag stopped = { &stopped_ };
+		LVDB_Impl* db = impl_;
+		if (!db) {
+			return -1;
+		}
 		Binlog_Queue *logs = db->binlogs;
 		std::string sync_seq = name_ + ":sync:seq";
 		LOG_INFO("logs seq[" << logs->min_seq() << ", " << logs->max_seq() << "]");
@@ -27,54 +195,87 @@ namespace lv
 		}
 		LOG_INFO(name_ << " last sync seq: " << last_seq);
 
-		Binlog log;
-		while (1) {
-			int ret = 0;
-			uint64_t expect_seq = last_seq + 1;
-			if (last_seq == 0) {
-				ret = logs->find_last(&log);
+		// a new sync starts from the last binlog
+		uint64_t start_seq = last_seq + 1;
+		if (last_seq == 0 && logs->max_seq() > 0) {
+			start_seq = logs->max_seq();
+		}
+		Binlog_Cursor cursor(logs, start_seq);
+		std::vector<Binlog> batch;
+		std::vector<Binlog> entries;
+		std::vector<Sync_Item> items;
+		// the checkpoint is a binlog itself, it is only saved when something
+		// was shipped, or the syncs would wake each other up forever, and at
+		// most once a second while busy
+		bool shipped = false;
+		// the slave misses the writes of dropped binlogs, the sync stops at
+		// the first gap until a Copy of the same name moves the checkpoint
+		bool lost = false;
+		std::chrono::steady_clock::time_point saved = std::chrono::steady_clock::now();
+		while (!quit_ && !lost) {
+			int ret = cursor.next(&batch, SSDB_SYNC_BATCH, 100);
+			if (ret == -1) {
+				LOG_ERROR(name_ << " read binlogs error");
+				Sleep(100);
+				continue;
 			}
-			else {
-				ret = logs->find_next(expect_seq, &log);
-			}
-			if (ret == 0)
-				return 0;
-			last_seq = log.seq();
-			switch (log.cmd()) {
-			case BinlogCommand::KSET:
-			case BinlogCommand::HSET:
-			case BinlogCommand::ZSET:
-			case BinlogCommand::QSET:
-			case BinlogCommand::QPUSH_BACK:
-			case BinlogCommand::QPUSH_FRONT:
-			{
-				std::string val;
-				int ret = db->raw_get(log.key(), &val);
-				if (ret == -1) {
-					LOG_ERROR(" raw_get error!");
+			if (ret == 0 && last_seq != 0 && cursor.seq() > last_seq + 1) {
+				LOG_ERROR(name_ << " binlogs [" << (last_seq + 1) << ", " << (cursor.seq() - 1) << "] lost, sync stopped, run a Copy to resync");
+				lost = true;
+				break;
+			}
+			items.clear();
+			// last_seq only moves past the batch once it is acked
+			uint64_t batch_seq = last_seq;
+			for (size_t i = 0; i < batch.size(); i++) {
+				Binlog &log = batch[i];
+				if (batch_seq != 0 && log.seq() > batch_seq + 1) {
+					// the binlogs before the gap are still shipped
+					LOG_ERROR(name_ << " binlogs [" << (batch_seq + 1) << ", " << (log.seq() - 1) << "] lost, sync stopped, run a Copy to resync");
+					lost = true;
 					break;
 				}
-				else if (ret == 0) {
-					LOG_ERROR("skip not found, " << log.dumps());
+				batch_seq = log.seq();
+				if (log.cmd() == BinlogCommand::BEGIN) {
+					// a transaction, its writes are shipped with its seq and
+					// so in one do_sync_batch()
+					if (log.entries(&entries) == -1) {
+						LOG_ERROR(name_ << " skip corrupt binlog group " << log.seq());
+						continue;
+					}
+					for (size_t j = 0; j < entries.size(); j++) {
+						add_sync_item(db, entries[j], &items);
+					}
+					continue;
 				}
-				else {
-					//
-					sync_->do_sync(log, val.c_str(), val.length());
+				add_sync_item(db, log, &items);
+			}
+			if (!items.empty()) {
+				// a failed batch is shipped again, the checkpoint stays at
+				// the last acked seq meanwhile
+				int wait = 100;
+				bool acked = (sync_->do_sync_batch(items) != -1);
+				while (!acked && !quit_) {
+					LOG_ERROR(name_ << " sync " << items.size() << " binlogs error, retry in " << wait << " ms");
+					Sleep(wait);
+					wait = std::min(wait * 2, 5000);
+					acked = (sync_->do_sync_batch(items) != -1);
 				}
-				break;
+				if (!acked) {
+					break;
+				}
+				shipped = true;
 			}
-
-			case BinlogCommand::KDEL:
-			case BinlogCommand::HDEL:
-			case BinlogCommand::ZDEL:
-			case BinlogCommand::QPOP_BACK:
-			case BinlogCommand::QPOP_FRONT:
-				sync_->do_sync(log, NULL, 0);
-				break;
+			last_seq = batch_seq;
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			if (shipped && (ret == 0 || now - saved >= std::chrono::seconds(1))) {
+				db_->meta_set(sync_seq, Bytes_uint64(last_seq));
+				shipped = false;
+				saved = now;
 			}
 		}
 		db_->meta_set(sync_seq, Bytes_uint64(last_seq));
-		return 0;
+		return lost ? -1 : 0;
 	}
 
 
@@ -82,83 +283,459 @@ namespace lv
 	Copy::Copy(const std::string& name, LVDB* db, Sync_Processor* sync) :
 		name_(name),
 		db_(db),
-		sync_(sync)
+		impl_(impl_of(name, db)),
+		syncs_(1, sync),
+		stopped_(false)
 	{
 
 	}
 
+	Copy::Copy(const std::string& name, LVDB* db, const std::vector<Sync_Processor*>& syncs) :
+		name_(name),
+		db_(db),
+		impl_(impl_of(name, db)),
+		syncs_(syncs),
+		stopped_(false)
+	{
+
+	}
+
+	struct Copy::Shard
+	{
+		Copy *copy;
+		int index;
+		// [begin, end)
+		std::string begin;
+		std::string end;
+		Sync_Processor *sync;
+		const leveldb::Snapshot *snapshot;
+		uint64_t count;
+		int ret;
+	};
+
+	static void encode_copy_splits(const std::vector<std::string>& splits, std::string* buf)
+	{
+		buf->clear();
+		for (size_t i = 0; i < splits.size(); i++) {
+			uint32_t len = (uint32_t)splits[i].size();
+			buf->append((char *)&len, sizeof(len));
+			buf->append(splits[i]);
+		}
+	}
+
+	static int decode_copy_splits(const std::string& buf, std::vector<std::string>* splits)
+	{
+		splits->clear();
+		size_t pos = 0;
+		while (pos < buf.size()) {
+			uint32_t len;
+			if (buf.size() - pos < sizeof(len)) {
+				return -1;
+			}
+			memcpy(&len, buf.data() + pos, sizeof(len));
+			pos += sizeof(len);
+			if (buf.size() - pos < len) {
+				return -1;
+			}
+			splits->push_back(buf.substr(pos, len));
+			pos += len;
+		}
+		return 0;
+	}
 
 	int Copy::svc()
 	{
-		LVDB_Impl* db = (LVDB_Impl*)db_;
-		Binlog_Queue *logs = db->binlogs;
-		std::string copy_key = name_ + ":copy:key";
-		std::string last_key;
-		db_->meta_get(last_key, &last_key);
-		if (last_key.empty()) {
-			last_key.push_back(DataType::MIN_PREFIX);
+		Stopped_Flag stopped = { &stopped_ };
+		LVDB_Impl* db = impl_;
+		std::string seq_key = name_ + ":copy:seq";
+		std::string splits_key = name_ + ":copy:splits";
+		std::string start(1, DataType::MIN_PREFIX);
+		std::string end(1, DataType::MAX_PREFIX + 1);
+		if (!db || syncs_.empty()) {
+			return -1;
 		}
 
-		LOG_INFO(name_ << " copy, last key: " << last_key);
-		Iterator *iter = db_->iterator(last_key, "", -1);
-		Binlog log;
-		while (1) {
-			if (!iter->next()) {
-				LOG_INFO("copy finish");
-				break;
+		uint64_t snapshot_seq;
+		const leveldb::Snapshot *snapshot = db->get_snapshot(&snapshot_seq);
+
+		// a resumed copy keeps its shards and the seq of its first snapshot,
+		// the binlogs after that seq make up for the keys copied since
+		uint64_t copy_seq = 0;
+		std::vector<std::string> splits;
+		std::string val, buf;
+		if (db_->meta_get(seq_key, &val) == 1 && db_->meta_get(splits_key, &buf) == 1
+			&& decode_copy_splits(buf, &splits) == 0 && splits.size() < syncs_.size()) {
+			Bytes_uint64::FromString(copy_seq, val);
+			LOG_INFO(name_ << " resume copy of seq " << copy_seq << ", " << (splits.size() + 1) << " shards");
+		}
+		else {
+			copy_seq = snapshot_seq;
+			db->split_range(start, end, (int)syncs_.size(), &splits);
+			for (size_t i = 0; i < syncs_.size(); i++) {
+				db_->meta_del(name_ + ":copy:" + str((int)i));
+			}
+			encode_copy_splits(splits, &buf);
+			db_->meta_set(splits_key, buf);
+			db_->meta_set(seq_key, Bytes_uint64(copy_seq));
+			LOG_INFO(name_ << " copy of seq " << copy_seq << ", " << (splits.size() + 1) << " shards");
+		}
+
+		std::vector<Shard> shards(splits.size() + 1);
+		for (size_t i = 0; i < shards.size(); i++) {
+			Shard &shard = shards[i];
+			shard.copy = this;
+			shard.index = (int)i;
+			shard.begin = (i == 0) ? start : splits[i - 1];
+			shard.end = (i == splits.size()) ? end : splits[i];
+			shard.sync = syncs_[i];
+			shard.snapshot = snapshot;
+			shard.count = 0;
+			shard.ret = 0;
+		}
+		// shard 0 is copied by this thread
+		std::vector<pthread_t> tids(shards.size());
+		std::vector<bool> started(shards.size(), false);
+		for (size_t i = 1; i < shards.size(); i++) {
+			int err = pthread_create(&tids[i], NULL, &Copy::shard_thread, &shards[i]);
+			if (err != 0) {
+				LOG_ERROR("can't create thread: " << strerror(err));
+				shards[i].ret = -1;
+			}
+			else {
+				started[i] = true;
+			}
+		}
+		copy_shard(&shards[0]);
+		int ret = shards[0].ret;
+		uint64_t count = shards[0].count;
+		for (size_t i = 1; i < shards.size(); i++) {
+			if (started[i]) {
+				pthread_join(tids[i], NULL);
+			}
+			if (shards[i].ret == -1) {
+				ret = -1;
 			}
+			count += shards[i].count;
+		}
+		db->release_snapshot(snapshot);
 
-			Bytes key = iter->key();
-			if (key.size() == 0) {
-				continue;
+		if (ret == -1) {
+			LOG_ERROR(name_ << " copy stopped after " << count << " keys, it resumes on the next run");
+			return -1;
+		}
+		db_->meta_set(name_ + ":sync:seq", Bytes_uint64(copy_seq));
+		db_->meta_del(seq_key);
+		db_->meta_del(splits_key);
+		for (size_t i = 0; i < shards.size(); i++) {
+			db_->meta_del(name_ + ":copy:" + str((int)i));
+		}
+		LOG_INFO(name_ << " copy finish, " << count << " keys, sync from seq " << copy_seq);
+		return 0;
+	}
+
+	void* Copy::shard_thread(void *arg)
+	{
+		Shard *shard = (Shard *)arg;
+		shard->copy->copy_shard(shard);
+		return NULL;
+	}
+
+	int Copy::copy_shard(Shard *shard)
+	{
+		LVDB_Impl* db = impl_;
+		std::string copy_key = name_ + ":copy:" + str(shard->index);
+		std::string from = shard->begin;
+		// a resumed shard starts after its checkpoint, a fresh one at begin
+		bool resumed = false;
+		std::string val;
+		if (db_->meta_get(copy_key, &val) == 1) {
+			from = val;
+			resumed = true;
+		}
+		if (from >= shard->end) {
+			return 0;
+		}
+
+		Iterator *iter = db->iterator(from, shard->end, UINT64_MAX, shard->snapshot);
+		std::vector<Sync_Item> items;
+		std::string last_key;
+		while (1) {
+			bool more = iter->next();
+			if (more) {
+				Bytes key = iter->key();
+				// end is inclusive for Iterator
+				if (key.compare(shard->end) >= 0) {
+					more = false;
+				}
+				// the checkpoint is the last key copied
+				else if (!key.empty() && !(resumed && key == Bytes(from))) {
+					char cmd = 0;
+					char data_type = key.data()[0];
+					if (data_type == DataType::KV) {
+						cmd = BinlogCommand::KSET;
+					}
+					else if (data_type == DataType::HASH) {
+						cmd = BinlogCommand::HSET;
+					}
+					else if (data_type == DataType::ZSET) {
+						cmd = BinlogCommand::ZSET;
+					}
+					else if (data_type == DataType::QUEUE) {
+						// by seq, the items shipped again by a resumed copy
+						// are overwritten, not pushed twice
+						cmd = BinlogCommand::QSET;
+					}
+					if (cmd) {
+						items.push_back(Sync_Item());
+						Sync_Item &item = items.back();
+						item.log = Binlog(0, BinlogType::COPY, cmd, slice(key));
+						item.has_val = true;
+						item.val = iter->val().String();
+						last_key = key.String();
+					}
+				}
 			}
-			// finish copying all valid data types
-			if (key.data()[0] > DataType::MAX_PREFIX) {
+			if (!items.empty() && (items.size() >= (size_t)SSDB_SYNC_BATCH || !more)) {
+				if (shard->sync->do_sync_batch(items) == -1) {
+					LOG_ERROR(name_ << " copy shard " << shard->index << " error");
+					shard->ret = -1;
+					break;
+				}
+				shard->count += items.size();
+				db_->meta_set(copy_key, last_key);
+				items.clear();
+			}
+			if (!more) {
+				db_->meta_set(copy_key, shard->end);
 				break;
 			}
+		}
+		delete iter;
+		return shard->ret;
+	}
 
-			Bytes val = iter->val();
-			last_key = key.String();
-			char cmd = 0;
-			char data_type = key.data()[0];
-			if (data_type == DataType::KV) {
-				cmd = BinlogCommand::KSET;
-			}
-			else if (data_type == DataType::HASH) {
-				cmd = BinlogCommand::HSET;
+
+
+	//////////////////////////////////////////////////////////////////////////
+	// smaller batches are applied on the calling thread, not worth a hand over
+	static const size_t LANE_MIN_ITEMS = 32;
+
+	struct Backup_Server_Processor::Lane
+	{
+		Backup_Server_Processor *processor;
+		pthread_t tid;
+		// sorted, the stripes of the containers applied by the lane
+		std::vector<int> stripes;
+		std::vector<Sync_Item*> items;
+		// the writes prepared for the batch, until joined
+		Binlog_Queue::Tran_State *tran;
+		int ret;
+	};
+
+	Backup_Server_Processor::Backup_Server_Processor(LVDB* db, const std::string& name, int lanes) :
+		db_(db),
+		name_(name),
+		impl_(impl_of(name.empty() ? "backup server" : name, db)),
+		round_(0),
+		joined_(0),
+		preparing_(0),
+		quit_(false)
+	{
+		pthread_mutex_init(&mutex_, NULL);
+		pthread_cond_init(&work_cond_, NULL);
+		pthread_cond_init(&done_cond_, NULL);
+		if (lanes <= 1) {
+			return;
+		}
+		for (int i = 0; i < lanes; i++) {
+			Lane *lane = new Lane();
+			lane->processor = this;
+			for (int s = i; s < Binlog_Queue::LOCK_STRIPES; s += lanes) {
+				lane->stripes.push_back(s);
+			}
+			lane->tran = NULL;
+			lane->ret = 0;
+			int err = pthread_create(&lane->tid, NULL, &Backup_Server_Processor::lane_thread, lane);
+			if (err != 0) {
+				LOG_ERROR("can't create thread: " << strerror(err));
+				exit(0);
+			}
+			lanes_.push_back(lane);
+		}
+	}
+
+	Backup_Server_Processor::~Backup_Server_Processor()
+	{
+		pthread_mutex_lock(&mutex_);
+		quit_ = true;
+		pthread_cond_broadcast(&work_cond_);
+		pthread_mutex_unlock(&mutex_);
+		for (size_t i = 0; i < lanes_.size(); i++) {
+			pthread_join(lanes_[i]->tid, NULL);
+			delete lanes_[i];
+		}
+		pthread_cond_destroy(&work_cond_);
+		pthread_cond_destroy(&done_cond_);
+		pthread_mutex_destroy(&mutex_);
+	}
+
+	void* Backup_Server_Processor::lane_thread(void *arg)
+	{
+		Lane *lane = (Lane*)arg;
+		Backup_Server_Processor *processor = lane->processor;
+		LVDB_Impl* db = processor->impl_;
+		uint64_t seen = 0;
+		pthread_mutex_lock(&processor->mutex_);
+		while (true) {
+			while (!processor->quit_ && processor->round_ == seen) {
+				pthread_cond_wait(&processor->work_cond_, &processor->mutex_);
+			}
+			if (processor->quit_) {
+				break;
 			}
-			else if (data_type == DataType::ZSET) {
-				cmd = BinlogCommand::ZSET;
+			seen = processor->round_;
+			pthread_mutex_unlock(&processor->mutex_);
+
+			// the stripes are held by the batch of do_sync_batch(), the
+			// writes of the lane are prepared in a batch of its own
+			Transaction trans(db->binlogs, lane->stripes, false);
+			db->binlogs->begin_batch();
+			int ret = 0;
+			for (size_t i = 0; i < lane->items.size(); i++) {
+				Sync_Item &item = *lane->items[i];
+				const char *val = item.has_val ? item.val.data() : NULL;
+				if (processor->do_sync(item.log, val, (int)item.val.size()) == -1) {
+					ret = -1;
+					break;
+				}
 			}
-			else if (data_type == DataType::QUEUE) {
-				cmd = BinlogCommand::QPUSH_BACK;
+
+			pthread_mutex_lock(&processor->mutex_);
+			lane->tran = trans.state();
+			lane->ret = ret;
+			if (--processor->preparing_ == 0) {
+				pthread_cond_signal(&processor->done_cond_);
 			}
-			else {
-				continue;
+			// trans must outlive the join
+			while (processor->joined_ != seen) {
+				pthread_cond_wait(&processor->work_cond_, &processor->mutex_);
 			}
+		}
+		pthread_mutex_unlock(&processor->mutex_);
+		return NULL;
+	}
 
-			Binlog log(0, BinlogType::COPY, cmd, slice(key));
-			if (!sync_->do_sync(log, val.data(), val.size())) {
-				//save
-				db_->meta_set(copy_key, last_key);
+	int Backup_Server_Processor::apply(std::vector<Sync_Item>& items, size_t begin, size_t end)
+	{
+		if (lanes_.empty() || end - begin < LANE_MIN_ITEMS) {
+			for (size_t i = begin; i < end; i++) {
+				Sync_Item &item = items[i];
+				const char *val = item.has_val ? item.val.data() : NULL;
+				if (do_sync(item.log, val, (int)item.val.size()) == -1) {
+					return -1;
+				}
 			}
+			return 0;
 		}
 
-		return 0;
+		LVDB_Impl* db = impl_;
+		for (size_t i = 0; i < lanes_.size(); i++) {
+			lanes_[i]->items.clear();
+		}
+		for (size_t i = begin; i < end; i++) {
+			int stripe = Binlog_Queue::stripe_of(items[i].log.name());
+			lanes_[stripe % lanes_.size()]->items.push_back(&items[i]);
+		}
+		pthread_mutex_lock(&mutex_);
+		round_++;
+		preparing_ = (int)lanes_.size();
+		pthread_cond_broadcast(&work_cond_);
+		while (preparing_ > 0) {
+			pthread_cond_wait(&done_cond_, &mutex_);
+		}
+		// joined in lane order, so the binlogs of the batch are too
+		int ret = 0;
+		for (size_t i = 0; i < lanes_.size(); i++) {
+			if (lanes_[i]->ret == -1) {
+				ret = -1;
+			}
+			else {
+				db->binlogs->join_batch(lanes_[i]->tran);
+			}
+		}
+		joined_ = round_;
+		pthread_cond_broadcast(&work_cond_);
+		pthread_mutex_unlock(&mutex_);
+		return ret;
 	}
 
+	uint64_t Backup_Server_Processor::last_seq()
+	{
+		std::string val;
+		uint64_t seq = 0;
+		if (!name_.empty() && db_->meta_get(name_ + ":sync:seq", &val) == 1) {
+			Bytes_uint64::FromString(seq, val);
+		}
+		return seq;
+	}
 
+	static bool is_clear(char cmd)
+	{
+		return cmd == BinlogCommand::HCLEAR || cmd == BinlogCommand::ZCLEAR || cmd == BinlogCommand::QCLEAR;
+	}
 
-	//////////////////////////////////////////////////////////////////////////
-	Backup_Server_Processor::Backup_Server_Processor(LVDB* db)
+	int Backup_Server_Processor::do_sync_batch(std::vector<Sync_Item>& items)
 	{
+		LVDB_Impl* db = impl_;
+		if (!db) {
+			return -1;
+		}
+		std::string seq_key = name_ + ":sync:seq";
+		size_t i = 0;
+		while (i < items.size()) {
+			// a clear deletes in several transactions of its own
+			if (is_clear(items[i].log.cmd())) {
+				if (do_sync(items[i].log, NULL, 0) == -1) {
+					return -1;
+				}
+				if (!name_.empty()) {
+					db_->meta_set(seq_key, Bytes_uint64(items[i].log.seq()));
+				}
+				i++;
+				continue;
+			}
 
+			// every set/del below joins this transaction, they are written
+			// together with the checkpoint
+			size_t end = i;
+			while (end < items.size() && !is_clear(items[end].log.cmd())) {
+				end++;
+			}
+			Transaction trans(db->binlogs);
+			db->binlogs->begin_batch();
+			if (apply(items, i, end) == -1) {
+				return -1;
+			}
+			i = end;
+			if (!name_.empty()) {
+				db_->meta_set(seq_key, Bytes_uint64(items[i - 1].log.seq()));
+			}
+			leveldb::Status s = db->binlogs->commit_batch();
+			if (!s.ok()) {
+				LOG_ERROR("sync batch error: " << s.ToString());
+				return -1;
+			}
+		}
+		return 0;
 	}
 
 
 
 	int Backup_Server_Processor::do_sync(Binlog& log, const char* val, int len)
 	{
+		if (!impl_) {
+			return -1;
+		}
 		const char log_type = BinlogType::MIRROR;
 		switch (log.cmd()) {
 		case BinlogCommand::KSET:
@@ -273,7 +850,11 @@ namespace lv
 				break;
 			}
 			int ret;
-			if (log.cmd() == BinlogCommand::QSET) {
+			if (log.cmd() == BinlogCommand::QSET && log.type() == BinlogType::COPY) {
+				LOG_INFO("qcopy " << hexmem(name.data(), name.size()) << " " << seq);
+				ret = impl_->qcopy_by_seq(name, seq, Bytes(val, len), log_type);
+			}
+			else if (log.cmd() == BinlogCommand::QSET) {
 				LOG_INFO("qset " << hexmem(name.data(), name.size()) << " " << seq);
 				ret = db_->qset_by_seq(name, seq, Bytes(val, len), log_type);
 			}
@@ -311,6 +892,30 @@ namespace lv
 		}
 		break;
 
+		case BinlogCommand::HCLEAR:
+		case BinlogCommand::ZCLEAR:
+		case BinlogCommand::QCLEAR:
+		{
+			int64_t ret;
+			const Bytes name = log.key();
+			if (log.cmd() == BinlogCommand::HCLEAR) {
+				LOG_INFO("hclear " << hexmem(name.data(), name.size()) );
+				ret = db_->hclear(name, log_type);
+			}
+			else if (log.cmd() == BinlogCommand::ZCLEAR) {
+				LOG_INFO("zclear " << hexmem(name.data(), name.size()) );
+				ret = db_->zclear(name, log_type);
+			}
+			else {
+				LOG_INFO("qclear " << hexmem(name.data(), name.size()) );
+				ret = db_->qclear(name, log_type);
+			}
+			if (ret == -1) {
+				return -1;
+			}
+		}
+		break;
+
 		default:
 			LOG_ERROR("unknown binlog, type: " << log.type() << ", cmd: " << log.cmd());
 			break;
@@ -1,6 +1,8 @@
 #include "lvdb_impl.h"
 #include "lvdb/t_hash.h"
 #include "toolkits/log.h"
+#include <map>
+#include <set>
 
 
 
@@ -14,7 +16,8 @@ namespace lv
 	 * @return -1: error, 0: item updated, 1: new item inserted
 	 */
 	int LVDB_Impl::hset(const Bytes &name, const Bytes &key, const Bytes &val, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::HSET);
+		Transaction trans(binlogs, name);
 
 		int ret = hset_one(this, name, key, val, log_type);
 		if (ret >= 0){
@@ -32,7 +35,8 @@ namespace lv
 	}
 
 	int LVDB_Impl::hdel(const Bytes &name, const Bytes &key, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::HDEL);
+		Transaction trans(binlogs, name);
 
 		int ret = hdel_one(this, name, key, log_type);
 		if (ret >= 0){
@@ -50,7 +54,8 @@ namespace lv
 	}
 
 	int LVDB_Impl::hincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::HINCR);
+		Transaction trans(binlogs, name);
 
 		std::string old;
 		int ret = this->hget(name, key, &old);
@@ -85,12 +90,77 @@ namespace lv
 		return 1;
 	}
 
+	int LVDB_Impl::multi_hset(const Bytes &name, const std::vector<Bytes> &kvs, int offset, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_HSET);
+		Transaction trans(binlogs, name);
+
+		// the reads of hset_one() don't see this batch, so a key given more
+		// than once is only set with its last value
+		std::map<Bytes, size_t> last;
+		for (size_t i = offset; i + 1 < kvs.size(); i += 2){
+			last[kvs[i]] = i;
+		}
+		int num = 0;
+		for (size_t i = offset; i + 1 < kvs.size(); i += 2){
+			if (last[kvs[i]] != i){
+				continue;
+			}
+			int ret = hset_one(this, name, kvs[i], kvs[i + 1], log_type);
+			if (ret == -1){
+				return -1;
+			}
+			num += ret;
+		}
+		if (num > 0){
+			if (incr_hsize(this, name, num) == -1){
+				return -1;
+			}
+		}
+		leveldb::Status s = binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("multi_hset error: " << s.ToString().c_str());
+			return -1;
+		}
+		return num;
+	}
+
+	int LVDB_Impl::multi_hdel(const Bytes &name, const std::vector<Bytes> &keys, int offset, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_HDEL);
+		Transaction trans(binlogs, name);
+
+		std::set<Bytes> deleted;
+		int num = 0;
+		for (size_t i = offset; i < keys.size(); i++){
+			if (!deleted.insert(keys[i]).second){
+				continue;
+			}
+			int ret = hdel_one(this, name, keys[i], log_type);
+			if (ret == -1){
+				return -1;
+			}
+			num += ret;
+		}
+		if (num > 0){
+			if (incr_hsize(this, name, -num) == -1){
+				return -1;
+			}
+		}
+		leveldb::Status s = binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("multi_hdel error: " << s.ToString().c_str());
+			return -1;
+		}
+		return num;
+	}
+
 	int64_t LVDB_Impl::hsize(const Bytes &name){
+		Op_Timer timer(op_stats, Op_Stats::HSIZE);
 		std::string size_key = encode_hsize_key(name);
 		std::string val;
 		leveldb::Status s;
 
-		s = ldb->Get(leveldb::ReadOptions(), size_key, &val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		s = binlogs->Get(scope.options(), size_key, &val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -106,32 +176,68 @@ namespace lv
 		}
 	}
 
-	int64_t LVDB_Impl::hclear(const Bytes &name){
+	int64_t LVDB_Impl::hclear(const Bytes &name, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::HCLEAR);
+		// delete the fields batch by batch instead of one hdel() each, still
+		// O(n) and synchronous, every batch but the last logs an HDEL per
+		// field and the last one a single HCLEAR, so a replica or a restart
+		// never misses the batches committed before a failure
+		std::string prefix = encode_hash_key(name, "");
+		// the deleted keys are read once, they must not evict the hot blocks
+		Read_Hint hint(read_policy(conf.bulk_read_policy));
 		int64_t count = 0;
 		while (1){
-			HIterator *it = this->hscan(name, "", "", 1000);
+			Transaction trans(binlogs, name);
+			// the commits of this container still waiting for their group are
+			// not seen by the iterator
+			binlogs->wait_written();
+
 			int num = 0;
+			std::vector<std::string> keys;
+			Iterator *it = this->iterator(prefix, "", SSDB_CLEAR_BATCH);
 			while (it->next()){
-				int ret = this->hdel(name, it->key);
-				if (ret == -1){
-					delete it;
-					return 0;
+				Bytes ks = it->key();
+				if (ks.size() < (int)prefix.size() || memcmp(ks.data(), prefix.data(), prefix.size()) != 0){
+					break;
 				}
+				binlogs->Delete(slice(ks));
+				keys.push_back(ks.String());
 				num++;
-			};
+			}
 			delete it;
 
-			if (num == 0){
-				break;
+			if (num > 0){
+				if (incr_hsize(this, name, -num) == -1){
+					return -1;
+				}
 			}
 			count += num;
+			bool done = num < SSDB_CLEAR_BATCH;
+			if (done && count > 0){
+				binlogs->add_log(log_type, BinlogCommand::HCLEAR, slice(name));
+			}
+			else if (!done){
+				for (size_t i = 0; i < keys.size(); i++){
+					binlogs->add_log(log_type, BinlogCommand::HDEL, keys[i]);
+				}
+			}
+			leveldb::Status s = binlogs->commit();
+			if (!s.ok()){
+				LOG_ERROR("hclear error: " << s.ToString().c_str());
+				return -1;
+			}
+			if (done){
+				break;
+			}
 		}
 		return count;
 	}
 
 	int LVDB_Impl::hget(const Bytes &name, const Bytes &key, std::string *val){
+		Op_Timer timer(op_stats, Op_Stats::HGET);
 		std::string dbkey = encode_hash_key(name, key);
-		leveldb::Status s = ldb->Get(leveldb::ReadOptions(), dbkey, val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		leveldb::Status s = binlogs->Get(scope.options(), dbkey, val, true);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -142,7 +248,18 @@ namespace lv
 		return 1;
 	}
 
+	int LVDB_Impl::multi_hget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *vals, int offset){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_HGET);
+		std::vector<std::string> bufs;
+		std::vector<Bytes>::const_iterator it;
+		for (it = keys.begin() + offset; it != keys.end(); it++){
+			bufs.push_back(encode_hash_key(name, *it));
+		}
+		return this->multi_read(bufs, vals);
+	}
+
 	HIterator* LVDB_Impl::hscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::HSCAN);
 		std::string key_start, key_end;
 
 		key_start = encode_hash_key(name, start);
@@ -156,6 +273,7 @@ namespace lv
 	}
 
 	HIterator* LVDB_Impl::hrscan(const Bytes &name, const Bytes &start, const Bytes &end, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::HRSCAN);
 		std::string key_start, key_end;
 
 		key_start = encode_hash_key(name, start);
@@ -187,6 +305,7 @@ namespace lv
 
 	int LVDB_Impl::hlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::HLIST);
 		std::string start;
 		std::string end;
 
@@ -203,6 +322,7 @@ namespace lv
 
 	int LVDB_Impl::hrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::HRLIST);
 		std::string start;
 		std::string end;
 
@@ -239,14 +359,14 @@ namespace lv
 		if (ssdb->hget(name, key, &dbval) == 0){ // not found
 			std::string hkey = encode_hash_key(name, key);
 			ssdb->binlogs->Put(hkey, slice(val));
-			ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey);
+			ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey, slice(val));
 			ret = 1;
 		}
 		else{
 			if (dbval != val){
 				std::string hkey = encode_hash_key(name, key);
 				ssdb->binlogs->Put(hkey, slice(val));
-				ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey);
+				ssdb->binlogs->add_log(log_type, BinlogCommand::HSET, hkey, slice(val));
 			}
 			ret = 0;
 		}
@@ -276,6 +396,9 @@ namespace lv
 
 	static int incr_hsize(LVDB_Impl *ssdb, const Bytes &name, int64_t incr){
 		int64_t size = ssdb->hsize(name);
+		if (size == -1){
+			return -1;
+		}
 		size += incr;
 		std::string size_key = encode_hsize_key(name);
 		if (size == 0){
@@ -6,7 +6,8 @@
 namespace lv
 {
 	int LVDB_Impl::multi_set(const std::vector<Bytes> &kvs, int offset, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::MULTI_SET);
+		Transaction trans(binlogs, kvs, offset, 2);
 
 		std::vector<Bytes>::const_iterator it;
 		it = kvs.begin() + offset;
@@ -20,7 +21,7 @@ namespace lv
 			const Bytes &val = *(it + 1);
 			std::string buf = encode_kv_key(key);
 			binlogs->Put(buf, slice(val));
-			binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+			binlogs->add_log(log_type, BinlogCommand::KSET, buf, slice(val));
 		}
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
@@ -31,7 +32,8 @@ namespace lv
 	}
 
 	int LVDB_Impl::multi_del(const std::vector<Bytes> &keys, int offset, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::MULTI_DEL);
+		Transaction trans(binlogs, keys, offset, 1);
 
 		std::vector<Bytes>::const_iterator it;
 		it = keys.begin() + offset;
@@ -50,16 +52,17 @@ namespace lv
 	}
 
 	int LVDB_Impl::set(const Bytes &key, const Bytes &val, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::SET);
 		if (key.empty()){
 			LOG_INFO("empty key!");
 			//return -1;
 			return 0;
 		}
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, key);
 
 		std::string buf = encode_kv_key(key);
 		binlogs->Put(buf, slice(val));
-		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::KSET, buf, slice(val));
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
 			LOG_INFO("set error: " << s.ToString().c_str());
@@ -69,12 +72,13 @@ namespace lv
 	}
 
 	int LVDB_Impl::setnx(const Bytes &key, const Bytes &val, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::SETNX);
 		if (key.empty()){
 			LOG_INFO("empty key!");
 			//return -1;
 			return 0;
 		}
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, key);
 
 		std::string tmp;
 		int found = this->get(key, &tmp);
@@ -83,7 +87,7 @@ namespace lv
 		}
 		std::string buf = encode_kv_key(key);
 		binlogs->Put(buf, slice(val));
-		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::KSET, buf, slice(val));
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
 			LOG_INFO("set error: " << s.ToString().c_str());
@@ -93,17 +97,18 @@ namespace lv
 	}
 
 	int LVDB_Impl::getset(const Bytes &key, std::string *val, const Bytes &newval, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::GETSET);
 		if (key.empty()){
 			LOG_INFO("empty key!");
 			//return -1;
 			return 0;
 		}
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, key);
 
 		int found = this->get(key, val);
 		std::string buf = encode_kv_key(key);
 		binlogs->Put(buf, slice(newval));
-		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::KSET, buf, slice(newval));
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
 			LOG_INFO("set error: " << s.ToString().c_str());
@@ -114,7 +119,8 @@ namespace lv
 
 
 	int LVDB_Impl::del(const Bytes &key, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::DEL);
+		Transaction trans(binlogs, key);
 
 		std::string buf = encode_kv_key(key);
 		binlogs->Delete(buf);
@@ -128,7 +134,8 @@ namespace lv
 	}
 
 	int LVDB_Impl::incr(const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::INCR);
+		Transaction trans(binlogs, key);
 
 		std::string old;
 		int ret = this->get(key, &old);
@@ -146,8 +153,9 @@ namespace lv
 		}
 
 		std::string buf = encode_kv_key(key);
-		binlogs->Put(buf, str(*new_val));
-		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+		std::string num = str(*new_val);
+		binlogs->Put(buf, num);
+		binlogs->add_log(log_type, BinlogCommand::KSET, buf, num);
 
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
@@ -158,9 +166,11 @@ namespace lv
 	}
 
 	int LVDB_Impl::get(const Bytes &key, std::string *val){
+		Op_Timer timer(op_stats, Op_Stats::GET);
 		std::string buf = encode_kv_key(key);
 
-		leveldb::Status s = ldb->Get(leveldb::ReadOptions(), buf, val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		leveldb::Status s = binlogs->Get(scope.options(), buf, val, true);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -171,7 +181,18 @@ namespace lv
 		return 1;
 	}
 
+	int LVDB_Impl::multi_get(const std::vector<Bytes> &keys, Multi_Values *vals, int offset){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_GET);
+		std::vector<std::string> bufs;
+		std::vector<Bytes>::const_iterator it;
+		for (it = keys.begin() + offset; it != keys.end(); it++){
+			bufs.push_back(encode_kv_key(*it));
+		}
+		return this->multi_read(bufs, vals);
+	}
+
 	KIterator* LVDB_Impl::scan(const Bytes &start, const Bytes &end, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::SCAN);
 		std::string key_start, key_end;
 		key_start = encode_kv_key(start);
 		if (end.empty()){
@@ -187,6 +208,7 @@ namespace lv
 	}
 
 	KIterator* LVDB_Impl::rscan(const Bytes &start, const Bytes &end, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::RSCAN);
 		std::string key_start, key_end;
 
 		key_start = encode_kv_key(start);
@@ -203,11 +225,12 @@ namespace lv
 	}
 
 	int LVDB_Impl::set_bit(const Bytes &key, int bitoffset, int on, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::SET_BIT);
 		if (key.empty()){
 			LOG_INFO("empty key!");
 			return 0;
 		}
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, key);
 
 		std::string val;
 		int ret = this->get(key, &val);
@@ -230,7 +253,7 @@ namespace lv
 
 		std::string buf = encode_kv_key(key);
 		binlogs->Put(buf, val);
-		binlogs->add_log(log_type, BinlogCommand::KSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::KSET, buf, val);
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
 			LOG_INFO("set error: " << s.ToString().c_str());
@@ -240,6 +263,7 @@ namespace lv
 	}
 
 	int LVDB_Impl::get_bit(const Bytes &key, int bitoffset){
+		Op_Timer timer(op_stats, Op_Stats::GET_BIT);
 		std::string val;
 		int ret = this->get(key, &val);
 		if (ret == -1){
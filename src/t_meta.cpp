@@ -7,7 +7,8 @@ namespace lv
 {
 	int LVDB_Impl::meta_set(const Bytes &key, const Bytes &val)
 	{
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::META_SET);
+		Transaction trans(binlogs, key);
 
 		std::string buf = encode_meta_key(key);
 		binlogs->Put(buf, slice(val));
@@ -22,7 +23,8 @@ namespace lv
 
 	int LVDB_Impl::meta_del(const Bytes &key)
 	{
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::META_DEL);
+		Transaction trans(binlogs, key);
 
 		std::string buf = encode_meta_key(key);
 		binlogs->Delete(buf);
@@ -37,8 +39,10 @@ namespace lv
 
 	int LVDB_Impl::meta_get(const Bytes &key, std::string *val)
 	{
+		Op_Timer timer(op_stats, Op_Stats::META_GET);
 		std::string buf = encode_meta_key(key);
-		leveldb::Status s = ldb->Get(leveldb::ReadOptions(), buf, val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		leveldb::Status s = binlogs->Get(scope.options(), buf, val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -51,6 +55,7 @@ namespace lv
 
 	int LVDB_Impl::meta_list(std::vector<std::string> *list)
 	{
+		Op_Timer timer(op_stats, Op_Stats::META_LIST);
 		std::string start;
 		std::string end;
 		start = encode_meta_key(LVDB::KeyMin);
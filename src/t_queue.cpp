@@ -6,11 +6,12 @@
 
 namespace lv
 {
-	static int qget_by_seq(leveldb::DB* db, const Bytes &name, uint64_t seq, std::string *val){
+	static int qget_by_seq(LVDB_Impl *ssdb, const Bytes &name, uint64_t seq, std::string *val){
 		std::string key = encode_qitem_key(name, seq);
 		leveldb::Status s;
 
-		s = db->Get(leveldb::ReadOptions(), key, val);
+		Read_Scope scope(ssdb->read_policy(ssdb->conf.point_read_policy));
+		s = ssdb->binlogs->Get(scope.options(), key, val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -23,10 +24,10 @@ namespace lv
 		}
 	}
 
-	static int qget_uint64(leveldb::DB* db, const Bytes &name, uint64_t seq, uint64_t *ret){
+	static int qget_uint64(LVDB_Impl *ssdb, const Bytes &name, uint64_t seq, uint64_t *ret){
 		std::string val;
 		*ret = 0;
-		int s = qget_by_seq(db, name, seq, &val);
+		int s = qget_by_seq(ssdb, name, seq, &val);
 		if (s == 1){
 			if (val.size() != sizeof(uint64_t)){
 				return -1;
@@ -72,11 +73,13 @@ namespace lv
 	/****************/
 
 	int64_t LVDB_Impl::qsize(const Bytes &name){
+		Op_Timer timer(op_stats, Op_Stats::QSIZE);
 		std::string key = encode_qsize_key(name);
 		std::string val;
 
 		leveldb::Status s;
-		s = ldb->Get(leveldb::ReadOptions(), key, &val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		s = binlogs->Get(scope.options(), key, &val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -92,45 +95,110 @@ namespace lv
 		}
 	}
 
+	int64_t LVDB_Impl::qclear(const Bytes &name, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QCLEAR);
+		// pop the items from the front batch by batch, so the queue is still
+		// valid between two batches, every batch but the last logs a
+		// QPOP_FRONT per item and the last one a single QCLEAR
+		std::string key_start = encode_qitem_key(name, QITEM_MIN_SEQ);
+		std::string key_end = encode_qitem_key(name, QITEM_MAX_SEQ);
+		Read_Hint hint(read_policy(conf.bulk_read_policy));
+		int64_t count = 0;
+		while (1){
+			Transaction trans(binlogs, name);
+			// the commits of this container still waiting for their group are
+			// not seen by the iterator
+			binlogs->wait_written();
+
+			int num = 0;
+			uint64_t seq = 0;
+			Iterator *it = this->iterator(key_start, key_end, SSDB_CLEAR_BATCH);
+			while (it->next()){
+				if (decode_qitem_key(it->key(), NULL, &seq) == -1){
+					continue;
+				}
+				binlogs->Delete(slice(it->key()));
+				num++;
+			}
+			delete it;
+
+			count += num;
+			bool done = num < SSDB_CLEAR_BATCH;
+			if (done){
+				binlogs->Delete(encode_qsize_key(name));
+				qdel_one(this, name, QFRONT_SEQ);
+				qdel_one(this, name, QBACK_SEQ);
+				if (count > 0){
+					binlogs->add_log(log_type, BinlogCommand::QCLEAR, name.String());
+				}
+			}
+			else{
+				int64_t size = incr_qsize(this, name, -num);
+				if (size == -1){
+					return -1;
+				}
+				if (size > 0){
+					seq++;
+					qset_one(this, name, QFRONT_SEQ, Bytes(&seq, sizeof(seq)));
+				}
+				for (int i = 0; i < num; i++){
+					binlogs->add_log(log_type, BinlogCommand::QPOP_FRONT, name.String());
+				}
+			}
+			leveldb::Status s = binlogs->commit();
+			if (!s.ok()){
+				LOG_ERROR("qclear error: " << s.ToString().c_str());
+				return -1;
+			}
+			if (done){
+				break;
+			}
+		}
+		return count;
+	}
+
 	// @return 0: empty queue, 1: item peeked, -1: error
 	int LVDB_Impl::qfront(const Bytes &name, std::string *item){
+		Op_Timer timer(op_stats, Op_Stats::QFRONT);
 		int ret = 0;
 		uint64_t seq;
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+		ret = qget_uint64(this, name, QFRONT_SEQ, &seq);
 		if (ret == -1){
 			return -1;
 		}
 		if (ret == 0){
 			return 0;
 		}
-		ret = qget_by_seq(this->ldb, name, seq, item);
+		ret = qget_by_seq(this, name, seq, item);
 		return ret;
 	}
 
 	// @return 0: empty queue, 1: item peeked, -1: error
 	int LVDB_Impl::qback(const Bytes &name, std::string *item){
+		Op_Timer timer(op_stats, Op_Stats::QBACK);
 		int ret = 0;
 		uint64_t seq;
-		ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+		ret = qget_uint64(this, name, QBACK_SEQ, &seq);
 		if (ret == -1){
 			return -1;
 		}
 		if (ret == 0){
 			return 0;
 		}
-		ret = qget_by_seq(this->ldb, name, seq, item);
+		ret = qget_by_seq(this, name, seq, item);
 		return ret;
 	}
 
 	int LVDB_Impl::qset_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::QSET_BY_SEQ);
+		Transaction trans(binlogs, name);
 		uint64_t min_seq, max_seq;
 		int ret;
 		int64_t size = this->qsize(name);
 		if (size == -1){
 			return -1;
 		}
-		ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &min_seq);
+		ret = qget_uint64(this, name, QFRONT_SEQ, &min_seq);
 		if (ret == -1){
 			return -1;
 		}
@@ -145,7 +213,60 @@ namespace lv
 		}
 
 		std::string buf = encode_qitem_key(name, seq);
-		binlogs->add_log(log_type, BinlogCommand::QSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::QSET, buf, slice(item));
+
+		leveldb::Status s = binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("Write error!");
+			return -1;
+		}
+		return 1;
+	}
+
+	int LVDB_Impl::qcopy_by_seq(const Bytes &name, uint64_t seq, const Bytes &item, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QSET_BY_SEQ);
+		Transaction trans(binlogs, name);
+		if (seq < QITEM_MIN_SEQ || seq > QITEM_MAX_SEQ){
+			return 0;
+		}
+		uint64_t front_seq, back_seq;
+		int ret = qget_uint64(this, name, QFRONT_SEQ, &front_seq);
+		if (ret == -1){
+			return -1;
+		}
+		if (ret == 1){
+			ret = qget_uint64(this, name, QBACK_SEQ, &back_seq);
+			if (ret == -1){
+				return -1;
+			}
+		}
+		char cmd = BinlogCommand::QSET;
+		int64_t incr = 0;
+		if (ret == 0){
+			// an empty queue starts at the first item copied
+			front_seq = back_seq = seq;
+			qset_one(this, name, QFRONT_SEQ, Bytes(&seq, sizeof(seq)));
+			qset_one(this, name, QBACK_SEQ, Bytes(&seq, sizeof(seq)));
+			cmd = BinlogCommand::QPUSH_BACK;
+			incr = 1;
+		}
+		else if (seq > back_seq){
+			qset_one(this, name, QBACK_SEQ, Bytes(&seq, sizeof(seq)));
+			cmd = BinlogCommand::QPUSH_BACK;
+			incr = (int64_t)(seq - back_seq);
+		}
+		else if (seq < front_seq){
+			qset_one(this, name, QFRONT_SEQ, Bytes(&seq, sizeof(seq)));
+			cmd = BinlogCommand::QPUSH_FRONT;
+			incr = (int64_t)(front_seq - seq);
+		}
+
+		qset_one(this, name, seq, item);
+		std::string buf = encode_qitem_key(name, seq);
+		binlogs->add_log(log_type, cmd, buf, slice(item));
+		if (incr && incr_qsize(this, name, incr) == -1){
+			return -1;
+		}
 
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
@@ -157,7 +278,8 @@ namespace lv
 
 	// return: 0: index out of range, -1: error, 1: ok
 	int LVDB_Impl::qset(const Bytes &name, int64_t index, const Bytes &item, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::QSET);
+		Transaction trans(binlogs, name);
 		int64_t size = this->qsize(name);
 		if (size == -1){
 			return -1;
@@ -169,11 +291,11 @@ namespace lv
 		int ret;
 		uint64_t seq;
 		if (index >= 0){
-			ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+			ret = qget_uint64(this, name, QFRONT_SEQ, &seq);
 			seq += index;
 		}
 		else{
-			ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+			ret = qget_uint64(this, name, QBACK_SEQ, &seq);
 			seq += index + 1;
 		}
 		if (ret == -1){
@@ -190,7 +312,7 @@ namespace lv
 
 		//log_info("qset %s %" PRIu64 "", hexmem(name.data(), name.size()).c_str(), seq);
 		std::string buf = encode_qitem_key(name, seq);
-		binlogs->add_log(log_type, BinlogCommand::QSET, buf);
+		binlogs->add_log(log_type, BinlogCommand::QSET, buf, slice(item));
 
 		leveldb::Status s = binlogs->commit();
 		if (!s.ok()){
@@ -201,12 +323,12 @@ namespace lv
 	}
 
 	int64_t LVDB_Impl::_qpush(const Bytes &name, const Bytes &item, uint64_t front_or_back_seq, char log_type){
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, name);
 
 		int ret;
 		// generate seq
 		uint64_t seq;
-		ret = qget_uint64(this->ldb, name, front_or_back_seq, &seq);
+		ret = qget_uint64(this, name, front_or_back_seq, &seq);
 		if (ret == -1){
 			return -1;
 		}
@@ -239,10 +361,10 @@ namespace lv
 
 		std::string buf = encode_qitem_key(name, seq);
 		if (front_or_back_seq == QFRONT_SEQ){
-			binlogs->add_log(log_type, BinlogCommand::QPUSH_FRONT, buf);
+			binlogs->add_log(log_type, BinlogCommand::QPUSH_FRONT, buf, slice(item));
 		}
 		else{
-			binlogs->add_log(log_type, BinlogCommand::QPUSH_BACK, buf);
+			binlogs->add_log(log_type, BinlogCommand::QPUSH_BACK, buf, slice(item));
 		}
 
 		// update size
@@ -260,19 +382,21 @@ namespace lv
 	}
 
 	int64_t LVDB_Impl::qpush_front(const Bytes &name, const Bytes &item, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QPUSH_FRONT);
 		return _qpush(name, item, QFRONT_SEQ, log_type);
 	}
 
 	int64_t LVDB_Impl::qpush_back(const Bytes &name, const Bytes &item, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QPUSH_BACK);
 		return _qpush(name, item, QBACK_SEQ, log_type);
 	}
 
 	int LVDB_Impl::_qpop(const Bytes &name, std::string *item, uint64_t front_or_back_seq, char log_type){
-		Transaction trans(binlogs);
+		Transaction trans(binlogs, name);
 
 		int ret;
 		uint64_t seq;
-		ret = qget_uint64(this->ldb, name, front_or_back_seq, &seq);
+		ret = qget_uint64(this, name, front_or_back_seq, &seq);
 		if (ret == -1){
 			return -1;
 		}
@@ -280,7 +404,7 @@ namespace lv
 			return 0;
 		}
 
-		ret = qget_by_seq(this->ldb, name, seq, item);
+		ret = qget_by_seq(this, name, seq, item);
 		if (ret == -1){
 			return -1;
 		}
@@ -327,10 +451,12 @@ namespace lv
 
 	// @return 0: empty queue, 1: item popped, -1: error
 	int LVDB_Impl::qpop_front(const Bytes &name, std::string *item, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QPOP_FRONT);
 		return _qpop(name, item, QFRONT_SEQ, log_type);
 	}
 
 	int LVDB_Impl::qpop_back(const Bytes &name, std::string *item, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::QPOP_BACK);
 		return _qpop(name, item, QBACK_SEQ, log_type);
 	}
 
@@ -351,6 +477,7 @@ namespace lv
 
 	int LVDB_Impl::qlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::QLIST);
 		std::string start;
 		std::string end;
 
@@ -367,6 +494,7 @@ namespace lv
 
 	int LVDB_Impl::qrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::QRLIST);
 		std::string start;
 		std::string end;
 
@@ -385,7 +513,9 @@ namespace lv
 	}
 
 	int LVDB_Impl::qfix(const Bytes &name){
+		Op_Timer timer(op_stats, Op_Stats::QFIX);
 		Transaction trans(binlogs);
+		binlogs->drain();
 		std::string key_s = encode_qitem_key(name, QITEM_MIN_SEQ - 1);
 		std::string key_e = encode_qitem_key(name, QITEM_MAX_SEQ);
 
@@ -436,11 +566,12 @@ namespace lv
 	int LVDB_Impl::qslice(const Bytes &name, int64_t begin, int64_t end,
 		std::vector<std::string> *list)
 	{
+		Op_Timer timer(op_stats, Op_Stats::QSLICE);
 		int ret;
 		uint64_t seq_begin, seq_end;
 		if (begin >= 0 && end >= 0){
 			uint64_t tmp_seq;
-			ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &tmp_seq);
+			ret = qget_uint64(this, name, QFRONT_SEQ, &tmp_seq);
 			if (ret != 1){
 				return ret;
 			}
@@ -449,7 +580,7 @@ namespace lv
 		}
 		else if (begin < 0 && end < 0){
 			uint64_t tmp_seq;
-			ret = qget_uint64(this->ldb, name, QBACK_SEQ, &tmp_seq);
+			ret = qget_uint64(this, name, QBACK_SEQ, &tmp_seq);
 			if (ret != 1){
 				return ret;
 			}
@@ -458,11 +589,11 @@ namespace lv
 		}
 		else{
 			uint64_t f_seq, b_seq;
-			ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &f_seq);
+			ret = qget_uint64(this, name, QFRONT_SEQ, &f_seq);
 			if (ret != 1){
 				return ret;
 			}
-			ret = qget_uint64(this->ldb, name, QBACK_SEQ, &b_seq);
+			ret = qget_uint64(this, name, QBACK_SEQ, &b_seq);
 			if (ret != 1){
 				return ret;
 			}
@@ -480,29 +611,38 @@ namespace lv
 			}
 		}
 
-		for (; seq_begin <= seq_end; seq_begin++){
-			std::string item;
-			ret = qget_by_seq(this->ldb, name, seq_begin, &item);
-			if (ret == -1){
-				return -1;
-			}
-			if (ret == 0){
-				return 0;
+		if (seq_begin > seq_end){
+			return 0;
+		}
+
+		// the item keys of a queue are ordered by seq, so the whole slice is
+		// one iterator range instead of a Get() per item
+		std::string key_start = encode_qitem_key(name, seq_begin);
+		std::string key_end = encode_qitem_key(name, seq_end);
+		Iterator *it = this->iterator(key_start, key_end, seq_end - seq_begin + 1);
+		while (it->next()){
+			uint64_t seq;
+			if (decode_qitem_key(it->key(), NULL, &seq) == -1 || seq != seq_begin){
+				// a hole in the queue, stop as reading by seq would
+				break;
 			}
-			list->push_back(item);
+			list->push_back(it->val().String());
+			seq_begin++;
 		}
+		delete it;
 		return 0;
 	}
 
 	int LVDB_Impl::qget(const Bytes &name, int64_t index, std::string *item){
+		Op_Timer timer(op_stats, Op_Stats::QGET);
 		int ret;
 		uint64_t seq;
 		if (index >= 0){
-			ret = qget_uint64(this->ldb, name, QFRONT_SEQ, &seq);
+			ret = qget_uint64(this, name, QFRONT_SEQ, &seq);
 			seq += index;
 		}
 		else{
-			ret = qget_uint64(this->ldb, name, QBACK_SEQ, &seq);
+			ret = qget_uint64(this, name, QBACK_SEQ, &seq);
 			seq += index + 1;
 		}
 		if (ret == -1){
@@ -512,7 +652,7 @@ namespace lv
 			return 0;
 		}
 
-		ret = qget_by_seq(this->ldb, name, seq, item);
+		ret = qget_by_seq(this, name, seq, item);
 		return ret;
 	}
 
@@ -1,5 +1,7 @@
 #include "lvdb_impl.h"
 #include <limits.h>
+#include <map>
+#include <set>
 #include "lvdb/t_zset.h"
 #include "toolkits/log.h"
 
@@ -9,53 +11,99 @@ namespace lv
 	static const char *SSDB_SCORE_MIN = "-9223372036854775808";
 	static const char *SSDB_SCORE_MAX = "+9223372036854775807";
 
-	static int zset_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type);
-	static int zdel_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, char log_type);
+	// the zrank index of a zset: its zscore keys are cut into blocks of about
+	// ZRANK_BLOCK_ITEMS items, each block a key counting the items from its
+	// first zscore key to the next block. A rank is the sum of the blocks
+	// before the item plus a scan inside its own block
+
+	// the zrank blocks of one zset written by a transaction
+	struct Zrank_Deltas
+	{
+		// -1: not looked up yet, 0: no index, 1: indexed
+		int indexed;
+		// block key => count delta
+		std::map<std::string, int64_t> blocks;
+		// blocks to split or fold once the transaction is committed
+		std::set<std::string> unbalanced;
+		// looks up the block of an item in db, see zrank_block()
+		leveldb::Iterator *it;
+
+		Zrank_Deltas() : indexed(-1), it(NULL){}
+		~Zrank_Deltas(){
+			delete it;
+		}
+	};
+
+	static inline bool has_prefix(const leveldb::Slice &key, const std::string &prefix){
+		return key.size() >= prefix.size() && memcmp(key.data(), prefix.data(), prefix.size()) == 0;
+	}
+
+	static int zset_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type, Zrank_Deltas *deltas);
+	static int zdel_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, char log_type, Zrank_Deltas *deltas);
 	static int incr_zsize(LVDB_Impl *ssdb, const Bytes &name, int64_t incr);
+	static int zrank_prepare(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas, bool rebuild);
+	static void zrank_add(Zrank_Deltas *deltas, const Bytes &name, const Bytes &key, const std::string &score, int64_t incr);
+	static int incr_zrank(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas);
+	static void zrank_balance(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas);
+	static int64_t zrank_by_index(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, int64_t *size);
+	static int zrank_seek(LVDB_Impl *ssdb, const Bytes &name, int64_t rank, std::string *zscore_key);
 
 	/**
 	 * @return -1: error, 0: item updated, 1: new item inserted
 	 */
 	int LVDB_Impl::zset(const Bytes &name, const Bytes &key, const Bytes &score, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::ZSET);
+		Transaction trans(binlogs, name);
 
-		int ret = zset_one(this, name, key, score, log_type);
+		Zrank_Deltas deltas;
+		int ret = zset_one(this, name, key, score, log_type, &deltas);
 		if (ret >= 0){
 			if (ret > 0){
 				if (incr_zsize(this, name, ret) == -1){
 					return -1;
 				}
 			}
+			if (incr_zrank(this, name, &deltas) == -1){
+				return -1;
+			}
 			leveldb::Status s = binlogs->commit();
 			if (!s.ok()){
 				LOG_ERROR("zset error: " << s.ToString().c_str());
 				return -1;
 			}
+			zrank_balance(this, name, &deltas);
 		}
 		return ret;
 	}
 
 	int LVDB_Impl::zdel(const Bytes &name, const Bytes &key, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::ZDEL);
+		Transaction trans(binlogs, name);
 
-		int ret = zdel_one(this, name, key, log_type);
+		Zrank_Deltas deltas;
+		int ret = zdel_one(this, name, key, log_type, &deltas);
 		if (ret >= 0){
 			if (ret > 0){
 				if (incr_zsize(this, name, -ret) == -1){
 					return -1;
 				}
 			}
+			if (incr_zrank(this, name, &deltas) == -1){
+				return -1;
+			}
 			leveldb::Status s = binlogs->commit();
 			if (!s.ok()){
 				LOG_ERROR("zdel error: " << s.ToString().c_str());
 				return -1;
 			}
+			zrank_balance(this, name, &deltas);
 		}
 		return ret;
 	}
 
 	int LVDB_Impl::zincr(const Bytes &name, const Bytes &key, int64_t by, int64_t *new_val, char log_type){
-		Transaction trans(binlogs);
+		Op_Timer timer(op_stats, Op_Stats::ZINCR);
+		Transaction trans(binlogs, name);
 
 		std::string old;
 		int ret = this->zget(name, key, &old);
@@ -69,7 +117,8 @@ namespace lv
 			*new_val = str_to_int64(old) + by;
 		}
 
-		ret = zset_one(this, name, key, str(*new_val), log_type);
+		Zrank_Deltas deltas;
+		ret = zset_one(this, name, key, str(*new_val), log_type, &deltas);
 		if (ret == -1){
 			return -1;
 		}
@@ -79,21 +128,100 @@ namespace lv
 					return -1;
 				}
 			}
+			if (incr_zrank(this, name, &deltas) == -1){
+				return -1;
+			}
 			leveldb::Status s = binlogs->commit();
 			if (!s.ok()){
 				LOG_ERROR("zset error: " << s.ToString().c_str());
 				return -1;
 			}
+			zrank_balance(this, name, &deltas);
 		}
 		return 1;
 	}
 
+	int LVDB_Impl::multi_zset(const Bytes &name, const std::vector<Bytes> &kvs, int offset, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_ZSET);
+		Transaction trans(binlogs, name);
+
+		// the reads of zset_one() don't see this batch, so a key given more
+		// than once is only set with its last score
+		std::map<Bytes, size_t> last;
+		for (size_t i = offset; i + 1 < kvs.size(); i += 2){
+			last[kvs[i]] = i;
+		}
+		Zrank_Deltas deltas;
+		int num = 0;
+		for (size_t i = offset; i + 1 < kvs.size(); i += 2){
+			if (last[kvs[i]] != i){
+				continue;
+			}
+			int ret = zset_one(this, name, kvs[i], kvs[i + 1], log_type, &deltas);
+			if (ret == -1){
+				return -1;
+			}
+			num += ret;
+		}
+		if (num > 0){
+			if (incr_zsize(this, name, num) == -1){
+				return -1;
+			}
+		}
+		if (incr_zrank(this, name, &deltas) == -1){
+			return -1;
+		}
+		leveldb::Status s = binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("multi_zset error: " << s.ToString().c_str());
+			return -1;
+		}
+		zrank_balance(this, name, &deltas);
+		return num;
+	}
+
+	int LVDB_Impl::multi_zdel(const Bytes &name, const std::vector<Bytes> &keys, int offset, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_ZDEL);
+		Transaction trans(binlogs, name);
+
+		std::set<Bytes> deleted;
+		Zrank_Deltas deltas;
+		int num = 0;
+		for (size_t i = offset; i < keys.size(); i++){
+			if (!deleted.insert(keys[i]).second){
+				continue;
+			}
+			int ret = zdel_one(this, name, keys[i], log_type, &deltas);
+			if (ret == -1){
+				return -1;
+			}
+			num += ret;
+		}
+		if (num > 0){
+			if (incr_zsize(this, name, -num) == -1){
+				return -1;
+			}
+		}
+		if (incr_zrank(this, name, &deltas) == -1){
+			return -1;
+		}
+		leveldb::Status s = binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("multi_zdel error: " << s.ToString().c_str());
+			return -1;
+		}
+		zrank_balance(this, name, &deltas);
+		return num;
+	}
+
 	int64_t LVDB_Impl::zsize(const Bytes &name){
+		Op_Timer timer(op_stats, Op_Stats::ZSIZE);
 		std::string size_key = encode_zsize_key(name);
 		std::string val;
 		leveldb::Status s;
 
-		s = ldb->Get(leveldb::ReadOptions(), size_key, &val);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		s = binlogs->Get(scope.options(), size_key, &val);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -109,9 +237,89 @@ namespace lv
 		}
 	}
 
+	int64_t LVDB_Impl::zclear(const Bytes &name, char log_type){
+		Op_Timer timer(op_stats, Op_Stats::ZCLEAR);
+		Read_Hint hint(read_policy(conf.bulk_read_policy));
+
+		// the zscore keys of one name share this prefix, taken in score order
+		// each batch also takes its items off the zrank index, so the index
+		// stays valid for the zsets in between and is dropped with the last,
+		// like hclear() every batch but the last logs a ZDEL per item
+		std::string prefix = encode_zscore_key(name, "", "0");
+		prefix.resize(2 + name.size());
+		int64_t count = 0;
+		while (1){
+			Transaction trans(binlogs, name);
+			// the commits of this container still waiting for their group are
+			// not seen by the iterator
+			binlogs->wait_written();
+
+			Zrank_Deltas deltas;
+			int indexed = zrank_prepare(this, name, &deltas, false);
+			if (indexed == -1){
+				return -1;
+			}
+			int num = 0;
+			std::vector<std::string> keys;
+			Iterator *it = this->iterator(prefix, "", SSDB_CLEAR_BATCH);
+			while (it->next()){
+				Bytes ks = it->key();
+				if (!has_prefix(slice(ks), prefix)){
+					break;
+				}
+				std::string name2, key, score;
+				if (decode_zscore_key(ks, &name2, &key, &score) == 0){
+					keys.push_back(encode_zset_key(name, key));
+					binlogs->Delete(keys.back());
+					if (indexed == 1){
+						zrank_add(&deltas, name, key, score, -1);
+					}
+				}
+				binlogs->Delete(slice(ks));
+				num++;
+			}
+			delete it;
+
+			if (num > 0){
+				if (incr_zsize(this, name, -num) == -1){
+					return -1;
+				}
+			}
+			if (incr_zrank(this, name, &deltas) == -1){
+				return -1;
+			}
+			count += num;
+			bool done = num < SSDB_CLEAR_BATCH;
+			if (done){
+				if (count > 0){
+					binlogs->add_log(log_type, BinlogCommand::ZCLEAR, slice(name));
+				}
+				// drops the index, of any layout, once the zset is empty
+				deltas.unbalanced.insert(encode_zrank_block(name, ""));
+			}
+			else{
+				for (size_t i = 0; i < keys.size(); i++){
+					binlogs->add_log(log_type, BinlogCommand::ZDEL, keys[i]);
+				}
+			}
+			leveldb::Status s = binlogs->commit();
+			if (!s.ok()){
+				LOG_ERROR("zclear error: " << s.ToString().c_str());
+				return -1;
+			}
+			zrank_balance(this, name, &deltas);
+			if (done){
+				break;
+			}
+		}
+		return count;
+	}
+
 	int LVDB_Impl::zget(const Bytes &name, const Bytes &key, std::string *score){
+		Op_Timer timer(op_stats, Op_Stats::ZGET);
 		std::string buf = encode_zset_key(name, key);
-		leveldb::Status s = ldb->Get(leveldb::ReadOptions(), buf, score);
+		Read_Scope scope(read_policy(conf.point_read_policy));
+		leveldb::Status s = binlogs->Get(scope.options(), buf, score, true);
 		if (s.IsNotFound()){
 			return 0;
 		}
@@ -122,6 +330,16 @@ namespace lv
 		return 1;
 	}
 
+	int LVDB_Impl::multi_zget(const Bytes &name, const std::vector<Bytes> &keys, Multi_Values *scores, int offset){
+		Op_Timer timer(op_stats, Op_Stats::MULTI_ZGET);
+		std::vector<std::string> bufs;
+		std::vector<Bytes>::const_iterator it;
+		for (it = keys.begin() + offset; it != keys.end(); it++){
+			bufs.push_back(encode_zset_key(name, *it));
+		}
+		return this->multi_read(bufs, scores);
+	}
+
 	static ZIterator* ziterator(
 		LVDB_Impl *ssdb,
 		const Bytes &name, const Bytes &key_start,
@@ -168,6 +386,19 @@ namespace lv
 	}
 
 	int64_t LVDB_Impl::zrank(const Bytes &name, const Bytes &key){
+		Op_Timer timer(op_stats, Op_Stats::ZRANK);
+		std::string score;
+		int found = this->zget(name, key, &score);
+		if (found != 1){
+			return -1;
+		}
+		int64_t size;
+		int64_t rank = zrank_by_index(this, name, key, &size);
+		if (rank >= 0){
+			return rank;
+		}
+
+		// no index for this zset, count from the front
 		ZIterator *it = ziterator(this, name, "", "", "", INT_MAX, Iterator::FORWARD);
 		uint64_t ret = 0;
 		while (true){
@@ -185,6 +416,19 @@ namespace lv
 	}
 
 	int64_t LVDB_Impl::zrrank(const Bytes &name, const Bytes &key){
+		Op_Timer timer(op_stats, Op_Stats::ZRRANK);
+		std::string score;
+		int found = this->zget(name, key, &score);
+		if (found != 1){
+			return -1;
+		}
+		int64_t size;
+		int64_t rank = zrank_by_index(this, name, key, &size);
+		if (rank >= 0){
+			return size - 1 - rank;
+		}
+
+		// no index for this zset, count from the back
 		ZIterator *it = ziterator(this, name, "", "", "", INT_MAX, Iterator::BACKWARD);
 		uint64_t ret = 0;
 		while (true){
@@ -202,6 +446,17 @@ namespace lv
 	}
 
 	ZIterator* LVDB_Impl::zrange(const Bytes &name, uint64_t offset, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::ZRANGE);
+		std::string start;
+		int found = (offset > 0 && offset < INT64_MAX)? zrank_seek(this, name, offset, &start) : -1;
+		if (found == 1){
+			std::string end = encode_zscore_key(name, "\xff", SSDB_SCORE_MAX);
+			return new ZIterator(this->iterator(start, end, limit), name);
+		}
+		if (found == 0){
+			// offset past the last item
+			return ziterator(this, name, "", "", "", 0, Iterator::FORWARD);
+		}
 		if (offset + limit > limit){
 			limit = offset + limit;
 		}
@@ -211,6 +466,17 @@ namespace lv
 	}
 
 	ZIterator* LVDB_Impl::zrrange(const Bytes &name, uint64_t offset, uint64_t limit){
+		Op_Timer timer(op_stats, Op_Stats::ZRRANGE);
+		std::string start;
+		int found = (offset > 0 && offset < INT64_MAX)? zrank_seek(this, name, -1 - (int64_t)offset, &start) : -1;
+		if (found == 1){
+			std::string end = encode_zscore_key(name, "", SSDB_SCORE_MIN);
+			return new ZIterator(this->rev_iterator(start, end, limit), name);
+		}
+		if (found == 0){
+			// offset past the first item
+			return ziterator(this, name, "", "", "", 0, Iterator::BACKWARD);
+		}
 		if (offset + limit > limit){
 			limit = offset + limit;
 		}
@@ -222,6 +488,7 @@ namespace lv
 	ZIterator* LVDB_Impl::zscan(const Bytes &name, const Bytes &key,
 		const Bytes &score_start, const Bytes &score_end, uint64_t limit)
 	{
+		Op_Timer timer(op_stats, Op_Stats::ZSCAN);
 		std::string score;
 		// if only key is specified, load its value
 		if (!key.empty() && score_start.empty()){
@@ -236,6 +503,7 @@ namespace lv
 	ZIterator* LVDB_Impl::zrscan(const Bytes &name, const Bytes &key,
 		const Bytes &score_start, const Bytes &score_end, uint64_t limit)
 	{
+		Op_Timer timer(op_stats, Op_Stats::ZRSCAN);
 		std::string score;
 		// if only key is specified, load its value
 		if (!key.empty() && score_start.empty()){
@@ -264,6 +532,7 @@ namespace lv
 
 	int LVDB_Impl::zlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::ZLIST);
 		std::string start;
 		std::string end;
 
@@ -280,6 +549,7 @@ namespace lv
 
 	int LVDB_Impl::zrlist(const Bytes &name_s, const Bytes &name_e, uint64_t limit,
 		std::vector<std::string> *list){
+		Op_Timer timer(op_stats, Op_Stats::ZRLIST);
 		std::string start;
 		std::string end;
 
@@ -302,8 +572,398 @@ namespace lv
 		return str(s);
 	}
 
+	// a counter of the zrank index, or the zsize, as of snapshot when given
+	static int64_t zrank_get(LVDB_Impl *ssdb, const std::string &rank_key, const leveldb::Snapshot *snapshot = NULL){
+		Read_Scope scope(ssdb->read_policy(ssdb->conf.point_read_policy));
+		leveldb::ReadOptions options = scope.options();
+		options.snapshot = snapshot;
+		std::string val;
+		leveldb::Status s = ssdb->binlogs->Get(options, rank_key, &val);
+		if (s.IsNotFound()){
+			return 0;
+		}
+		else if (!s.ok()){
+			return -1;
+		}
+		if (val.size() != sizeof(int64_t)){
+			return -1;
+		}
+		return *(int64_t *)val.data();
+	}
+
+	/**
+	 * whether the writes of a zset keep its zrank index. The first item
+	 * starts the index, a zset written without it, or with the layout of an
+	 * older version, is indexed again by its first write outside of a
+	 * batch when rebuild is set
+	 * @return -1: error, 0: no index, 1: indexed
+	 */
+	static int zrank_prepare(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas, bool rebuild){
+		if (deltas->indexed != -1){
+			return deltas->indexed;
+		}
+		deltas->indexed = 0;
+		if (!ssdb->conf.zset_rank_index){
+			return 0;
+		}
+		std::string root = encode_zrank_root(name);
+		std::string version;
+		Read_Scope scope(ssdb->read_policy(ssdb->conf.point_read_policy));
+		leveldb::Status s = ssdb->binlogs->Get(scope.options(), root, &version);
+		if (!s.ok() && !s.IsNotFound()){
+			return -1;
+		}
+		// the blocks are looked up in db, a commit of this zset waiting for
+		// its group may have split, folded or dropped them
+		deltas->it = ssdb->db_iterator();
+		deltas->it->Seek(root);
+		bool written = deltas->it->Valid() && deltas->it->key() == root;
+		if (s.ok() != written || (written && deltas->it->value() != version)){
+			ssdb->binlogs->wait_written();
+			delete deltas->it;
+			deltas->it = ssdb->db_iterator();
+		}
+		if (s.ok()){
+			deltas->indexed = 1;
+			return 1;
+		}
+
+		int64_t size = ssdb->zsize(name);
+		if (size == -1){
+			return -1;
+		}
+		if (size == 0){
+			int64_t one = 1, zero = 0;
+			ssdb->binlogs->Put(root, leveldb::Slice((char *)&one, sizeof(int64_t)));
+			ssdb->binlogs->Put(encode_zrank_block(name, ""), leveldb::Slice((char *)&zero, sizeof(int64_t)));
+			deltas->indexed = 1;
+			return 1;
+		}
+		if (!rebuild || ssdb->binlogs->in_batch()){
+			// the writes of a batch are not in db yet, a later write builds it
+			return 0;
+		}
+		ssdb->binlogs->wait_written();
+		if (ssdb->zrank_rebuild(name) == -1){
+			return 0;
+		}
+		delete deltas->it;
+		deltas->it = ssdb->db_iterator();
+		deltas->indexed = 1;
+		return 1;
+	}
+
+	// the block holding a zscore key, the last one starting at or before it
+	static std::string zrank_block(const Bytes &name, const std::string &zscore_key, Zrank_Deltas *deltas){
+		std::string first = encode_zrank_block(name, "");
+		std::string key = encode_zrank_block(name, zscore_key);
+		leveldb::Iterator *it = deltas->it;
+		it->Seek(key);
+		if (it->Valid() && it->key() == key){
+			return key;
+		}
+		if (it->Valid()){
+			it->Prev();
+		}
+		else{
+			it->SeekToLast();
+		}
+		if (it->Valid() && has_prefix(it->key(), first)){
+			return it->key().ToString();
+		}
+		// started by this transaction
+		return first;
+	}
+
+	static void zrank_add(Zrank_Deltas *deltas, const Bytes &name, const Bytes &key, const std::string &score, int64_t incr){
+		deltas->blocks[zrank_block(name, encode_zscore_key(name, key, score), deltas)] += incr;
+	}
+
+	static int incr_zrank(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas){
+		std::string first = encode_zrank_block(name, "");
+		std::map<std::string, int64_t>::const_iterator it;
+		for (it = deltas->blocks.begin(); it != deltas->blocks.end(); it++){
+			if (it->second == 0){
+				continue;
+			}
+			int64_t count = zrank_get(ssdb, it->first);
+			if (count == -1){
+				return -1;
+			}
+			count += it->second;
+			if (count < 0){
+				count = 0;
+			}
+			ssdb->binlogs->Put(it->first, leveldb::Slice((char *)&count, sizeof(int64_t)));
+			// the first block has none before it to fold into, once empty the
+			// zset may be
+			bool small = it->first == first ? count == 0 : count < ZRANK_BLOCK_ITEMS / 4;
+			if (small || count > 2 * ZRANK_BLOCK_ITEMS){
+				deltas->unbalanced.insert(it->first);
+			}
+		}
+		return 0;
+	}
+
+	// delete every key of the zrank index of a zset, of any layout
+	static void zrank_drop(LVDB_Impl *ssdb, const Bytes &name){
+		std::string prefix = encode_zrank_root(name);
+		prefix.resize(prefix.size() - 1);
+		leveldb::Iterator *it = ssdb->db_iterator();
+		for (it->Seek(prefix); it->Valid() && has_prefix(it->key(), prefix); it->Next()){
+			ssdb->binlogs->Delete(it->key());
+		}
+		delete it;
+	}
+
+	/**
+	 * after the commit of a transaction, in the same transaction: split the
+	 * blocks it made too large, fold the small ones into the block before
+	 * them and drop the index of an emptied zset. A rare write, so the
+	 * blocks stay bounded while a zset or zdel only updates the counters of
+	 * the blocks of its items
+	 */
+	static void zrank_balance(LVDB_Impl *ssdb, const Bytes &name, Zrank_Deltas *deltas){
+		if (deltas->unbalanced.empty() || ssdb->binlogs->in_batch()){
+			// the writes of a batch are not in db yet, a later write balances its blocks
+			return;
+		}
+		// the blocks and items are read from db, the stripe of the zset is
+		// held again and its commits so far are written
+		ssdb->binlogs->wait_written();
+		int64_t size = ssdb->zsize(name);
+		if (size == -1){
+			return;
+		}
+		if (size == 0){
+			zrank_drop(ssdb, name);
+		}
+
+		std::string first = encode_zrank_block(name, "");
+		std::string items = decode_zrank_block(name, first);
+		// the blocks written below and their counts, -1 for a folded one
+		std::map<std::string, int64_t> counts;
+		leveldb::Iterator *it = ssdb->db_iterator();
+		std::set<std::string>::const_iterator b;
+		for (b = deltas->unbalanced.begin(); size > 0 && b != deltas->unbalanced.end(); b++){
+			const std::string &block = *b;
+			if (counts.find(block) != counts.end()){
+				continue;
+			}
+			it->Seek(block);
+			if (!it->Valid() || it->key() != block || it->value().size() != sizeof(int64_t)){
+				// folded by the balance of another transaction
+				continue;
+			}
+			int64_t count = *(int64_t *)it->value().data();
+			if (count > 2 * ZRANK_BLOCK_ITEMS){
+				// a new block every ZRANK_BLOCK_ITEMS items, the last one
+				// keeps at least half as many
+				std::string cur = block;
+				int64_t cur_count = 0;
+				int64_t n = 0;
+				leveldb::Iterator *item = ssdb->db_iterator();
+				item->Seek(decode_zrank_block(name, block));
+				for (; item->Valid() && n < count && has_prefix(item->key(), items); item->Next(), n++){
+					if (cur_count == ZRANK_BLOCK_ITEMS && count - n >= ZRANK_BLOCK_ITEMS / 2){
+						counts[cur] = cur_count;
+						cur = encode_zrank_block(name, Bytes(item->key().data(), item->key().size()));
+						cur_count = 0;
+					}
+					cur_count++;
+				}
+				delete item;
+				counts[cur] = cur_count;
+			}
+			else if (block != first && count < ZRANK_BLOCK_ITEMS / 4){
+				it->Prev();
+				if (!it->Valid() || !has_prefix(it->key(), first) || it->value().size() != sizeof(int64_t)){
+					continue;
+				}
+				std::string prev = it->key().ToString();
+				int64_t prev_count = *(int64_t *)it->value().data();
+				// a block split above ends before this one
+				if (counts.find(prev) == counts.end() && prev_count + count <= ZRANK_BLOCK_ITEMS){
+					counts[prev] = prev_count + count;
+					counts[block] = -1;
+				}
+			}
+		}
+		delete it;
+
+		if (!counts.empty()){
+			std::map<std::string, int64_t>::const_iterator c;
+			for (c = counts.begin(); c != counts.end(); c++){
+				if (c->second == -1){
+					ssdb->binlogs->Delete(c->first);
+				}
+				else{
+					ssdb->binlogs->Put(c->first, leveldb::Slice((char *)&c->second, sizeof(int64_t)));
+				}
+			}
+			// the writers of this zset look the blocks up in db, until this
+			// is written they see another version and wait for it
+			std::string root = encode_zrank_root(name);
+			int64_t version = zrank_get(ssdb, root) + 1;
+			ssdb->binlogs->Put(root, leveldb::Slice((char *)&version, sizeof(int64_t)));
+		}
+		leveldb::Status s = ssdb->binlogs->commit();
+		if (!s.ok()){
+			LOG_ERROR("zrank balance error: " << s.ToString().c_str());
+		}
+	}
+
+	// @return the number of items ordered before key, -1 if the zset has no
+	// usable index or key is not in it
+	static int64_t zrank_by_index(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, int64_t *size){
+		if (!ssdb->conf.zset_rank_index){
+			return -1;
+		}
+		// every read below is made on one snapshot, a concurrent write is
+		// either counted in its block and the size or in neither
+		Read_Hint hint(ssdb->read_policy(ssdb->conf.scan_read_policy));
+		uint64_t seq;
+		const leveldb::Snapshot *snapshot = ssdb->get_snapshot(&seq);
+		int64_t rank = -1;
+		bool usable = false;
+		std::string score;
+		Read_Scope scope(ssdb->read_policy(ssdb->conf.point_read_policy));
+		leveldb::ReadOptions options = scope.options();
+		options.snapshot = snapshot;
+		*size = zrank_get(ssdb, encode_zsize_key(name), snapshot);
+		bool indexed = *size > 0 && zrank_get(ssdb, encode_zrank_root(name), snapshot) > 0;
+		usable = indexed;
+		if (indexed && ssdb->binlogs->Get(options, encode_zset_key(name, key), &score).ok()){
+			// the items of the blocks before the item's own one, and the
+			// total checked against the size
+			std::string zscore_key = encode_zscore_key(name, key, score);
+			std::string target = encode_zrank_block(name, zscore_key);
+			std::string first = encode_zrank_block(name, "");
+			std::string block;
+			int64_t before = 0;
+			int64_t total = 0;
+			Iterator *it = ssdb->iterator(first, "", UINT64_MAX, snapshot);
+			while (it->next()){
+				Bytes ks = it->key();
+				Bytes vs = it->val();
+				if (!has_prefix(slice(ks), first) || vs.size() != sizeof(int64_t)){
+					break;
+				}
+				if (ks.compare(target) <= 0){
+					block = ks.String();
+					before = total;
+				}
+				total += *(int64_t *)vs.data();
+			}
+			delete it;
+
+			// then the items of its block before it
+			usable = total == *size && !block.empty();
+			if (usable){
+				rank = before;
+				it = ssdb->iterator(decode_zrank_block(name, block), "", UINT64_MAX, snapshot);
+				while (it->next()){
+					if (it->key().compare(zscore_key) >= 0){
+						break;
+					}
+					rank++;
+				}
+				delete it;
+			}
+		}
+		ssdb->release_snapshot(snapshot);
+		if (!usable && *size > 0){
+			ssdb->zrank_fallback(name);
+		}
+		return rank;
+	}
+
+	// zrank_seek() on snapshot
+	static int zrank_walk(LVDB_Impl *ssdb, const Bytes &name, int64_t rank, const leveldb::Snapshot *snapshot, std::string *zscore_key){
+		int64_t size = zrank_get(ssdb, encode_zsize_key(name), snapshot);
+		if (size <= 0){
+			return 0;
+		}
+		if (zrank_get(ssdb, encode_zrank_root(name), snapshot) <= 0){
+			ssdb->zrank_fallback(name);
+			return -1;
+		}
+		if (rank < 0){
+			rank += size;
+		}
+		if (rank < 0 || rank >= size){
+			return 0;
+		}
+
+		// the block holding the rank-th item, the total is checked against the size
+		std::string first = encode_zrank_block(name, "");
+		std::string block;
+		int64_t total = 0;
+		Iterator *it = ssdb->iterator(first, "", UINT64_MAX, snapshot);
+		while (it->next()){
+			Bytes ks = it->key();
+			Bytes vs = it->val();
+			if (!has_prefix(slice(ks), first) || vs.size() != sizeof(int64_t)){
+				break;
+			}
+			int64_t count = *(int64_t *)vs.data();
+			if (block.empty() && rank < total + count){
+				block = ks.String();
+				rank -= total;
+			}
+			total += count;
+		}
+		delete it;
+		if (total != size || block.empty()){
+			ssdb->zrank_fallback(name);
+			return -1;
+		}
+
+		std::string items = decode_zrank_block(name, first);
+		it = ssdb->iterator(decode_zrank_block(name, block), "", rank + 1, snapshot);
+		int ret = -1;
+		while (it->next()){
+			if (rank-- == 0){
+				Bytes ks = it->key();
+				if (has_prefix(slice(ks), items)){
+					zscore_key->assign(ks.data(), ks.size());
+					ret = 1;
+				}
+				break;
+			}
+		}
+		delete it;
+		return ret;
+	}
+
+	/**
+	 * find the zscore key of the item at the given rank, summing the blocks
+	 * of the zrank index instead of iterating the items before it, a
+	 * negative rank counts from the back, -1 is the last item
+	 * @return -1: no index or error, 0: rank out of range, 1: found
+	 */
+	static int zrank_seek(LVDB_Impl *ssdb, const Bytes &name, int64_t rank, std::string *zscore_key){
+		if (!ssdb->conf.zset_rank_index){
+			return -1;
+		}
+		// the blocks and the items are read from one snapshot, as in zrank_by_index()
+		Read_Hint hint(ssdb->read_policy(ssdb->conf.scan_read_policy));
+		uint64_t seq;
+		const leveldb::Snapshot *snapshot = ssdb->get_snapshot(&seq);
+		int ret = zrank_walk(ssdb, name, rank, snapshot, zscore_key);
+		ssdb->release_snapshot(snapshot);
+		return ret;
+	}
+
+	void LVDB_Impl::zrank_fallback(const Bytes &name){
+		std::lock_guard<std::mutex> lock(zrank_mutex);
+		if (zrank_fallbacks.insert(name.String()).second){
+			LOG_WARN("zset " << hexmem(name.data(), name.size()) << " has no usable zrank index, its ranks are counted item by item until its next write or zfix");
+		}
+	}
+
 	// returns the number of newly added items
-	static int zset_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type){
+	static int zset_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, const Bytes &score, char log_type, Zrank_Deltas *deltas){
 		if (name.empty() || key.empty()){
 			LOG_ERROR("empty name or key!");
 			return 0;
@@ -322,11 +982,21 @@ namespace lv
 		int found = ssdb->zget(name, key, &old_score);
 		if (found == 0 || old_score != new_score){
 			std::string k0, k1, k2;
+			int indexed = zrank_prepare(ssdb, name, deltas, true);
+			if (indexed == -1){
+				return -1;
+			}
 
 			if (found){
 				// delete zscore key
 				k1 = encode_zscore_key(name, key, old_score);
 				ssdb->binlogs->Delete(k1);
+				if (indexed == 1){
+					zrank_add(deltas, name, key, old_score, -1);
+				}
+			}
+			if (indexed == 1){
+				zrank_add(deltas, name, key, new_score, +1);
 			}
 
 			// add zscore key
@@ -336,14 +1006,14 @@ namespace lv
 			// update zset
 			k0 = encode_zset_key(name, key);
 			ssdb->binlogs->Put(k0, new_score);
-			ssdb->binlogs->add_log(log_type, BinlogCommand::ZSET, k0);
+			ssdb->binlogs->add_log(log_type, BinlogCommand::ZSET, k0, new_score);
 
 			return found ? 0 : 1;
 		}
 		return 0;
 	}
 
-	static int zdel_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, char log_type){
+	static int zdel_one(LVDB_Impl *ssdb, const Bytes &name, const Bytes &key, char log_type, Zrank_Deltas *deltas){
 		if (name.size() > SSDB_KEY_LEN_MAX){
 			LOG_ERROR("name too long!");
 			return -1;
@@ -362,6 +1032,13 @@ namespace lv
 		// delete zscore key
 		k1 = encode_zscore_key(name, key, old_score);
 		ssdb->binlogs->Delete(k1);
+		int indexed = zrank_prepare(ssdb, name, deltas, true);
+		if (indexed == -1){
+			return -1;
+		}
+		if (indexed == 1){
+			zrank_add(deltas, name, key, old_score, -1);
+		}
 
 		// delete zset
 		k0 = encode_zset_key(name, key);
@@ -373,6 +1050,9 @@ namespace lv
 
 	static int incr_zsize(LVDB_Impl *ssdb, const Bytes &name, int64_t incr){
 		int64_t size = ssdb->zsize(name);
+		if (size == -1){
+			return -1;
+		}
 		size += incr;
 		std::string size_key = encode_zsize_key(name);
 		if (size == 0){
@@ -384,8 +1064,73 @@ namespace lv
 		return 0;
 	}
 
+	int LVDB_Impl::zrank_rebuild(const Bytes &name){
+		leveldb::WriteBatch batch;
+		leveldb::Status s;
+		int num = 0;
+		leveldb::Iterator *it = this->db_iterator();
+
+		// every layout of the index starts with the type and name
+		std::string prefix = encode_zrank_root(name);
+		prefix.resize(prefix.size() - 1);
+		for (it->Seek(prefix); s.ok() && it->Valid() && has_prefix(it->key(), prefix); it->Next()){
+			batch.Delete(it->key());
+			if (++num % SSDB_CLEAR_BATCH == 0){
+				s = ldb->Write(leveldb::WriteOptions(), &batch);
+				batch.Clear();
+			}
+		}
+
+		// a block every ZRANK_BLOCK_ITEMS zscore keys, the first one starts
+		// with an empty key
+		std::string block = encode_zrank_block(name, "");
+		std::string items = decode_zrank_block(name, block);
+		int64_t count = 0;
+		int64_t size = 0;
+		int64_t blocks = 0;
+		for (it->Seek(items); s.ok() && it->Valid() && has_prefix(it->key(), items); it->Next()){
+			if (count == ZRANK_BLOCK_ITEMS){
+				batch.Put(block, leveldb::Slice((char *)&count, sizeof(int64_t)));
+				blocks++;
+				block = encode_zrank_block(name, Bytes(it->key().data(), it->key().size()));
+				count = 0;
+				if (blocks % SSDB_CLEAR_BATCH == 0){
+					s = ldb->Write(leveldb::WriteOptions(), &batch);
+					batch.Clear();
+				}
+			}
+			count++;
+			size++;
+		}
+		delete it;
+		if (size > 0){
+			batch.Put(block, leveldb::Slice((char *)&count, sizeof(int64_t)));
+			blocks++;
+			// last, an index stopped before it is built again
+			int64_t version = 1;
+			batch.Put(encode_zrank_root(name), leveldb::Slice((char *)&version, sizeof(int64_t)));
+		}
+		if (s.ok()){
+			s = ldb->Write(leveldb::WriteOptions(), &batch);
+		}
+		binlogs->touch();
+		if (!s.ok()){
+			LOG_ERROR("zrank rebuild error: " << s.ToString().c_str());
+			return -1;
+		}
+		LOG_INFO("build zrank index, name: " << hexmem(name.data(), name.size()) << ", " << size << " items in " << blocks << " blocks");
+		std::lock_guard<std::mutex> lock(zrank_mutex);
+		zrank_fallbacks.erase(name.String());
+		return 0;
+	}
+
 	int64_t LVDB_Impl::zfix(const Bytes &name){
+		Op_Timer timer(op_stats, Op_Stats::ZFIX);
 		Transaction trans(binlogs);
+		binlogs->drain();
+		// a whole pass over the zset, read like the clears
+		Read_Hint hint(read_policy(conf.bulk_read_policy));
+		Read_Scope scope(read_policy(conf.point_read_policy));
 		std::string it_start, it_end;
 		Iterator *it;
 		leveldb::Status s;
@@ -416,7 +1161,7 @@ namespace lv
 
 			std::string buf = encode_zset_key(name, key);
 			std::string score2;
-			s = ldb->Get(leveldb::ReadOptions(), buf, &score2);
+			s = ldb->Get(scope.options(), buf, &score2);
 			if (!s.ok() && !s.IsNotFound()){
 				LOG_ERROR("zget error: " << s.ToString().c_str());
 				size = -1;
@@ -434,6 +1179,8 @@ namespace lv
 			}
 		}
 		delete it;
+		// the fixes are written around the transactions
+		binlogs->touch();
 		if (size == -1){
 			return -1;
 		}
@@ -451,6 +1198,7 @@ namespace lv
 			else{
 				s = ldb->Put(leveldb::WriteOptions(), size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
 			}
+			binlogs->touch();
 		}
 
 		//////////////////////////////////////////
@@ -480,7 +1228,7 @@ namespace lv
 
 			std::string buf = encode_zscore_key(name, key, score);
 			std::string score2;
-			s = ldb->Get(leveldb::ReadOptions(), buf, &score2);
+			s = ldb->Get(scope.options(), buf, &score2);
 			if (!s.ok() && !s.IsNotFound()){
 				LOG_ERROR("zget error: " << s.ToString().c_str());
 				size = -1;
@@ -498,6 +1246,7 @@ namespace lv
 			}
 		}
 		delete it;
+		binlogs->touch();
 		if (size == -1){
 			return -1;
 		}
@@ -515,10 +1264,14 @@ namespace lv
 			else{
 				s = ldb->Put(leveldb::WriteOptions(), size_key, leveldb::Slice((char *)&size, sizeof(int64_t)));
 			}
+			binlogs->touch();
 		}
 
 		//////////////////////////////////////////
 
+		if (this->conf.zset_rank_index && this->zrank_rebuild(name) == -1){
+			return -1;
+		}
 		return size;
 	}
 
@@ -0,0 +1,179 @@
+#include "value_cache.h"
+#include "lvdb/strings.h"
+#include <algorithm>
+
+
+namespace lv
+{
+	Value_Cache::Value_Cache(size_t budget){
+		this->shard_budget = std::max<size_t>(budget / SHARDS, 1);
+		this->hits = 0;
+		this->misses = 0;
+		this->evictions = 0;
+		for (int i = 0; i < SHARDS; i++){
+			pthread_mutex_init(&shards[i].mutex, NULL);
+			shards[i].hand = shards[i].ring.end();
+			shards[i].used = 0;
+			shards[i].next_lease = 0;
+		}
+	}
+
+	Value_Cache::~Value_Cache(){
+		for (int i = 0; i < SHARDS; i++){
+			pthread_mutex_destroy(&shards[i].mutex);
+		}
+	}
+
+	Value_Cache::Shard& Value_Cache::shard(const leveldb::Slice &key){
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < key.size(); i++){
+			h ^= (uint8_t)key.data()[i];
+			h *= 16777619u;
+		}
+		return shards[h % SHARDS];
+	}
+
+	size_t Value_Cache::charge(const std::string &key, const std::string &val){
+		// the map node, the ring node and the two strings
+		return key.size() * 2 + val.size() + 96;
+	}
+
+	void Value_Cache::remove(Shard &s, std::unordered_map<std::string, Entry>::iterator it){
+		if (s.hand == it->second.pos){
+			++s.hand;
+		}
+		s.ring.erase(it->second.pos);
+		s.used -= charge(it->first, it->second.val);
+		s.entries.erase(it);
+	}
+
+	void Value_Cache::evict(Shard &s){
+		size_t steps = s.ring.size() * 2 + 1;
+		while (s.used > shard_budget && !s.ring.empty() && steps-- > 0){
+			if (s.hand == s.ring.end()){
+				s.hand = s.ring.begin();
+			}
+			std::unordered_map<std::string, Entry>::iterator it = s.entries.find(*s.hand);
+			Entry &e = it->second;
+			// a leased entry is left to its reader
+			if (e.referenced || e.lease != 0){
+				e.referenced = false;
+				++s.hand;
+				continue;
+			}
+			remove(s, it);
+			evictions++;
+		}
+	}
+
+	int Value_Cache::get(const leveldb::Slice &key, std::string *val, uint64_t *lease){
+		Shard &s = shard(key);
+		std::string k = key.ToString();
+		*lease = 0;
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(k);
+		if (it != s.entries.end() && it->second.lease == 0){
+			it->second.referenced = true;
+			val->assign(it->second.val);
+			pthread_mutex_unlock(&s.mutex);
+			hits++;
+			return 1;
+		}
+		// an other reader is filling it otherwise
+		if (it == s.entries.end()){
+			Entry e;
+			e.lease = ++s.next_lease;
+			e.referenced = false;
+			// just behind the hand, the last entry it will look at
+			e.pos = s.ring.insert(s.hand, k);
+			s.used += charge(k, e.val);
+			s.entries.insert(std::make_pair(k, e));
+			*lease = e.lease;
+		}
+		pthread_mutex_unlock(&s.mutex);
+		misses++;
+		return 0;
+	}
+
+	void Value_Cache::fill(const leveldb::Slice &key, const leveldb::Slice &val, uint64_t lease){
+		Shard &s = shard(key);
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(key.ToString());
+		if (it != s.entries.end() && it->second.lease == lease){
+			s.used -= charge(it->first, it->second.val);
+			it->second.val.assign(val.data(), val.size());
+			it->second.lease = 0;
+			s.used += charge(it->first, it->second.val);
+			evict(s);
+		}
+		pthread_mutex_unlock(&s.mutex);
+	}
+
+	void Value_Cache::cancel(const leveldb::Slice &key, uint64_t lease){
+		Shard &s = shard(key);
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(key.ToString());
+		if (it != s.entries.end() && it->second.lease == lease){
+			remove(s, it);
+		}
+		pthread_mutex_unlock(&s.mutex);
+	}
+
+	void Value_Cache::update(const leveldb::Slice &key, const leveldb::Slice &val){
+		Shard &s = shard(key);
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(key.ToString());
+		if (it != s.entries.end()){
+			// a pending fill() of an older value is dropped with the lease
+			s.used -= charge(it->first, it->second.val);
+			it->second.val.assign(val.data(), val.size());
+			it->second.lease = 0;
+			s.used += charge(it->first, it->second.val);
+			evict(s);
+		}
+		pthread_mutex_unlock(&s.mutex);
+	}
+
+	void Value_Cache::erase(const leveldb::Slice &key){
+		Shard &s = shard(key);
+		pthread_mutex_lock(&s.mutex);
+		std::unordered_map<std::string, Entry>::iterator it = s.entries.find(key.ToString());
+		if (it != s.entries.end()){
+			remove(s, it);
+		}
+		pthread_mutex_unlock(&s.mutex);
+	}
+
+	void Value_Cache::clear(){
+		for (int i = 0; i < SHARDS; i++){
+			Shard &s = shards[i];
+			pthread_mutex_lock(&s.mutex);
+			s.entries.clear();
+			s.ring.clear();
+			s.hand = s.ring.end();
+			s.used = 0;
+			pthread_mutex_unlock(&s.mutex);
+		}
+	}
+
+	std::string Value_Cache::stats() const{
+		size_t entries = 0;
+		size_t used = 0;
+		for (int i = 0; i < SHARDS; i++){
+			Shard &s = const_cast<Shard &>(shards[i]);
+			pthread_mutex_lock(&s.mutex);
+			entries += s.entries.size();
+			used += s.used;
+			pthread_mutex_unlock(&s.mutex);
+		}
+		std::string s;
+		s.append("    entries  : " + str((uint64_t)entries) + "\n");
+		s.append("    bytes    : " + str((uint64_t)used) + "\n");
+		s.append("    hits     : " + str((uint64_t)hits) + "\n");
+		s.append("    misses   : " + str((uint64_t)misses) + "\n");
+		s.append("    evictions: " + str((uint64_t)evictions) + "");
+		return s;
+	}
+
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "pthread.h"
+#include "leveldb/slice.h"
+
+
+namespace lv
+{
+	// values of the hot keys read by get, hget and zget, by encoded key
+	//
+	// Each shard evicts with CLOCK: a hit marks the entry, and the hand
+	// drops the first unmarked entry once the shard is over its share of
+	// the memory budget. Binlog_Queue updates the cached values when a
+	// transaction is handed to a group commit. A miss takes a lease on the
+	// key before reading the db, and the value read is only cached if no
+	// commit of the key came in between, so a slow reader never caches a
+	// value older than the last commit.
+	class Value_Cache
+	{
+	public:
+		// budget in bytes, keys and values with some overhead each
+		Value_Cache(size_t budget);
+		~Value_Cache();
+
+		// 1: hit, 0: miss, with a lease to fill() or cancel() when *lease != 0
+		int get(const leveldb::Slice &key, std::string *val, uint64_t *lease);
+		void fill(const leveldb::Slice &key, const leveldb::Slice &val, uint64_t lease);
+		void cancel(const leveldb::Slice &key, uint64_t lease);
+
+		// a committed write, only the cached or leased keys are touched
+		void update(const leveldb::Slice &key, const leveldb::Slice &val);
+		void erase(const leveldb::Slice &key);
+		void clear();
+
+		std::string stats() const;
+
+	private:
+		static const int SHARDS = 16;
+
+		struct Entry
+		{
+			std::string val;
+			// the reader filling this entry, 0 once it holds a value
+			uint64_t lease;
+			bool referenced;
+			std::list<std::string>::iterator pos;
+		};
+
+		struct Shard
+		{
+			pthread_mutex_t mutex;
+			std::unordered_map<std::string, Entry> entries;
+			// the clock, the hand points to the next entry to look at
+			std::list<std::string> ring;
+			std::list<std::string>::iterator hand;
+			size_t used;
+			uint64_t next_lease;
+		};
+
+		size_t shard_budget;
+		Shard shards[SHARDS];
+		std::atomic<uint64_t> hits;
+		std::atomic<uint64_t> misses;
+		std::atomic<uint64_t> evictions;
+
+		Shard& shard(const leveldb::Slice &key);
+		static size_t charge(const std::string &key, const std::string &val);
+		// caller holds s.mutex
+		void remove(Shard &s, std::unordered_map<std::string, Entry>::iterator it);
+		void evict(Shard &s);
+	};
+
+
+}
@@ -0,0 +1,448 @@
+// db_bench style workloads for the LVDB operates
+//
+//   lvdb_bench [--name=value ...]
+//
+//   --benchmarks   comma separated list of the workloads to run, in order
+//   --db           directory of the db, flushed before the first workload
+//   --num          number of keys, and of ops of the write workloads
+//   --reads        number of ops of the read workloads, --num by default
+//   --threads      threads running each workload
+//   --value_size   bytes of each value
+//   --containers   hashes, zsets and queues the fan-out workloads spread over
+//   --scan_limit   items read by each scan
+//   --read_ratio   percent of gets in the mixed workload
+//   --shards, --value_cache, --size_cache   as in lv::Options
+//
+// Each workload prints one line of name=value fields, ops_per_sec and the
+// latency percentiles in microseconds, so the runs can be diffed or
+// parsed by a script.
+#include "lvdb/lvdb.h"
+#include "lvdb/bytes.h"
+#include "lvdb/strings.h"
+#include "pthread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const char *FLAGS_benchmarks =
+		"fillseq,fillrandom,readrandom,readhot,multiget,incr,scan,"
+		"hset,hget,hscan,zset,zget,zrank,zrange,zscan,qpush,qpop,mixed";
+	std::string FLAGS_db = "lvdb_bench/";
+	int64_t FLAGS_num = 100000;
+	int64_t FLAGS_reads = -1;
+	int FLAGS_threads = 1;
+	int FLAGS_value_size = 100;
+	int FLAGS_containers = 100;
+	int FLAGS_scan_limit = 100;
+	int FLAGS_read_ratio = 90;
+	int FLAGS_shards = 1;
+	int FLAGS_value_cache = 0;
+	int FLAGS_size_cache = 100000;
+
+	// xorshift64*, one for each thread so the workloads don't share a lock
+	class Random
+	{
+	public:
+		Random(uint64_t seed){
+			state = seed * 2654435761u + 1;
+		}
+		uint64_t next(){
+			state ^= state >> 12;
+			state ^= state << 25;
+			state ^= state >> 27;
+			return state * 2685821657736338717ull;
+		}
+		uint64_t uniform(uint64_t n){
+			return n ? next() % n : 0;
+		}
+	private:
+		uint64_t state;
+	};
+
+	struct Thread_State
+	{
+		lv::LVDB *db;
+		int id;
+		// the ops of this thread are [begin, end) of the workload
+		int64_t begin;
+		int64_t end;
+		Random rnd;
+		std::string value;
+		// latency of each op in ns
+		std::vector<int64_t> latencies;
+		// items read by the scans, or keys found by the reads
+		int64_t found;
+
+		Thread_State(int id) : rnd(id + 1){
+			this->id = id;
+			this->found = 0;
+		}
+	};
+
+	std::string key_of(int64_t i){
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%016lld", (long long)i);
+		return std::string(buf);
+	}
+
+	std::string container_of(const char *type, int64_t i){
+		char buf[32];
+		snprintf(buf, sizeof(buf), "%s%06lld", type, (long long)(i % FLAGS_containers));
+		return std::string(buf);
+	}
+
+	int64_t random_key(Thread_State *t){
+		return (int64_t)t->rnd.uniform(FLAGS_num);
+	}
+
+	/* the ops, i is the index of the op in the workload */
+
+	void op_fillseq(Thread_State *t, int64_t i){
+		t->db->set(key_of(i), t->value);
+	}
+
+	void op_fillrandom(Thread_State *t, int64_t i){
+		t->db->set(key_of(random_key(t)), t->value);
+	}
+
+	void op_readrandom(Thread_State *t, int64_t i){
+		std::string val;
+		if (t->db->get(key_of(random_key(t)), &val) == 1){
+			t->found++;
+		}
+	}
+
+	// 1% of the keys take all the reads
+	void op_readhot(Thread_State *t, int64_t i){
+		std::string val;
+		if (t->db->get(key_of(t->rnd.uniform(FLAGS_num / 100 + 1)), &val) == 1){
+			t->found++;
+		}
+	}
+
+	void op_multiget(Thread_State *t, int64_t i){
+		std::vector<std::string> keys;
+		for (int j = 0; j < 16; j++){
+			keys.push_back(key_of(random_key(t)));
+		}
+		std::vector<lv::Bytes> req(keys.begin(), keys.end());
+		lv::Multi_Values vals;
+		int ret = t->db->multi_get(req, &vals);
+		if (ret > 0){
+			t->found += ret;
+		}
+	}
+
+	void op_incr(Thread_State *t, int64_t i){
+		int64_t new_val;
+		t->db->incr(container_of("counter", t->rnd.next()), 1, &new_val);
+	}
+
+	void op_scan(Thread_State *t, int64_t i){
+		lv::KIterator *it = t->db->scan(key_of(random_key(t)), "", FLAGS_scan_limit);
+		while (it->next()){
+			t->found++;
+		}
+		it->release();
+	}
+
+	void op_hset(Thread_State *t, int64_t i){
+		t->db->hset(container_of("h", i), key_of(i), t->value);
+	}
+
+	void op_hget(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		std::string val;
+		if (t->db->hget(container_of("h", k), key_of(k), &val) == 1){
+			t->found++;
+		}
+	}
+
+	void op_hscan(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		lv::HIterator *it = t->db->hscan(container_of("h", k), key_of(k), "", FLAGS_scan_limit);
+		while (it->next()){
+			t->found++;
+		}
+		it->release();
+	}
+
+	void op_zset(Thread_State *t, int64_t i){
+		t->db->zset(container_of("z", i), key_of(i), lv::str((int64_t)t->rnd.uniform(1000000)));
+	}
+
+	void op_zget(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		std::string score;
+		if (t->db->zget(container_of("z", k), key_of(k), &score) == 1){
+			t->found++;
+		}
+	}
+
+	void op_zrank(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		if (t->db->zrank(container_of("z", k), key_of(k)) >= 0){
+			t->found++;
+		}
+	}
+
+	void op_zrange(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		uint64_t offset = t->rnd.uniform(FLAGS_num / FLAGS_containers + 1);
+		lv::ZIterator *it = t->db->zrange(container_of("z", k), offset, FLAGS_scan_limit);
+		while (it->next()){
+			t->found++;
+		}
+		it->release();
+	}
+
+	void op_zscan(Thread_State *t, int64_t i){
+		int64_t k = random_key(t);
+		std::string score = lv::str((int64_t)t->rnd.uniform(1000000));
+		lv::ZIterator *it = t->db->zscan(container_of("z", k), "", score, "", FLAGS_scan_limit);
+		while (it->next()){
+			t->found++;
+		}
+		it->release();
+	}
+
+	void op_qpush(Thread_State *t, int64_t i){
+		t->db->qpush_back(container_of("q", i), t->value);
+	}
+
+	void op_qpop(Thread_State *t, int64_t i){
+		std::string item;
+		if (t->db->qpop_front(container_of("q", i), &item) == 1){
+			t->found++;
+		}
+	}
+
+	void op_mixed(Thread_State *t, int64_t i){
+		if ((int)t->rnd.uniform(100) < FLAGS_read_ratio){
+			op_readrandom(t, i);
+		}
+		else{
+			op_fillrandom(t, i);
+		}
+	}
+
+	struct Benchmark
+	{
+		const char *name;
+		void (*op)(Thread_State *t, int64_t i);
+		// reads run --reads ops, writes --num
+		bool reads;
+	};
+
+	const Benchmark benchmarks[] = {
+		{"fillseq", op_fillseq, false},
+		{"fillrandom", op_fillrandom, false},
+		{"readrandom", op_readrandom, true},
+		{"readhot", op_readhot, true},
+		{"multiget", op_multiget, true},
+		{"incr", op_incr, false},
+		{"scan", op_scan, true},
+		{"hset", op_hset, false},
+		{"hget", op_hget, true},
+		{"hscan", op_hscan, true},
+		{"zset", op_zset, false},
+		{"zget", op_zget, true},
+		{"zrank", op_zrank, true},
+		{"zrange", op_zrange, true},
+		{"zscan", op_zscan, true},
+		{"qpush", op_qpush, false},
+		{"qpop", op_qpop, false},
+		{"mixed", op_mixed, true},
+	};
+
+	struct Thread_Arg
+	{
+		Thread_State *state;
+		const Benchmark *bench;
+	};
+
+	int64_t now_ns(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void* run_thread(void *arg){
+		Thread_Arg *a = (Thread_Arg *)arg;
+		Thread_State *t = a->state;
+		t->latencies.reserve(t->end - t->begin);
+		for (int64_t i = t->begin; i < t->end; i++){
+			int64_t start = now_ns();
+			a->bench->op(t, i);
+			t->latencies.push_back(now_ns() - start);
+		}
+		return NULL;
+	}
+
+	double percentile_us(const std::vector<int64_t> &sorted, double p){
+		if (sorted.empty()){
+			return 0;
+		}
+		size_t i = std::min(sorted.size() - 1, (size_t)(sorted.size() * p));
+		return sorted[i] / 1000.0;
+	}
+
+	void run(lv::LVDB *db, const Benchmark *bench){
+		int64_t ops = (bench->reads && FLAGS_reads >= 0) ? FLAGS_reads : FLAGS_num;
+		std::vector<Thread_State*> states;
+		std::vector<Thread_Arg> args(FLAGS_threads);
+		std::vector<pthread_t> tids(FLAGS_threads);
+		for (int i = 0; i < FLAGS_threads; i++){
+			Thread_State *t = new Thread_State(i);
+			t->db = db;
+			t->begin = ops * i / FLAGS_threads;
+			t->end = ops * (i + 1) / FLAGS_threads;
+			t->value.assign(FLAGS_value_size, 'a' + i % 26);
+			states.push_back(t);
+			args[i].state = t;
+			args[i].bench = bench;
+		}
+
+		int64_t start = now_ns();
+		for (int i = 0; i < FLAGS_threads; i++){
+			pthread_create(&tids[i], NULL, &run_thread, &args[i]);
+		}
+		for (int i = 0; i < FLAGS_threads; i++){
+			pthread_join(tids[i], NULL);
+		}
+		int64_t elapsed = now_ns() - start;
+
+		std::vector<int64_t> latencies;
+		latencies.reserve(ops);
+		int64_t found = 0;
+		for (int i = 0; i < FLAGS_threads; i++){
+			latencies.insert(latencies.end(), states[i]->latencies.begin(), states[i]->latencies.end());
+			found += states[i]->found;
+			delete states[i];
+		}
+		std::sort(latencies.begin(), latencies.end());
+		double sum = 0;
+		for (size_t i = 0; i < latencies.size(); i++){
+			sum += latencies[i];
+		}
+		double secs = elapsed / 1e9;
+		printf("name=%s ops=%lld threads=%d found=%lld secs=%.3f ops_per_sec=%.0f"
+			" avg_us=%.2f p50_us=%.2f p99_us=%.2f p999_us=%.2f max_us=%.2f\n",
+			bench->name, (long long)ops, FLAGS_threads, (long long)found, secs,
+			secs > 0 ? ops / secs : 0,
+			latencies.empty() ? 0 : sum / latencies.size() / 1000.0,
+			percentile_us(latencies, 0.5), percentile_us(latencies, 0.99),
+			percentile_us(latencies, 0.999), percentile_us(latencies, 1));
+		fflush(stdout);
+	}
+
+	bool parse_flag(const char *arg){
+		const char *eq = strchr(arg, '=');
+		if (strncmp(arg, "--", 2) != 0 || eq == NULL){
+			return false;
+		}
+		std::string name(arg + 2, eq - arg - 2);
+		const char *val = eq + 1;
+		if (name == "benchmarks"){
+			FLAGS_benchmarks = val;
+		}
+		else if (name == "db"){
+			FLAGS_db = val;
+		}
+		else if (name == "num"){
+			FLAGS_num = atoll(val);
+		}
+		else if (name == "reads"){
+			FLAGS_reads = atoll(val);
+		}
+		else if (name == "threads"){
+			FLAGS_threads = std::max(1, atoi(val));
+		}
+		else if (name == "value_size"){
+			FLAGS_value_size = atoi(val);
+		}
+		else if (name == "containers"){
+			FLAGS_containers = std::max(1, atoi(val));
+		}
+		else if (name == "scan_limit"){
+			FLAGS_scan_limit = atoi(val);
+		}
+		else if (name == "read_ratio"){
+			FLAGS_read_ratio = atoi(val);
+		}
+		else if (name == "shards"){
+			FLAGS_shards = atoi(val);
+		}
+		else if (name == "value_cache"){
+			FLAGS_value_cache = atoi(val);
+		}
+		else if (name == "size_cache"){
+			FLAGS_size_cache = atoi(val);
+		}
+		else{
+			return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++){
+		if (!parse_flag(argv[i])){
+			fprintf(stderr, "invalid flag: %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	lv::Options opt;
+	opt.dir = FLAGS_db;
+	opt.shards = FLAGS_shards;
+	opt.value_cache = FLAGS_value_cache;
+	opt.size_cache = FLAGS_size_cache;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	if (db == NULL){
+		fprintf(stderr, "open db failed: %s\n", FLAGS_db.c_str());
+		return 1;
+	}
+	db->flushdb();
+
+	printf("# lvdb_bench num=%lld reads=%lld threads=%d value_size=%d containers=%d"
+		" scan_limit=%d shards=%d value_cache=%d size_cache=%d\n",
+		(long long)FLAGS_num, (long long)(FLAGS_reads >= 0 ? FLAGS_reads : FLAGS_num),
+		FLAGS_threads, FLAGS_value_size, FLAGS_containers, FLAGS_scan_limit,
+		FLAGS_shards, FLAGS_value_cache, FLAGS_size_cache);
+	std::string list = FLAGS_benchmarks;
+	size_t pos = 0;
+	while (pos <= list.size()){
+		size_t comma = list.find(',', pos);
+		if (comma == std::string::npos){
+			comma = list.size();
+		}
+		std::string name = list.substr(pos, comma - pos);
+		pos = comma + 1;
+		if (name.empty()){
+			continue;
+		}
+		const Benchmark *bench = NULL;
+		for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++){
+			if (name == benchmarks[i].name){
+				bench = &benchmarks[i];
+			}
+		}
+		if (bench == NULL){
+			fprintf(stderr, "unknown benchmark: %s\n", name.c_str());
+			continue;
+		}
+		run(db, bench);
+	}
+
+	db->release();
+	return 0;
+}
@@ -1,8 +1,16 @@
 
 #include "lvdb/lvdb.h"
+#include "lvdb/cdc.h"
 #include "lvdb/sync.h"
+#include "lvdb/binlog.h"
+#include "binlog_store.h"
 #include "toolkits/util.h"
 #include "gtest/gtest.h"
+#include "pthread.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
 
 TEST(LVDBTest, DBApi)
 {
@@ -53,6 +61,1044 @@ TEST(LVDBTest, DBApi)
 	db->release();
 }
 
+static void* group_commit_writer(void *arg)
+{
+	lv::LVDB *db = (lv::LVDB *)arg;
+	for (int i = 0; i < 1000; i++) {
+		db->hset("group_commit", lv::str(i), "v");
+		int64_t v;
+		db->incr("group_commit_count", 1, &v);
+	}
+	return NULL;
+}
+
+TEST(LVDBTest, GroupCommit)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_group_commit/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	pthread_t tids[4];
+	for (int i = 0; i < 4; i++) {
+		pthread_create(&tids[i], NULL, &group_commit_writer, db);
+	}
+	for (int i = 0; i < 4; i++) {
+		pthread_join(tids[i], NULL);
+	}
+	std::string v;
+	EXPECT_EQ(1000, db->hsize("group_commit"));
+	EXPECT_EQ(1, db->get("group_commit_count", &v));
+	EXPECT_EQ(4000, lv::Bytes(v).Int64());
+	db->hclear("group_commit");
+	db->del("group_commit_count");
+	db->release();
+}
+
+TEST(LVDBTest, ZRank)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_zrank/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	for (int i = 0; i < 500; i++) {
+		db->zset("zrank", "m" + lv::str(i), lv::str(i % 50 - 25));
+	}
+	db->zset("zrank", "a", "-100");
+	db->zset("zrank", "b", "100");
+	EXPECT_EQ(0, db->zrank("zrank", "a"));
+	EXPECT_EQ(501, db->zrank("zrank", "b"));
+	EXPECT_EQ(0, db->zrrank("zrank", "b"));
+	// ties are ordered by member: m0, m100, m150, ..., m50 all score -25
+	EXPECT_EQ(1, db->zrank("zrank", "m0"));
+	EXPECT_EQ(2, db->zrank("zrank", "m100"));
+	db->zdel("zrank", "a");
+	EXPECT_EQ(0, db->zrank("zrank", "m0"));
+	EXPECT_EQ(-1, db->zrank("zrank", "a"));
+	for (int i = 0; i < 500; i++) {
+		db->zdel("zrank", "m" + lv::str(i));
+	}
+	db->zdel("zrank", "b");
+	EXPECT_EQ(0, db->zsize("zrank"));
+
+	// one score for all, members sharing more bytes than the index keeps
+	for (int i = 0; i < 300; i++) {
+		db->zset("zrank", "player:00000000000" + lv::str(i + 1000), "7");
+	}
+	db->zset("zrank", "player:0", "7");
+	EXPECT_EQ(0, db->zrank("zrank", "player:0"));
+	EXPECT_EQ(1, db->zrank("zrank", "player:000000000001000"));
+	EXPECT_EQ(300, db->zrank("zrank", "player:000000000001299"));
+	EXPECT_EQ(299, db->zrrank("zrank", "player:000000000001000"));
+	lv::ZIterator *it = db->zrange("zrank", 250, 1);
+	ASSERT_TRUE(it->next());
+	EXPECT_EQ("player:000000000001249", it->key);
+	delete it;
+	it = db->zrrange("zrank", 300, 1);
+	ASSERT_TRUE(it->next());
+	EXPECT_EQ("player:0", it->key);
+	delete it;
+	// an offset past the end is answered by the index, not by a walk
+	it = db->zrange("zrank", 301, 1);
+	EXPECT_FALSE(it->next());
+	delete it;
+	it = db->zrrange("zrank", 1000000, 1);
+	EXPECT_FALSE(it->next());
+	delete it;
+	db->zclear("zrank");
+
+	// enough items to split the blocks of the index, then to fold them
+	for (int i = 0; i < 3000; i++) {
+		db->zset("zrank", "m" + lv::str(i), lv::str(i / 3));
+	}
+	EXPECT_EQ(1500, db->zrank("zrank", "m1500"));
+	EXPECT_EQ(1499, db->zrrank("zrank", "m1500"));
+	it = db->zrange("zrank", 2999, 1);
+	ASSERT_TRUE(it->next());
+	EXPECT_EQ("m2999", it->key);
+	delete it;
+	for (int i = 0; i < 3000; i++) {
+		if (i % 100 != 0) {
+			db->zdel("zrank", "m" + lv::str(i));
+		}
+	}
+	EXPECT_EQ(29, db->zrank("zrank", "m2900"));
+	EXPECT_EQ(0, db->zrrank("zrank", "m2900"));
+	db->zclear("zrank");
+	db->release();
+}
+
+static void* multi_get_writer(void *arg)
+{
+	lv::LVDB *db = (lv::LVDB *)arg;
+	for (int i = 0; i < 1000; i++) {
+		std::vector<lv::Bytes> kvs;
+		std::string v = lv::str(i);
+		kvs.push_back("multi_get_x");
+		kvs.push_back(v);
+		kvs.push_back("multi_get_y");
+		kvs.push_back(v);
+		db->multi_set(kvs);
+	}
+	return NULL;
+}
+
+TEST(LVDBTest, MultiGet)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_multi_get/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->hset("multi_get", "a", "1");
+	db->hset("multi_get", "c", "3");
+	std::vector<lv::Bytes> keys;
+	keys.push_back("c");
+	keys.push_back("b");
+	keys.push_back("a");
+	lv::Multi_Values vals;
+	EXPECT_EQ(2, db->multi_hget("multi_get", keys, &vals));
+	EXPECT_EQ(3, vals.size());
+	EXPECT_EQ("3", vals.value(0).String());
+	EXPECT_FALSE(vals.found(1));
+	EXPECT_EQ("1", vals.value(2).String());
+	db->hclear("multi_get");
+
+	// both keys are written by one group, a read never sees half of it
+	pthread_t tid;
+	pthread_create(&tid, NULL, &multi_get_writer, db);
+	keys.clear();
+	keys.push_back("multi_get_x");
+	keys.push_back("multi_get_y");
+	for (int i = 0; i < 1000; i++) {
+		if (db->multi_get(keys, &vals) == 2) {
+			ASSERT_EQ(vals.value(0).String(), vals.value(1).String());
+		}
+	}
+	pthread_join(tid, NULL);
+	db->multi_del(keys);
+	db->release();
+}
+
+TEST(LVDBTest, MultiSet)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_multi_set/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	std::vector<lv::Bytes> kvs;
+	kvs.push_back("a");
+	kvs.push_back("1");
+	kvs.push_back("b");
+	kvs.push_back("2");
+	kvs.push_back("a");
+	kvs.push_back("3");
+	EXPECT_EQ(2, db->multi_zset("multi_set", kvs));
+	EXPECT_EQ(2, db->zsize("multi_set"));
+	EXPECT_EQ(1, db->zrank("multi_set", "a"));
+	std::vector<lv::Bytes> keys;
+	keys.push_back("a");
+	keys.push_back("c");
+	EXPECT_EQ(1, db->multi_zdel("multi_set", keys));
+	EXPECT_EQ(1, db->zsize("multi_set"));
+	EXPECT_EQ(2, db->multi_hset("multi_set", kvs));
+	EXPECT_EQ(2, db->hsize("multi_set"));
+	EXPECT_EQ(2, db->multi_hdel("multi_set", kvs));
+	EXPECT_EQ(0, db->hsize("multi_set"));
+	db->zdel("multi_set", "b");
+	db->release();
+}
+
+TEST(LVDBTest, Clear)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_clear/";
+	// keeps the binlogs of a large clear until the cursor reads them
+	opt.binlog_capacity = 4 * lv::SSDB_CLEAR_BATCH;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	for (int i = 0; i < 100; i++) {
+		db->hset("clear", lv::str(i), "v");
+		db->zset("clear", lv::str(i), lv::str(i));
+		db->qpush_back("clear", lv::str(i));
+	}
+	EXPECT_EQ(100, db->hclear("clear"));
+	EXPECT_EQ(100, db->zclear("clear"));
+	EXPECT_EQ(100, db->qclear("clear"));
+	EXPECT_EQ(0, db->hsize("clear"));
+	EXPECT_EQ(0, db->zsize("clear"));
+	EXPECT_EQ(0, db->qsize("clear"));
+	db->zset("clear", "a", "1");
+	EXPECT_EQ(0, db->zrank("clear", "a"));
+	EXPECT_EQ(1, db->zclear("clear"));
+
+	// every batch but the last is logged item by item
+	int n = lv::SSDB_CLEAR_BATCH + 5;
+	for (int i = 0; i < n; i++) {
+		db->hset("clear_big", lv::str(i), "v");
+	}
+	lv::Cdc_Filter filter;
+	filter.types.push_back(lv::DataType::HASH);
+	filter.prefix = "clear_big";
+	lv::Cdc_Cursor *cursor = db->subscribe("clear", filter);
+	ASSERT_NE((lv::Cdc_Cursor *)NULL, cursor);
+	EXPECT_EQ(n, db->hclear("clear_big"));
+	std::vector<lv::Binlog> logs;
+	ASSERT_EQ(lv::SSDB_CLEAR_BATCH + 1, cursor->next(&logs, n, 100));
+	EXPECT_EQ(lv::BinlogCommand::HDEL, logs[0].cmd());
+	EXPECT_EQ(lv::BinlogCommand::HCLEAR, logs.back().cmd());
+	cursor->remove();
+	delete cursor;
+	db->release();
+}
+
+// polls cond until it holds, false if it still doesn't after timeout_ms
+static bool wait_for(const std::function<bool()>& cond, int timeout_ms = 10000)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	while (!cond()) {
+		if (std::chrono::steady_clock::now() >= deadline) {
+			return false;
+		}
+		Sleep(5);
+	}
+	return true;
+}
+
+class Count_Sync_Processor : public lv::Sync_Processor
+{
+public:
+	Count_Sync_Processor() : sets(0), dels(0) {}
+
+	virtual int do_sync(lv::Binlog& log, const char* val, int len)
+	{
+		if (val) {
+			sets++;
+		}
+		else {
+			dels++;
+		}
+		return 0;
+	}
+
+	std::atomic<int> sets;
+	std::atomic<int> dels;
+};
+
+TEST(LVDBTest, SyncTail)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_sync_tail/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->set("sync_tail", "0");
+	Count_Sync_Processor counter;
+	lv::Sync *sync = new lv::Sync("sync_tail", db, &counter);
+	sync->create();
+	sync->start();
+	// a new sync starts from the last binlog
+	ASSERT_TRUE(wait_for([&counter]{ return counter.sets == 1; }));
+	// the sync waits for new binlogs instead of returning
+	for (int i = 0; i < 1000; i++) {
+		db->set("sync_tail", lv::str(i));
+	}
+	db->del("sync_tail");
+	EXPECT_TRUE(wait_for([&counter]{ return counter.dels == 1; }));
+	EXPECT_EQ(1001, counter.sets);
+	EXPECT_EQ(1, counter.dels);
+	sync->quit();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	db->release();
+}
+
+TEST(LVDBTest, SyncGap)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_sync_gap/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->set("sync_gap", "0");
+	db->set("sync_gap", "1");
+	// drops the binlogs, a sync checkpointed before them can't go on
+	db->flushdb();
+	db->meta_set("sync_gap:sync:seq", lv::Bytes_uint64(1));
+	db->set("sync_gap", "2");
+	Count_Sync_Processor counter;
+	lv::Sync *sync = new lv::Sync("sync_gap", db, &counter);
+	sync->create();
+	sync->start();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	EXPECT_EQ(0, counter.sets);
+	std::string val;
+	ASSERT_EQ(1, db->meta_get("sync_gap:sync:seq", &val));
+	EXPECT_EQ(lv::Bytes_uint64(1).String(), val);
+	db->del("sync_gap");
+	db->release();
+}
+
+TEST(LVDBTest, SyncBatch)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_sync_master/";
+	lv::LVDB *master = lv::LVDB::open(opt);
+	opt.dir = "lvdb_sync_slave/";
+	lv::LVDB *slave = lv::LVDB::open(opt);
+	master->set("sync_batch", "0");
+	lv::Backup_Server_Processor server(slave, "master");
+	uint64_t seq = server.last_seq();
+	lv::Sync *sync = new lv::Sync("slave", master, &server);
+	sync->create();
+	sync->start();
+	ASSERT_TRUE(wait_for([&server, seq]{ return server.last_seq() > seq; }));
+	for (int i = 0; i < 1000; i++) {
+		// the same fields are set several times in one batch
+		master->hset("sync_batch", lv::str(i % 10), lv::str(i));
+		master->zset("sync_batch", lv::str(i % 10), lv::str(i % 7));
+	}
+	master->hclear("sync_batch");
+	master->hset("sync_batch", "a", "1");
+	std::string v;
+	// the last write, the batches are applied in order
+	EXPECT_TRUE(wait_for([slave, &v]{ return slave->hget("sync_batch", "a", &v) == 1; }));
+	sync->quit();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	EXPECT_EQ(1, slave->hsize("sync_batch"));
+	EXPECT_EQ(10, slave->zsize("sync_batch"));
+	EXPECT_EQ(master->zrank("sync_batch", "3"), slave->zrank("sync_batch", "3"));
+	EXPECT_LT(2000u, server.last_seq());
+	slave->hclear("sync_batch");
+	slave->zclear("sync_batch");
+	master->hclear("sync_batch");
+	master->zclear("sync_batch");
+	master->release();
+	slave->release();
+}
+
+TEST(LVDBTest, CopyShards)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_copy_master/";
+	lv::LVDB *master = lv::LVDB::open(opt);
+	opt.dir = "lvdb_copy_slave/";
+	lv::LVDB *slave = lv::LVDB::open(opt);
+	for (int i = 0; i < 1000; i++) {
+		master->set("copy_" + lv::str(i), lv::str(i));
+		master->hset("copy", lv::str(i), lv::str(i));
+	}
+	lv::Backup_Server_Processor server(slave);
+	std::vector<lv::Sync_Processor*> syncs(4, &server);
+	lv::Copy *copy = new lv::Copy("copy_slave", master, syncs);
+	copy->create();
+	copy->start();
+	ASSERT_TRUE(wait_for([copy]{ return copy->stopped(); }));
+	std::string v;
+	EXPECT_EQ(1000, slave->hsize("copy"));
+	EXPECT_EQ(1, slave->get("copy_999", &v));
+	EXPECT_EQ("999", v);
+	// the copy hands off to the sync of the same name
+	EXPECT_EQ(1, master->meta_get("copy_slave:sync:seq", &v));
+	master->hclear("copy");
+	slave->hclear("copy");
+	master->release();
+	slave->release();
+}
+
+TEST(LVDBTest, ScanView)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_scan_view/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->hset("scan_view", "a", "1");
+	db->hset("scan_view", "b", "22");
+	db->hset("scan_view_2", "a", "3");
+	lv::HIterator *it = db->hscan("scan_view", "", "", 10);
+	EXPECT_TRUE(it->next_view());
+	EXPECT_EQ("a", it->key_view().String());
+	EXPECT_EQ("1", it->val_view().String());
+	EXPECT_TRUE(it->next_view());
+	EXPECT_EQ("b", it->key_view().String());
+	EXPECT_EQ("22", it->val_view().String());
+	// the views stop at the end of the hash like next()
+	EXPECT_FALSE(it->next_view());
+	it->release();
+	db->zset("scan_view", "m", "-5");
+	lv::ZIterator *zit = db->zscan("scan_view", "", "", "", 10);
+	EXPECT_TRUE(zit->next_view());
+	EXPECT_EQ("m", zit->key_view().String());
+	EXPECT_EQ(-5, zit->score_value());
+	zit->release();
+	db->hclear("scan_view");
+	db->hclear("scan_view_2");
+	db->zclear("scan_view");
+	db->release();
+}
+
+TEST(LVDBTest, IteratorPool)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_iterator_pool/";
+	opt.iterator_max_age = 1000;
+	// the clears and the scans share the pooled iterators of the same policy
+	opt.bulk_read_policy = lv::ReadPolicy::CACHE;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	for (int i = 0; i < 10; i++) {
+		db->hset("iterator_pool", lv::str(i), "v");
+		db->zset("iterator_pool", lv::str(i), lv::str(i));
+	}
+	for (int n = 0; n < 3; n++) {
+		int count = 0;
+		lv::HIterator *it = db->hscan("iterator_pool", "", "", 20);
+		while (it->next()) {
+			count++;
+		}
+		it->release();
+		EXPECT_EQ(10, count);
+	}
+	// a pooled iterator is not reused after a write
+	db->hset("iterator_pool", "a", "v");
+	int count = 0;
+	lv::HIterator *it = db->hscan("iterator_pool", "", "", 20);
+	while (it->next()) {
+		count++;
+	}
+	it->release();
+	EXPECT_EQ(11, count);
+	// nor after the last commit of a clear
+	db->hclear("iterator_pool");
+	it = db->hscan("iterator_pool", "", "", 20);
+	EXPECT_FALSE(it->next());
+	it->release();
+	db->zclear("iterator_pool");
+	lv::ZIterator *zit = db->zscan("iterator_pool", "", "", "", 20);
+	EXPECT_FALSE(zit->next());
+	zit->release();
+	db->release();
+}
+
+TEST(LVDBTest, ReadPolicy)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_read_policy/";
+	opt.scan_read_policy = lv::ReadPolicy::NO_CACHE;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->hset("read_policy", "a", "1");
+	EXPECT_EQ(lv::ReadPolicy::DEFAULT, lv::Read_Hint::current());
+	{
+		lv::Read_Hint hint(lv::ReadPolicy::CACHE);
+		{
+			lv::Read_Hint inner(lv::ReadPolicy::NO_CACHE);
+			EXPECT_EQ(lv::ReadPolicy::NO_CACHE, lv::Read_Hint::current());
+		}
+		EXPECT_EQ(lv::ReadPolicy::CACHE, lv::Read_Hint::current());
+		lv::HIterator *it = db->hscan("read_policy", "", "", 10);
+		EXPECT_TRUE(it->next());
+		it->release();
+	}
+	EXPECT_EQ(lv::ReadPolicy::DEFAULT, lv::Read_Hint::current());
+	std::string v;
+	EXPECT_EQ(1, db->hget("read_policy", "a", &v));
+	std::vector<std::string> info = db->info();
+	EXPECT_NE(info.end(), std::find(info.begin(), info.end(), "block_cache"));
+	db->hclear("read_policy");
+	db->release();
+}
+
+TEST(LVDBTest, ShardedDB)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_sharded/";
+	opt.shards = 4;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	ASSERT_TRUE(db != NULL);
+	EXPECT_EQ(4, db->shards());
+	std::vector<std::string> names;
+	for (int i = 0; i < 20; i++){
+		names.push_back("sharded_" + lv::str(i));
+	}
+	for (size_t i = 0; i < names.size(); i++){
+		db->set(names[i], names[i]);
+		db->hset(names[i], "a", "1");
+	}
+	std::string v;
+	EXPECT_EQ(1, db->get("sharded_7", &v));
+	EXPECT_EQ("sharded_7", v);
+	EXPECT_EQ(1, db->hsize("sharded_7"));
+	// the scans over several shards come out in key order
+	std::sort(names.begin(), names.end());
+	lv::KIterator *it = db->scan("sharded_", "sharded_~", 100);
+	size_t n = 0;
+	while (it->next()){
+		ASSERT_LT(n, names.size());
+		EXPECT_EQ(names[n], it->key);
+		n++;
+	}
+	it->release();
+	EXPECT_EQ(names.size(), n);
+	std::vector<std::string> list;
+	db->hlist("sharded_", "sharded_~", 5, &list);
+	EXPECT_EQ(std::vector<std::string>(names.begin(), names.begin() + 5), list);
+	std::vector<lv::Bytes> keys(names.begin(), names.end());
+	keys.push_back("sharded_none");
+	lv::Multi_Values vals;
+	EXPECT_EQ(20, db->multi_get(keys, &vals));
+	EXPECT_EQ(names[3], vals.value(3).String());
+	EXPECT_FALSE(vals.found(20));
+	for (size_t i = 0; i < names.size(); i++){
+		db->del(names[i]);
+		db->hclear(names[i]);
+	}
+	db->release();
+
+	// the names would be looked up in other shards
+	opt.shards = 2;
+	EXPECT_TRUE(lv::LVDB::open(opt) == NULL);
+	opt.shards = 1;
+	EXPECT_TRUE(lv::LVDB::open(opt) == NULL);
+	opt.dir = "lvdb_unsharded/";
+	db = lv::LVDB::open(opt);
+	ASSERT_TRUE(db != NULL);
+	db->release();
+	opt.shards = 4;
+	EXPECT_TRUE(lv::LVDB::open(opt) == NULL);
+}
+
+struct Striped_Writer
+{
+	lv::LVDB *db;
+	int id;
+};
+
+static void* striped_writer(void *arg) {
+	Striped_Writer *w = (Striped_Writer *)arg;
+	std::string own = "striped_" + lv::str(w->id);
+	for (int i = 0; i < 500; i++) {
+		int64_t v;
+		// one hash of this thread, one shared by every thread
+		w->db->hset(own, lv::str(i), "v");
+		w->db->hincr("striped_shared", "n", 1, &v);
+		w->db->qpush_back("striped_queue", lv::str(i));
+	}
+	return NULL;
+}
+
+TEST(LVDBTest, StripedLocks)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_striped/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	pthread_t tids[4];
+	Striped_Writer writers[4];
+	for (int i = 0; i < 4; i++) {
+		writers[i].db = db;
+		writers[i].id = i;
+		pthread_create(&tids[i], NULL, &striped_writer, &writers[i]);
+	}
+	for (int i = 0; i < 4; i++) {
+		pthread_join(tids[i], NULL);
+	}
+	std::string v;
+	for (int i = 0; i < 4; i++) {
+		EXPECT_EQ(500, db->hsize("striped_" + lv::str(i)));
+		db->hclear("striped_" + lv::str(i));
+	}
+	EXPECT_EQ(1, db->hget("striped_shared", "n", &v));
+	EXPECT_EQ(2000, lv::Bytes(v).Int64());
+	EXPECT_EQ(2000, db->qsize("striped_queue"));
+	db->hclear("striped_shared");
+	db->qclear("striped_queue");
+	db->release();
+}
+
+TEST(LVDBTest, SizeCache)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_size_cache/";
+	opt.size_cache = 16;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	// more containers than the cache holds, so some counters are evicted
+	for (int i = 0; i < 40; i++) {
+		std::string name = "size_cache_" + lv::str(i);
+		db->hset(name, "a", "1");
+		db->hset(name, "b", "1");
+		db->hdel(name, "a");
+		db->zset(name, "a", "1");
+		db->qpush_back(name, "x");
+		db->qpush_front(name, "y");
+	}
+	std::string v;
+	for (int i = 0; i < 40; i++) {
+		std::string name = "size_cache_" + lv::str(i);
+		EXPECT_EQ(1, db->hsize(name));
+		EXPECT_EQ(1, db->zsize(name));
+		EXPECT_EQ(2, db->qsize(name));
+		EXPECT_EQ(1, db->qfront(name, &v));
+		EXPECT_EQ("y", v);
+		EXPECT_EQ(1, db->qback(name, &v));
+		EXPECT_EQ("x", v);
+	}
+	std::vector<std::string> info = db->info();
+	EXPECT_NE(info.end(), std::find(info.begin(), info.end(), "size_cache"));
+	db->flushdb();
+	EXPECT_EQ(0, db->hsize("size_cache_0"));
+	EXPECT_EQ(0, db->qfront("size_cache_0", &v));
+	db->release();
+}
+
+TEST(LVDBTest, ValueCache)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_value_cache/";
+	opt.value_cache = 1;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	std::string v;
+	db->set("value_cache", "1");
+	EXPECT_EQ(1, db->get("value_cache", &v));
+	EXPECT_EQ(1, db->get("value_cache", &v));
+	// the cached values follow the writes
+	db->set("value_cache", "2");
+	EXPECT_EQ(1, db->get("value_cache", &v));
+	EXPECT_EQ("2", v);
+	db->del("value_cache");
+	EXPECT_EQ(0, db->get("value_cache", &v));
+	db->hset("value_cache", "a", "1");
+	EXPECT_EQ(1, db->hget("value_cache", "a", &v));
+	db->hset("value_cache", "a", "2");
+	EXPECT_EQ(1, db->hget("value_cache", "a", &v));
+	EXPECT_EQ("2", v);
+	db->zset("value_cache", "a", "5");
+	EXPECT_EQ(1, db->zget("value_cache", "a", &v));
+	int64_t n;
+	db->zincr("value_cache", "a", 1, &n);
+	EXPECT_EQ(1, db->zget("value_cache", "a", &v));
+	EXPECT_EQ("6", v);
+	std::vector<std::string> info = db->info();
+	EXPECT_NE(info.end(), std::find(info.begin(), info.end(), "value_cache"));
+	db->hclear("value_cache");
+	db->zclear("value_cache");
+	EXPECT_EQ(0, db->hget("value_cache", "a", &v));
+	db->release();
+}
+
+TEST(LVDBTest, OpStats)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_op_stats/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	std::string v;
+	db->set("op_stats", "1");
+	db->get("op_stats", &v);
+	db->hset("op_stats", "a", "1");
+	std::vector<std::string> info = db->info();
+	std::vector<std::string>::iterator it = std::find(info.begin(), info.end(), "op_stats");
+	ASSERT_NE(info.end(), it);
+	std::string stats = *(it + 1);
+	EXPECT_NE(std::string::npos, stats.find("    set"));
+	EXPECT_NE(std::string::npos, stats.find("    get"));
+	EXPECT_NE(std::string::npos, stats.find("    hset"));
+	EXPECT_NE(std::string::npos, stats.find("group_write"));
+	EXPECT_NE(std::string::npos, stats.find("bytes_read"));
+	db->release();
+}
+
+TEST(LVDBTest, BinlogBacklog)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_binlog_backlog/";
+	opt.binlog_capacity = 100;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	for (int i = 0; i < 200; i++) {
+		db->set("binlog_backlog", lv::str(i));
+	}
+	// the active segment is kept, the binlogs over the capacity are reported
+	std::vector<std::string> info = db->info();
+	std::vector<std::string>::iterator it = std::find(info.begin(), info.end(), "binlogs");
+	ASSERT_NE(info.end(), it);
+	std::string stats = *(it + 1);
+	size_t pos = stats.find("backlog  : ");
+	ASSERT_NE(std::string::npos, pos);
+	EXPECT_LE(100, atoi(stats.c_str() + pos + 11));
+	db->del("binlog_backlog");
+	db->release();
+}
+
+static void clear_binlog_dir(const std::string &dir)
+{
+	leveldb::Env *env = leveldb::Env::Default();
+	std::vector<std::string> names;
+	env->GetChildren(dir, &names);
+	for (size_t i = 0; i < names.size(); i++) {
+		env->DeleteFile(dir + names[i]);
+	}
+}
+
+static std::string binlog_segment_path(const std::string &dir, uint64_t first_seq)
+{
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%020" PRIu64 ".log", first_seq);
+	return dir + buf;
+}
+
+static lv::Binlog store_log(uint64_t seq)
+{
+	std::string key = "k" + lv::str(seq);
+	return lv::Binlog(seq, lv::BinlogType::SYNC, lv::BinlogCommand::KDEL, key);
+}
+
+TEST(LVDBTest, BinlogStore)
+{
+	std::string dir = "lvdb_binlog_store/";
+	clear_binlog_dir(dir);
+	uint64_t n = lv::Binlog_Store::SEGMENT_RECORDS + 100;
+	lv::Binlog log;
+	{
+		lv::Binlog_Store store(dir);
+		ASSERT_EQ(0, store.open());
+		for (uint64_t seq = 1; seq <= n; seq++) {
+			ASSERT_TRUE(store.append(store_log(seq)).ok());
+			ASSERT_TRUE(store.flush().ok());
+		}
+		// the first segment is sealed, the records on both sides of it are read
+		EXPECT_EQ(1u, store.min_seq());
+		EXPECT_EQ(n, store.max_seq());
+		ASSERT_EQ(1, store.get(lv::Binlog_Store::SEGMENT_RECORDS, &log));
+		EXPECT_EQ("k" + lv::str(lv::Binlog_Store::SEGMENT_RECORDS), log.key().String());
+		ASSERT_EQ(1, store.get(lv::Binlog_Store::SEGMENT_RECORDS + 1, &log));
+		EXPECT_EQ("k" + lv::str(lv::Binlog_Store::SEGMENT_RECORDS + 1), log.key().String());
+		std::vector<lv::Binlog> logs;
+		EXPECT_EQ(10, store.read_batch(lv::Binlog_Store::SEGMENT_RECORDS - 9, n, 100, &logs));
+		EXPECT_EQ(0, store.get(n + 1, &log));
+
+		// sealed records are masked by rewriting their segment
+		store.set_noop(5, 7);
+		ASSERT_EQ(1, store.get(6, &log));
+		EXPECT_EQ(lv::BinlogType::NOOP, log.type());
+		ASSERT_EQ(1, store.get(8, &log));
+		EXPECT_EQ("k8", log.key().String());
+	}
+
+	// the process stopped in the middle of a record of the active segment
+	FILE *fp = fopen(binlog_segment_path(dir, lv::Binlog_Store::SEGMENT_RECORDS + 1).c_str(), "ab");
+	ASSERT_TRUE(fp != NULL);
+	fwrite("\x40\x00\x00\x00torn", 1, 8, fp);
+	fclose(fp);
+	{
+		lv::Binlog_Store store(dir);
+		ASSERT_EQ(0, store.open());
+		EXPECT_EQ(n, store.max_seq());
+		ASSERT_EQ(1, store.get(6, &log));
+		EXPECT_EQ(lv::BinlogType::NOOP, log.type());
+		ASSERT_TRUE(store.append(store_log(n + 1)).ok());
+		ASSERT_TRUE(store.flush().ok());
+		ASSERT_EQ(1, store.get(n + 1, &log));
+		EXPECT_EQ("k" + lv::str(n + 1), log.key().String());
+
+		// only whole segments before the seq are dropped
+		EXPECT_EQ(0, store.drop_before(lv::Binlog_Store::SEGMENT_RECORDS));
+		EXPECT_EQ(1, store.drop_before(lv::Binlog_Store::SEGMENT_RECORDS + 10));
+		EXPECT_EQ(lv::Binlog_Store::SEGMENT_RECORDS + 1, store.min_seq());
+		EXPECT_EQ(0, store.get(1, &log));
+		EXPECT_EQ(n + 1, store.max_seq());
+	}
+	clear_binlog_dir(dir);
+
+	// the binlogs of a group lost before it reached the db are dropped on
+	// open, against the written seq the db keeps
+	lv::Options opt;
+	opt.dir = "lvdb_binlog_lost/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->set("binlog_lost", "1");
+	db->release();
+	uint64_t written;
+	{
+		lv::Binlog_Store store(opt.dir + "binlog/");
+		ASSERT_EQ(0, store.open());
+		written = store.max_seq();
+		for (uint64_t seq = written + 1; seq <= written + 3; seq++) {
+			ASSERT_TRUE(store.append(store_log(seq)).ok());
+		}
+		ASSERT_TRUE(store.flush().ok());
+	}
+	db = lv::LVDB::open(opt);
+	db->del("binlog_lost");
+	db->release();
+	{
+		lv::Binlog_Store store(opt.dir + "binlog/");
+		ASSERT_EQ(0, store.open());
+		EXPECT_EQ(written + 1, store.max_seq());
+		ASSERT_EQ(1, store.get(written + 1, &log));
+		EXPECT_EQ(lv::BinlogCommand::KDEL, log.cmd());
+		EXPECT_EQ("binlog_lost", log.name().String());
+	}
+}
+
+TEST(LVDBTest, AsyncWrites)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_async/";
+	lv::LVDB *db = lv::LVDB::open(opt);
+	std::atomic<int> done(0);
+	std::atomic<int64_t> counter(0);
+	for (int i = 0; i < 100; i++){
+		std::string k = lv::str(i);
+		EXPECT_EQ(1, db->async_hset("async", k, k, [&done](int64_t ret, int64_t){
+			if (ret >= 0){
+				done++;
+			}
+		}));
+	}
+	db->async_incr("async", 5, [&done, &counter](int64_t ret, int64_t new_val){
+		counter = new_val;
+		done++;
+	});
+	EXPECT_TRUE(wait_for([&done]{ return done == 101; }));
+	EXPECT_EQ(101, done);
+	EXPECT_EQ(5, counter);
+	EXPECT_EQ(100, db->hsize("async"));
+	db->hclear("async");
+	db->del("async");
+	db->release();
+}
+
+class Value_Sync_Processor : public lv::Sync_Processor
+{
+public:
+	Value_Sync_Processor() : count(0) {}
+
+	virtual int do_sync(lv::Binlog& log, const char* val, int len)
+	{
+		if (val) {
+			vals.push_back(std::string(val, len));
+			seqs.push_back(log.seq());
+			count++;
+		}
+		return 0;
+	}
+
+	std::vector<std::string> vals;
+	std::vector<uint64_t> seqs;
+	// vals and seqs are read once it reaches the expected size
+	std::atomic<int> count;
+};
+
+TEST(LVDBTest, InlineBinlogValues)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_inline_value/";
+	opt.binlog_inline_value = 16;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->set("inline_value", "0");
+	Value_Sync_Processor processor;
+	lv::Sync *sync = new lv::Sync("inline_value", db, &processor);
+	sync->create();
+	sync->start();
+	ASSERT_TRUE(wait_for([&processor]{ return processor.count == 1; }));
+	// the small values are shipped as they were at their seq
+	for (int i = 0; i < 100; i++) {
+		db->set("inline_value", "v" + lv::str(i));
+	}
+	db->set("inline_value", std::string(100, 'x'));
+	EXPECT_TRUE(wait_for([&processor]{ return processor.count == 102; }));
+	ASSERT_EQ(102u, processor.vals.size());
+	EXPECT_EQ("v0", processor.vals[1]);
+	EXPECT_EQ("v99", processor.vals[100]);
+	EXPECT_EQ(100u, processor.vals[101].size());
+	sync->quit();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	db->del("inline_value");
+	db->release();
+}
+
+TEST(LVDBTest, GroupedBinlogs)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_grouped_binlogs/";
+	opt.binlog_group = true;
+	opt.binlog_inline_value = 32;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	db->set("grouped_binlogs", "0");
+	Value_Sync_Processor processor;
+	lv::Sync *sync = new lv::Sync("grouped_binlogs", db, &processor);
+	sync->create();
+	sync->start();
+	ASSERT_TRUE(wait_for([&processor]{ return processor.count == 1; }));
+	// one binlog for the transaction, shipped as its writes
+	std::vector<lv::Bytes> kvs;
+	std::vector<std::string> keys;
+	for (int i = 0; i < 100; i++) {
+		keys.push_back("grouped_binlogs" + lv::str(i));
+	}
+	for (int i = 0; i < 100; i++) {
+		kvs.push_back(keys[i]);
+		kvs.push_back(keys[i]);
+	}
+	db->multi_set(kvs);
+	EXPECT_TRUE(wait_for([&processor]{ return processor.count == 101; }));
+	ASSERT_EQ(101u, processor.vals.size());
+	EXPECT_EQ("grouped_binlogs0", processor.vals[1]);
+	EXPECT_EQ("grouped_binlogs99", processor.vals[100]);
+	EXPECT_LT(processor.seqs[0], processor.seqs[1]);
+	EXPECT_EQ(processor.seqs[1], processor.seqs[100]);
+	sync->quit();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	db->del("grouped_binlogs");
+	db->multi_del(std::vector<lv::Bytes>(keys.begin(), keys.end()));
+	db->release();
+}
+
+TEST(LVDBTest, CdcCursor)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_cdc/";
+	opt.binlog_group = true;
+	lv::LVDB *db = lv::LVDB::open(opt);
+	lv::Cdc_Filter filter;
+	filter.types.push_back(lv::DataType::HASH);
+	filter.prefix = "cdc_user";
+	lv::Cdc_Cursor *cursor = db->subscribe("cdc", filter);
+	ASSERT_NE((lv::Cdc_Cursor *)NULL, cursor);
+	db->hset("cdc_user1", "a", "1");
+	db->hset("cdc_other", "a", "1");
+	db->set("cdc_user2", "1");
+	db->hdel("cdc_user1", "a");
+	std::vector<lv::Bytes> kvs;
+	kvs.push_back("a");
+	kvs.push_back("1");
+	kvs.push_back("b");
+	kvs.push_back("2");
+	db->multi_hset("cdc_user3", kvs);
+	std::vector<lv::Binlog> logs;
+	ASSERT_EQ(4, cursor->next(&logs, 1000, 100));
+	EXPECT_EQ(lv::BinlogCommand::HSET, logs[0].cmd());
+	EXPECT_EQ(lv::BinlogCommand::HDEL, logs[1].cmd());
+	EXPECT_EQ(logs[2].seq(), logs[3].seq());
+	EXPECT_EQ(0, cursor->next(&logs, 1000, 100));
+	cursor->commit();
+	delete cursor;
+
+	// resumes after the committed position
+	cursor = db->subscribe("cdc", filter);
+	EXPECT_EQ(0, cursor->next(&logs, 1000, 100));
+	db->hclear("cdc_user3");
+	ASSERT_EQ(1, cursor->next(&logs, 1000, 100));
+	EXPECT_EQ(lv::BinlogCommand::HCLEAR, logs[0].cmd());
+
+	// the binlogs flushed before they were read are reported lost
+	uint64_t seq = cursor->seq();
+	db->hset("cdc_user4", "a", "1");
+	db->flushdb();
+	EXPECT_EQ(-2, cursor->next(&logs, 1000, 100));
+	EXPECT_EQ(seq + 1, cursor->lost_begin());
+	EXPECT_EQ(seq + 1, cursor->lost_end());
+	EXPECT_EQ(0, cursor->next(&logs, 1000, 100));
+	cursor->remove();
+	delete cursor;
+	db->hclear("cdc_user1");
+	db->hclear("cdc_other");
+	db->del("cdc_user2");
+	db->release();
+}
+
+// a slow link, the binlogs pile up into large batches
+class Lagging_Backup_Processor : public lv::Backup_Server_Processor
+{
+public:
+	Lagging_Backup_Processor(lv::LVDB* db, const std::string& name, int lanes) :
+		lv::Backup_Server_Processor(db, name, lanes)
+	{
+	}
+
+	virtual int do_sync_batch(std::vector<lv::Sync_Item>& items) {
+		Sleep(20);
+		return lv::Backup_Server_Processor::do_sync_batch(items);
+	}
+};
+
+TEST(LVDBTest, ParallelApply)
+{
+	lv::Options opt;
+	opt.dir = "lvdb_parallel_master/";
+	opt.binlog_inline_value = 64;
+	lv::LVDB *master = lv::LVDB::open(opt);
+	opt.dir = "lvdb_parallel_slave/";
+	lv::LVDB *slave = lv::LVDB::open(opt);
+	master->set("parallel_apply", "0");
+	Lagging_Backup_Processor server(slave, "master", 4);
+	uint64_t seq = server.last_seq();
+	lv::Sync *sync = new lv::Sync("slave", master, &server);
+	sync->create();
+	sync->start();
+	ASSERT_TRUE(wait_for([&server, seq]{ return server.last_seq() > seq; }));
+	// the pushes and pops of a queue keep their order across the lanes
+	for (int i = 0; i < 2000; i++) {
+		std::string q = "parallel_apply" + lv::str(i % 8);
+		master->qpush_back(q, lv::str(i));
+		if (i % 3 == 0) {
+			std::string item;
+			master->qpop_front(q, &item);
+		}
+		master->hset("parallel_apply", lv::str(i % 50), lv::str(i));
+	}
+	// the last write, the batches are applied in order
+	EXPECT_TRUE(wait_for([slave]{
+		std::string v;
+		return slave->hget("parallel_apply", "49", &v) == 1 && v == "1999";
+	}));
+	sync->quit();
+	ASSERT_TRUE(wait_for([sync]{ return sync->stopped(); }));
+	for (int i = 0; i < 8; i++) {
+		std::string q = "parallel_apply" + lv::str(i);
+		std::vector<std::string> a, b;
+		master->qslice(q, 0, -1, &a);
+		slave->qslice(q, 0, -1, &b);
+		EXPECT_EQ(a, b);
+		master->qclear(q);
+		slave->qclear(q);
+	}
+	std::string a, b;
+	master->hget("parallel_apply", "7", &a);
+	slave->hget("parallel_apply", "7", &b);
+	EXPECT_EQ(a, b);
+	EXPECT_EQ(50, slave->hsize("parallel_apply"));
+	EXPECT_LT(4000u, server.last_seq());
+	master->hclear("parallel_apply");
+	slave->hclear("parallel_apply");
+	master->del("parallel_apply");
+	slave->del("parallel_apply");
+	master->release();
+	slave->release();
+}
+
 int main(int argc, char* argv[])
 {
 	testing::InitGoogleTest(&argc, argv);